@@ -0,0 +1,84 @@
+#include "benchmark_report.hh"
+
+#include <sstream>
+
+#include "file_util.hh"
+
+namespace camera_common
+{
+    static double Ratio(double _a, double _b)
+    {
+        return _b > 0 ? _a / _b : 0.0;
+    }
+
+    BenchmarkReport::BenchmarkReport() : seed(0) {}
+
+    void BenchmarkReport::SetConfiguration(const std::string &_world, unsigned int _seed)
+    {
+        world = _world;
+        seed = _seed;
+    }
+
+    void BenchmarkReport::AddEpisode(const EpisodeResult &_episode)
+    {
+        episodes.push_back(_episode);
+    }
+
+    std::string BenchmarkReport::ToJson() const
+    {
+        EpisodeResult total = {"", 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        double maxReload = 0;
+        std::ostringstream out;
+        out << "{\n  \"world\": \"" << world << "\",\n  \"seed\": " << seed
+            << ",\n  \"episodes\": [";
+        for(size_t i = 0; i < episodes.size(); i++){
+            const EpisodeResult &e = episodes[i];
+            out << (i ? "," : "") << "\n    {\"focus\": \"" << e.focus << "\""
+                << ", \"wall_time_s\": " << e.wallTime
+                << ", \"sim_time_s\": " << e.simTime
+                << ", \"real_time_factor\": " << Ratio(e.simTime, e.wallTime)
+                << ", \"reload_latency_s\": " << e.reloadLatency
+                << ", \"ticks\": " << e.ticks
+                << ", \"frames_captured\": " << e.framesCaptured
+                << ", \"frames_dropped\": " << e.framesDropped
+                << ", \"bytes_written\": " << e.bytesWritten
+                << ", \"asset_cache_hits\": " << e.assetHits
+                << ", \"asset_cache_misses\": " << e.assetMisses
+                << ", \"fps\": " << Ratio(e.framesCaptured, e.wallTime)
+                << ", \"disk_mb_per_s\": " << Ratio(e.bytesWritten / 1e6, e.wallTime) << "}";
+            total.wallTime += e.wallTime;
+            total.simTime += e.simTime;
+            total.reloadLatency += e.reloadLatency;
+            total.ticks += e.ticks;
+            total.framesCaptured += e.framesCaptured;
+            total.framesDropped += e.framesDropped;
+            total.bytesWritten += e.bytesWritten;
+            total.assetHits += e.assetHits;
+            total.assetMisses += e.assetMisses;
+            if(e.reloadLatency > maxReload) maxReload = e.reloadLatency;
+        }
+        out << "\n  ],\n  \"total\": {"
+            << "\"episodes\": " << episodes.size()
+            << ", \"wall_time_s\": " << total.wallTime
+            << ", \"sim_time_s\": " << total.simTime
+            << ", \"real_time_factor\": " << Ratio(total.simTime, total.wallTime)
+            << ", \"reload_latency_mean_s\": " << Ratio(total.reloadLatency, episodes.size())
+            << ", \"reload_latency_max_s\": " << maxReload
+            << ", \"ticks\": " << total.ticks
+            << ", \"frames_captured\": " << total.framesCaptured
+            << ", \"frames_dropped\": " << total.framesDropped
+            << ", \"bytes_written\": " << total.bytesWritten
+            << ", \"asset_cache_hits\": " << total.assetHits
+            << ", \"asset_cache_misses\": " << total.assetMisses
+            << ", \"asset_cache_hit_rate\": " << Ratio(total.assetHits, total.assetHits + total.assetMisses)
+            << ", \"fps\": " << Ratio(total.framesCaptured, total.wallTime)
+            << ", \"disk_mb_per_s\": " << Ratio(total.bytesWritten / 1e6, total.wallTime)
+            << "}\n}\n";
+        return out.str();
+    }
+
+    bool BenchmarkReport::Write(const std::string &_path) const
+    {
+        return WriteFileAtomically(_path, ToJson());
+    }
+}
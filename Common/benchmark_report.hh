@@ -0,0 +1,42 @@
+#ifndef _CAMERA_COMMON_BENCHMARK_REPORT_HH_
+#define _CAMERA_COMMON_BENCHMARK_REPORT_HH_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace camera_common
+{
+    // Measurements of one episode (one trajectory around one focus object).
+    struct EpisodeResult
+    {
+        std::string focus;
+        double wallTime;//s, from unpausing the world to the finished message
+        double simTime;//s of simulated time in the same interval
+        double reloadLatency;//s, from the reload request until all models were spawned
+        uint64_t ticks;
+        uint64_t framesCaptured;
+        uint64_t framesDropped;
+        uint64_t bytesWritten;
+        uint64_t assetHits;//model inserts served from the parsed SDF cache of the world
+        uint64_t assetMisses;//model inserts that read and parsed the model file
+    };
+
+    // Collects the episodes of a benchmark run and writes them, with
+    // aggregated frame rate, real time factor and disk throughput, as json.
+    // Keys are stable so reports of two builds can be diffed directly.
+    class BenchmarkReport
+    {
+        public: BenchmarkReport();
+        public: void SetConfiguration(const std::string &_world, unsigned int _seed);
+        public: void AddEpisode(const EpisodeResult &_episode);
+        public: size_t EpisodeCount() const { return episodes.size(); }
+        public: std::string ToJson() const;
+        public: bool Write(const std::string &_path) const;
+
+        private: std::string world;
+        private: unsigned int seed;
+        private: std::vector<EpisodeResult> episodes;
+    };
+}
+#endif
@@ -0,0 +1,55 @@
+#include "capture_manifest.hh"
+
+#include <stdlib.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "file_util.hh"
+
+namespace camera_common
+{
+    CaptureManifest::CaptureManifest() : frames(0), nextFrameId(0), failed(0) {}
+
+    void CaptureManifest::AddFrame(uint64_t _id, int _label)
+    {
+        frames++;
+        if(_id + 1 > nextFrameId) nextFrameId = _id + 1;
+        if(_label < 0) return;
+        if((size_t)_label >= labels.size()) labels.resize(_label + 1, 0);
+        labels[_label]++;
+    }
+
+    std::string CaptureManifest::ToJson() const
+    {
+        std::ostringstream out;
+        out << "{\n  \"codec\": \"" << codec << "\",\n  \"pixel_format\": \"" << format
+            << "\",\n  \"output\": \"" << output
+            << "\",\n  \"layout\": \"" << layout
+            << "\",\n  \"frames\": " << frames
+            << ",\n  \"next_frame_id\": " << nextFrameId
+            << ",\n  \"failed_frames\": " << failed
+            << ",\n  \"labels\": {";
+        for(size_t i = 0; i < labels.size(); i++)
+            out << (i ? ", " : "") << "\"" << i << "\": " << labels[i];
+        out << "}\n}\n";
+        return out.str();
+    }
+
+    bool CaptureManifest::Write(const std::string &_directory) const
+    {
+        return WriteFileAtomically(_directory + "/" + MANIFEST_FILE, ToJson());
+    }
+
+    int64_t ReadManifestNumber(const std::string &_directory, const char *_key)
+    {
+        std::ifstream in((_directory + "/" + MANIFEST_FILE).c_str());
+        if(!in) return -1;
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        std::string json = buffer.str(), key = std::string("\"") + _key + "\":";
+        size_t p = json.find(key);
+        if(p == std::string::npos) return -1;
+        return strtoll(json.c_str() + p + key.size(), NULL, 10);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef _CAMERA_COMMON_CAPTURE_MANIFEST_HH_
+#define _CAMERA_COMMON_CAPTURE_MANIFEST_HH_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace camera_common
+{
+    static const char *const MANIFEST_FILE = "manifest.json";
+
+    // Summary of one output directory, kept up to date by the
+    // CapturePipeline in <directory>/manifest.json.
+    struct CaptureManifest
+    {
+        std::string codec;
+        std::string format;//pixel format of the frames
+        std::string output;
+        std::string layout;
+        uint64_t frames;//frames written
+        uint64_t nextFrameId;//one past the highest frame id written
+        uint64_t failed;//frames whose write failed after they got their id, the gaps in the ids
+        std::vector<uint64_t> labels;//frames written per label
+
+        CaptureManifest();
+        void AddFrame(uint64_t _id, int _label);
+        void AddFailed() { failed++; }
+        std::string ToJson() const;
+        bool Write(const std::string &_directory) const;
+    };
+
+    // The number _key (e.g. "frames") of <_directory>/manifest.json, -1
+    // without a manifest or without the key.
+    int64_t ReadManifestNumber(const std::string &_directory, const char *_key);
+}
+#endif
@@ -0,0 +1,305 @@
+#include "capture_pipeline.hh"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "trace.hh"
+
+namespace camera_common
+{
+    CaptureConfig::CaptureConfig()
+        : codec(CODEC_JPEG), quality(75), compression(6), format(PIXEL_RGB), output(OUTPUT_FILES),
+          threads(2), queueSize(64), dropWhenFull(false),
+          append(false), layout(LAYOUT_FLAT), framesPerDir(1000), hashDirs(256),
+          io(IO_SYNC), ioDepth(16), streamQueue(64), streamBatch(16) {}
+
+    CapturePipeline::CapturePipeline(const CaptureConfig &_config)
+        : config(_config), encode(true), pending(0), stopping(false),
+          written(0), dropped(0), failed(0), bytes(0), generation(0)
+    {
+        if(config.threads == 0) config.threads = 1;
+        if(config.queueSize == 0) config.queueSize = 1;
+        if(config.output == OUTPUT_VIDEO && !VideoFrameWriter::Available()){
+            fprintf(stderr, "[CAPTURE]: built without libavcodec, writing %s files instead of video\n", CodecName(config.codec));
+            config.output = OUTPUT_FILES;
+        }
+        if(config.output == OUTPUT_VIDEO && config.format != PIXEL_RGB){
+            fprintf(stderr, "[CAPTURE]: video output converts to yuv420 itself, ignoring pixel format %s\n",
+                PixelFormatName(config.format));
+            config.format = PIXEL_RGB;
+        }
+        //video and npy output take the pixels, there is nothing to encode
+        encode = config.output != OUTPUT_VIDEO && config.output != OUTPUT_NPY;
+        if(encode && !CodecSupports(config.codec, config.format)){
+            fprintf(stderr, "[CAPTURE]: %s cannot store %s frames, using raw\n",
+                CodecName(config.codec), PixelFormatName(config.format));
+            config.codec = CODEC_RAW;
+        }
+        //the encoder needs the frames in order
+        if(config.output == OUTPUT_VIDEO) config.threads = 1;
+        else if(encode && config.codec == CODEC_DELTA){
+            config.delta.threads = config.threads;
+            config.threads = 1;
+        }
+        io = IoBackend::Create(config.io, config.ioDepth);
+        if(config.output == OUTPUT_SHARDS)
+            writer.reset(new ShardFrameWriter(config.codec, config.shard, io.get()));
+        else if(config.output == OUTPUT_VIDEO)
+            writer.reset(new VideoFrameWriter(config.video));
+        else if(config.output == OUTPUT_NPY)
+            writer.reset(new NpyFrameWriter());
+        else
+            writer.reset(new FileFrameWriter(FrameLayout(config.layout, config.framesPerDir, config.hashDirs), io.get()));
+        writer->SetExclusive(config.append);
+        writer->SetCompletion([this](uint64_t _id, int _label, size_t _size, bool _ok){
+            Finished(_id, _label, _size, _ok);
+        });
+        if(config.stream != ""){
+            server.reset(new FrameServer(config.streamQueue, config.streamBatch));
+            if(!server->Start(config.stream)) server.reset();
+        }
+        manifest.codec = config.output == OUTPUT_VIDEO ? "h264" : encode ? CodecName(config.codec) : "none";
+        manifest.format = PixelFormatName(config.format);
+        manifest.output = OutputModeName(config.output);
+        manifest.layout = config.output == OUTPUT_FILES ?
+            FrameLayout(config.layout, config.framesPerDir, config.hashDirs).Describe() : "flat";
+        for(unsigned int i = 0; i < config.threads; i++){
+            latencies.push_back(std::unique_ptr<LatencyHistogram>(new LatencyHistogram()));
+            workers.push_back(std::thread(&CapturePipeline::Run, this, i));
+        }
+    }
+
+    CapturePipeline::~CapturePipeline()
+    {
+        Flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        notEmpty.notify_all();
+        for(size_t i = 0; i < workers.size(); i++) workers[i].join();
+        //closing may complete the last frames
+        writer->Close();
+        WriteManifest();
+    }
+
+    bool CapturePipeline::SetOutputDirectory(const std::string &_directory)
+    {
+        Flush();
+        writer->Close();
+        WriteManifest();
+        CaptureManifest fresh;
+        fresh.codec = manifest.codec;
+        fresh.format = manifest.format;
+        fresh.output = manifest.output;
+        fresh.layout = manifest.layout;
+        if(config.append){
+            writer->Scan(_directory, fresh);
+            //the gaps the earlier runs left
+            int64_t failedBefore = ReadManifestNumber(_directory, "failed_frames");
+            if(failedBefore > 0) fresh.failed = failedBefore;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            directory = _directory;
+            manifest = fresh;
+        }
+        generation++;
+        return writer->Open(_directory);
+    }
+
+    CaptureManifest CapturePipeline::Manifest()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return manifest;
+    }
+
+    uint64_t CapturePipeline::NextFrameId()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return manifest.nextFrameId;
+    }
+
+    void CapturePipeline::WriteManifest()
+    {
+        std::lock_guard<std::mutex> writing(manifestMutex);
+        CaptureManifest copy;
+        std::string dir;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(directory == "" || manifest.frames == 0) return;
+            copy = manifest;
+            dir = directory;
+        }
+        if(!copy.Write(dir)) fprintf(stderr, "[CAPTURE]: could not write the manifest in %s\n", dir.c_str());
+    }
+
+    void CapturePipeline::Finished(uint64_t _id, int _label, size_t _size, bool _ok)
+    {
+        CaptureStats &stats = CaptureStats::Instance();
+        if(!_ok){
+            failed++;
+            stats.Add(COUNTER_FRAMES_DROPPED);
+            std::lock_guard<std::mutex> lock(mutex);
+            manifest.AddFailed();
+            return;
+        }
+        written++;
+        bytes += _size;
+        stats.Add(COUNTER_FRAMES_SAVED);
+        stats.Add(COUNTER_BYTES_WRITTEN, _size);
+        bool writeManifest;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            manifest.AddFrame(_id, _label);
+            writeManifest = manifest.frames % MANIFEST_INTERVAL == 0;
+        }
+        //before the frame counts as done, so Flush also waits for the manifest
+        if(writeManifest) WriteManifest();
+    }
+
+    CaptureFrame *CapturePipeline::Acquire()
+    {
+        if(pool.empty()){
+            frames.push_back(std::unique_ptr<CaptureFrame>(new CaptureFrame()));
+            return frames.back().get();
+        }
+        CaptureFrame *f = pool.back();
+        pool.pop_back();
+        return f;
+    }
+
+    void CapturePipeline::Release(CaptureFrame *_frame)
+    {
+        pool.push_back(_frame);
+    }
+
+    bool CapturePipeline::Submit(uint64_t _id, int _label, const std::string &_name,
+        const unsigned char *_pixels, unsigned int _width,
+        unsigned int _height, unsigned int _channels)
+    {
+        CaptureStats &stats = CaptureStats::Instance();
+        CaptureFrame *frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if(queue.size() >= config.queueSize){
+                if(config.dropWhenFull){
+                    dropped++;
+                    stats.Add(COUNTER_FRAMES_DROPPED);
+                    return false;
+                }
+                notFull.wait(lock, [this]{ return queue.size() < config.queueSize; });
+            }
+            frame = Acquire();
+            pending++;
+        }
+        uint64_t start = NowNs();
+        frame->submitted = start;
+        frame->id = _id;
+        frame->label = _label;
+        frame->name = _name;
+        frame->width = _width;
+        frame->height = _height;
+        frame->channels = _channels;
+        frame->format = PIXEL_RGB;
+        frame->pixels.assign(_pixels, _pixels + (size_t)_width * _height * _channels);
+        stats.Record(STAGE_COPY, NowNs() - start);
+        size_t depth;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(frame);
+            depth = queue.size();
+        }
+        stats.SetGauge(GAUGE_QUEUE_DEPTH, depth);
+        notEmpty.notify_one();
+        return true;
+    }
+
+    void CapturePipeline::Flush()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [this]{ return pending == 0; });
+        }
+        writer->Flush();
+    }
+
+    std::vector<uint64_t> CapturePipeline::Latencies()
+    {
+        std::vector<uint64_t> total;
+        for(size_t i = 0; i < latencies.size(); i++) latencies[i]->MergeInto(total);
+        return total;
+    }
+
+    void CapturePipeline::Run(unsigned int _worker)
+    {
+        CaptureStats &stats = CaptureStats::Instance();
+        FrameEncoder encoder(config.codec, config.quality, config.compression, config.delta);
+        uint64_t encoderGeneration = generation.load();
+        std::vector<unsigned char> converted;//swapped with the pixels of the frame
+        while(true){
+            CaptureFrame *frame;
+            size_t depth;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                //the first worker lets the writer keep its deadlines while no frames arrive
+                while(_worker == 0 && !stopping && queue.empty()){
+                    if(notEmpty.wait_for(lock, std::chrono::seconds(1)) == std::cv_status::timeout){
+                        lock.unlock();
+                        writer->Poll();
+                        lock.lock();
+                    }
+                }
+                notEmpty.wait(lock, [this]{ return stopping || !queue.empty(); });
+                if(queue.empty()) return;//stopping
+                frame = queue.front();
+                queue.pop_front();
+                depth = queue.size();
+            }
+            notFull.notify_one();
+            stats.SetGauge(GAUGE_QUEUE_DEPTH, depth);
+
+            if(encoderGeneration != generation.load()){
+                //no frames in flight while the directory changes
+                encoder.Reset();
+                encoderGeneration = generation.load();
+            }
+            bool ok = true;
+            if(config.format != PIXEL_RGB){
+                uint64_t start = NowNs();
+                ok = ConvertPixels(config.format, frame->pixels.data(), frame->width, frame->height,
+                    frame->channels, converted);
+                if(ok){
+                    frame->pixels.swap(converted);
+                    frame->format = config.format;
+                }
+                stats.Record(STAGE_CONVERT, NowNs() - start);
+            }
+            uint64_t start = NowNs();
+            if(ok) ok = !encode || encoder.Encode(*frame);
+            uint64_t encoded = NowNs();
+            stats.Record(STAGE_ENCODE, encoded - start);
+            Tracer::Instance().Record("encode", "capture", start, encoded);
+            if(ok && server && !frame->encoded.empty()) server->Publish(*frame, config.codec);
+            if(ok) ok = writer->Write(*frame);
+            uint64_t end = NowNs();
+            stats.Record(STAGE_WRITE, end - encoded);
+            Tracer::Instance().Record("write", "capture", encoded, end);
+
+            if(ok) latencies[_worker]->Record(end - frame->submitted);
+            //a queued asynchronous write is counted by the completion of the writer
+            if(!ok || !writer->Asynchronous()){
+                size_t size = config.output == OUTPUT_NPY ? frame->pixels.size() : frame->encoded.size();
+                Finished(frame->id, frame->label, size, ok);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                Release(frame);
+                pending--;
+                if(pending == 0) idle.notify_all();
+            }
+        }
+    }
+}
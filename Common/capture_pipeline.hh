@@ -0,0 +1,134 @@
+#ifndef _CAMERA_COMMON_CAPTURE_PIPELINE_HH_
+#define _CAMERA_COMMON_CAPTURE_PIPELINE_HH_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_manifest.hh"
+#include "capture_stats.hh"
+#include "frame_encoder.hh"
+#include "frame_server.hh"
+#include "frame_writer.hh"
+#include "npy_writer.hh"
+#include "video_writer.hh"
+
+namespace camera_common
+{
+    struct CaptureConfig
+    {
+        Codec codec;
+        int quality;//jpeg quality
+        int compression;//png zlib level
+        PixelFormat format;//converted on the workers before encoding
+        OutputMode output;
+        unsigned int threads;//encode/write workers
+        unsigned int queueSize;//frames waiting for a worker
+        bool dropWhenFull;//drop instead of blocking the render thread
+        ShardOptions shard;//shards output: size, write coalescing, durability, page cache
+        VideoOptions video;//video output
+        DeltaOptions delta;//delta codec: keyframe interval and zlib level, tile threads are set from threads
+        bool append;//continue after the frames already in a directory, never overwrite
+        LayoutMode layout;//sub directories for files output
+        unsigned int framesPerDir;//LAYOUT_CHUNKED
+        unsigned int hashDirs;//LAYOUT_HASHED
+        IoBackendMode io;//how the writes are issued
+        unsigned int ioDepth;//writes in flight (io_uring) or pwrite threads
+        std::string stream;//serve encoded frames on unix:<path> or tcp:<port>, empty for none
+        unsigned int streamQueue;//frames queued per subscriber before its oldest are dropped
+        unsigned int streamBatch;//frames per send
+        CaptureConfig();
+    };
+
+    // Copies rendered frames into a bounded queue and encodes/writes them on
+    // worker threads, so the render callback only pays for the copy. With
+    // a stream address every encoded frame is also served by a FrameServer
+    // before it is written. Frames are converted to config.format on the
+    // workers; yuv420 and chw_f32 need the raw or delta codec, jpg and png
+    // fall back to raw. Video output skips the image codec and runs
+    // with one worker, it falls back to files in builds without libavcodec.
+    // Npy output also skips the codec and appends the converted pixels.
+    // The delta codec also needs the frames in order: it runs one worker
+    // that encodes the tiles of a frame on 'threads' threads, and starts
+    // with a keyframe in every output directory.
+    // Records copy/encode/write latencies, the queue depth and dropped
+    // frames in CaptureStats. Keeps a CaptureManifest of the written frames
+    // in the output directory, rewritten every MANIFEST_INTERVAL frames and
+    // when the directory changes.
+    class CapturePipeline
+    {
+        public: explicit CapturePipeline(const CaptureConfig &_config);
+        public: ~CapturePipeline();
+
+        // Waits for the frames in flight, then writes new frames to _directory.
+        // In append mode the frames already there are counted (once, by
+        // scanning the directory or shard index; the manifest may lag behind
+        // after a crash) and NextFrameId continues after them.
+        public: bool SetOutputDirectory(const std::string &_directory);
+        // Copy and queue one frame. Returns false if it was dropped.
+        public: bool Submit(uint64_t _id, int _label, const std::string &_name,
+            const unsigned char *_pixels, unsigned int _width,
+            unsigned int _height, unsigned int _channels);
+        // Block until every submitted frame is written. With an IoBackend
+        // file frames count as written (and go into the manifest) when their
+        // write finished; a write that fails then is logged, counted as
+        // COUNTER_WRITE_ERRORS and the frame as failed.
+        public: void Flush();
+
+        public: const CaptureConfig &Config() const { return config; }
+        public: const char *Extension(unsigned int _channels) const
+        {
+            return FrameExtension(config.codec, config.format, _channels);
+        }
+        public: uint64_t FramesWritten() const { return written.load(); }
+        public: uint64_t FramesDropped() const { return dropped.load(); }
+        public: uint64_t FramesFailed() const { return failed.load(); }
+        public: uint64_t BytesWritten() const { return bytes.load(); }
+        // Submit to written latency histogram of all frames so far.
+        public: std::vector<uint64_t> Latencies();
+
+        // Frames written to the current directory so far.
+        public: CaptureManifest Manifest();
+        public: uint64_t NextFrameId();
+
+        private: static const uint64_t MANIFEST_INTERVAL = 256;
+        private: void Run(unsigned int _worker);
+        private: void WriteManifest();
+        // Counts a frame as written or failed and adds written frames to the manifest.
+        private: void Finished(uint64_t _id, int _label, size_t _size, bool _ok);
+        private: CaptureFrame *Acquire();
+        private: void Release(CaptureFrame *_frame);
+
+        private: CaptureConfig config;
+        private: bool encode;//false for output that takes the pixels
+        private: std::unique_ptr<IoBackend> io;//outlives writer
+        private: std::unique_ptr<FrameWriter> writer;
+        private: std::unique_ptr<FrameServer> server;
+        private: std::mutex mutex;
+        private: std::condition_variable notEmpty;
+        private: std::condition_variable notFull;
+        private: std::condition_variable idle;
+        private: std::deque<CaptureFrame *> queue;
+        private: std::vector<CaptureFrame *> pool;//reused frame buffers
+        private: std::vector<std::unique_ptr<CaptureFrame> > frames;
+        private: unsigned int pending;//submitted but not yet written
+        private: bool stopping;
+        private: std::vector<std::thread> workers;
+        private: std::vector<std::unique_ptr<LatencyHistogram> > latencies;//one per worker
+        private: std::atomic<uint64_t> written;
+        private: std::atomic<uint64_t> dropped;
+        private: std::atomic<uint64_t> failed;
+        private: std::atomic<uint64_t> bytes;
+        private: std::atomic<uint64_t> generation;//incremented by SetOutputDirectory, resets the encoders
+        private: std::string directory;
+        private: CaptureManifest manifest;//guarded by mutex
+        private: std::mutex manifestMutex;//one manifest write at a time
+    };
+}
+#endif
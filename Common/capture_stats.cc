@@ -0,0 +1,278 @@
+#include "capture_stats.hh"
+
+#include <chrono>
+#include <sstream>
+
+#include "file_util.hh"
+
+namespace camera_common
+{
+    uint64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    const char *StageName(Stage _stage)
+    {
+        switch(_stage){
+            case STAGE_UPDATE: return "update";
+            case STAGE_RENDER: return "render";
+            case STAGE_COPY: return "copy";
+            case STAGE_CONVERT: return "convert";
+            case STAGE_ENCODE: return "encode";
+            case STAGE_WRITE: return "write";
+            default: return "unknown";
+        }
+    }
+
+    const char *CounterName(Counter _counter)
+    {
+        switch(_counter){
+            case COUNTER_TICKS: return "ticks";
+            case COUNTER_FRAMES_SEEN: return "frames_seen";
+            case COUNTER_FRAMES_SAVED: return "frames_saved";
+            case COUNTER_FRAMES_DROPPED: return "frames_dropped";
+            case COUNTER_BYTES_WRITTEN: return "bytes_written";
+            case COUNTER_FRAMES_BLANK: return "frames_blank";
+            case COUNTER_FRAMES_DUPLICATE: return "frames_duplicate";
+            case COUNTER_FRAMES_BALANCED: return "frames_balanced";
+            case COUNTER_WRITE_ERRORS: return "write_errors";
+            case COUNTER_FRAMES_STREAMED: return "frames_streamed";
+            case COUNTER_FRAMES_STREAM_DROPPED: return "frames_stream_dropped";
+            default: return "unknown";
+        }
+    }
+
+    const char *GaugeName(Gauge _gauge)
+    {
+        switch(_gauge){
+            case GAUGE_QUEUE_DEPTH: return "queue_depth";
+            case GAUGE_STREAM_SUBSCRIBERS: return "stream_subscribers";
+            default: return "unknown";
+        }
+    }
+
+    // Owner thread only: a relaxed load/store pair is enough and avoids the
+    // locked instruction of fetch_add.
+    static inline void Bump(std::atomic<uint64_t> &_a, uint64_t _n)
+    {
+        _a.store(_a.load(std::memory_order_relaxed) + _n, std::memory_order_relaxed);
+    }
+
+    /////////////////////////////////////////////////
+    LatencyHistogram::LatencyHistogram()
+    {
+        for(int i = 0; i < BUCKET_COUNT; i++) buckets[i].store(0, std::memory_order_relaxed);
+    }
+
+    int LatencyHistogram::BucketIndex(uint64_t _value)
+    {
+        if(_value < (uint64_t)SUB_COUNT) return (int)_value;
+        int e = 63 - __builtin_clzll(_value);
+        int sub = (int)((_value >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+        return (e - SUB_BITS + 1) * SUB_COUNT + sub;
+    }
+
+    uint64_t LatencyHistogram::BucketValue(int _index)
+    {
+        if(_index < SUB_COUNT) return _index;
+        int e = _index / SUB_COUNT + SUB_BITS - 1;
+        uint64_t sub = _index % SUB_COUNT;
+        uint64_t low = (SUB_COUNT + sub) << (e - SUB_BITS);
+        return low + ((1ULL << (e - SUB_BITS)) >> 1);
+    }
+
+    void LatencyHistogram::Record(uint64_t _value)
+    {
+        Bump(buckets[BucketIndex(_value)], 1);
+    }
+
+    void LatencyHistogram::MergeInto(std::vector<uint64_t> &_total) const
+    {
+        _total.resize(BUCKET_COUNT, 0);
+        for(int i = 0; i < BUCKET_COUNT; i++) _total[i] += buckets[i].load(std::memory_order_relaxed);
+    }
+
+    LatencySummary Summarize(const std::vector<uint64_t> &_buckets)
+    {
+        LatencySummary s = {0, 0, 0, 0, 0};
+        for(size_t i = 0; i < _buckets.size(); i++) s.count += _buckets[i];
+        if(s.count == 0) return s;
+        const double q[4] = {0.5, 0.9, 0.99, 0.999};
+        uint64_t *out[4] = {&s.p50, &s.p90, &s.p99, &s.p999};
+        int qi = 0;
+        uint64_t seen = 0;
+        for(size_t i = 0; i < _buckets.size() && qi < 4; i++){
+            seen += _buckets[i];
+            while(qi < 4 && seen >= (uint64_t)(q[qi] * s.count + 0.5)){
+                *out[qi] = LatencyHistogram::BucketValue(i);
+                qi++;
+            }
+        }
+        return s;
+    }
+
+    ThreadStats::ThreadStats()
+    {
+        for(int i = 0; i < COUNTER_COUNT; i++) counters[i].store(0, std::memory_order_relaxed);
+        for(int i = 0; i < STAGE_COUNT; i++){
+            sums[i].store(0, std::memory_order_relaxed);
+            maxima[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /////////////////////////////////////////////////
+    CaptureStats &CaptureStats::Instance()
+    {
+        static CaptureStats instance;
+        return instance;
+    }
+
+    CaptureStats::CaptureStats()
+    {
+        for(int i = 0; i < GAUGE_COUNT; i++){
+            gauges[i].store(0, std::memory_order_relaxed);
+            gaugeMaxima[i].store(0, std::memory_order_relaxed);
+        }
+        startNs = NowNs();
+    }
+
+    ThreadStats &CaptureStats::Local()
+    {
+        static thread_local ThreadStats *local = NULL;
+        if(local == NULL){
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.push_back(std::unique_ptr<ThreadStats>(new ThreadStats()));
+            local = threads.back().get();
+        }
+        return *local;
+    }
+
+    void CaptureStats::Add(Counter _counter, uint64_t _n)
+    {
+        Bump(Local().counters[_counter], _n);
+    }
+
+    void CaptureStats::Record(Stage _stage, uint64_t _ns)
+    {
+        ThreadStats &t = Local();
+        t.histograms[_stage].Record(_ns);
+        Bump(t.sums[_stage], _ns);
+        if(_ns > t.maxima[_stage].load(std::memory_order_relaxed))
+            t.maxima[_stage].store(_ns, std::memory_order_relaxed);
+    }
+
+    void CaptureStats::SetGauge(Gauge _gauge, uint64_t _value)
+    {
+        gauges[_gauge].store(_value, std::memory_order_relaxed);
+        uint64_t m = gaugeMaxima[_gauge].load(std::memory_order_relaxed);
+        while(_value > m && !gaugeMaxima[_gauge].compare_exchange_weak(m, _value, std::memory_order_relaxed));
+    }
+
+    uint64_t CaptureStats::Total(Counter _counter)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t total = 0;
+        for(size_t i = 0; i < threads.size(); i++)
+            total += threads[i]->counters[_counter].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    std::string CaptureStats::ToJson()
+    {
+        uint64_t counters[COUNTER_COUNT] = {0};
+        uint64_t sums[STAGE_COUNT] = {0};
+        uint64_t maxima[STAGE_COUNT] = {0};
+        std::vector<std::vector<uint64_t> > buckets(STAGE_COUNT);
+        size_t threadCount;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threadCount = threads.size();
+            for(size_t t = 0; t < threads.size(); t++){
+                for(int i = 0; i < COUNTER_COUNT; i++)
+                    counters[i] += threads[t]->counters[i].load(std::memory_order_relaxed);
+                for(int s = 0; s < STAGE_COUNT; s++){
+                    sums[s] += threads[t]->sums[s].load(std::memory_order_relaxed);
+                    uint64_t m = threads[t]->maxima[s].load(std::memory_order_relaxed);
+                    if(m > maxima[s]) maxima[s] = m;
+                    threads[t]->histograms[s].MergeInto(buckets[s]);
+                }
+            }
+        }
+        uint64_t now = NowNs();
+        std::ostringstream out;
+        out << "{\n  \"timestamp_ns\": " << now
+            << ",\n  \"uptime_s\": " << (now - startNs) / 1e9
+            << ",\n  \"threads\": " << threadCount
+            << ",\n  \"counters\": {";
+        for(int i = 0; i < COUNTER_COUNT; i++)
+            out << (i ? ", " : "") << "\"" << CounterName((Counter)i) << "\": " << counters[i];
+        out << "},\n  \"gauges\": {";
+        for(int i = 0; i < GAUGE_COUNT; i++)
+            out << (i ? ", " : "") << "\"" << GaugeName((Gauge)i) << "\": "
+                << gauges[i].load(std::memory_order_relaxed) << ", \""
+                << GaugeName((Gauge)i) << "_max\": " << gaugeMaxima[i].load(std::memory_order_relaxed);
+        out << "},\n  \"latency_us\": {";
+        for(int s = 0; s < STAGE_COUNT; s++){
+            LatencySummary l = Summarize(buckets[s]);
+            out << (s ? "," : "") << "\n    \"" << StageName((Stage)s) << "\": {"
+                << "\"count\": " << l.count
+                << ", \"mean\": " << (l.count ? sums[s] / 1e3 / l.count : 0.0)
+                << ", \"p50\": " << l.p50 / 1e3
+                << ", \"p90\": " << l.p90 / 1e3
+                << ", \"p99\": " << l.p99 / 1e3
+                << ", \"p999\": " << l.p999 / 1e3
+                << ", \"max\": " << maxima[s] / 1e3 << "}";
+        }
+        out << "\n  }\n}\n";
+        return out.str();
+    }
+
+    /////////////////////////////////////////////////
+    StatsDumper::StatsDumper() : interval(5.0), running(false) {}
+
+    StatsDumper::~StatsDumper()
+    {
+        Stop();
+    }
+
+    void StatsDumper::Start(const std::string &_path, double _intervalSeconds)
+    {
+        Stop();
+        path = _path;
+        interval = _intervalSeconds > 0 ? _intervalSeconds : 5.0;
+        running = true;
+        thread = std::thread(&StatsDumper::Run, this);
+    }
+
+    void StatsDumper::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!running) return;
+            running = false;
+        }
+        wake.notify_all();
+        thread.join();
+        Dump();//final numbers
+    }
+
+    bool StatsDumper::Dump()
+    {
+        if(path == "") return false;
+        return WriteFileAtomically(path, CaptureStats::Instance().ToJson());
+    }
+
+    void StatsDumper::Run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(running){
+            wake.wait_for(lock, std::chrono::duration<double>(interval));
+            if(!running) break;
+            lock.unlock();
+            Dump();
+            lock.lock();
+        }
+    }
+}
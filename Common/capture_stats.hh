@@ -0,0 +1,159 @@
+#ifndef _CAMERA_COMMON_CAPTURE_STATS_HH_
+#define _CAMERA_COMMON_CAPTURE_STATS_HH_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace camera_common
+{
+    // Monotonic clock in nanoseconds, used for every stage timestamp.
+    uint64_t NowNs();
+
+    // Stages of the simulation / capture loop that get a latency histogram.
+    enum Stage
+    {
+        STAGE_UPDATE = 0,   // controller OnUpdate
+        STAGE_RENDER,       // Camera_gt OnNewFrame, the whole render callback
+        STAGE_COPY,         // copy of the rendered image out of the sensor buffer
+        STAGE_CONVERT,      // conversion to the configured pixel format
+        STAGE_ENCODE,       // image encoding
+        STAGE_WRITE,        // writing the encoded frame to disk
+        STAGE_COUNT
+    };
+
+    // Monotonic counters, summed over all threads when dumped.
+    enum Counter
+    {
+        COUNTER_TICKS = 0,      // controller updates
+        COUNTER_FRAMES_SEEN,    // frames delivered to Camera_gt
+        COUNTER_FRAMES_SAVED,   // frames that landed on disk
+        COUNTER_FRAMES_DROPPED, // frames that should have been saved but were not
+        COUNTER_BYTES_WRITTEN,
+        COUNTER_FRAMES_BLANK,   // frames skipped because nothing is rendered yet
+        COUNTER_FRAMES_DUPLICATE, // frames skipped because they equal the previous saved frame
+        COUNTER_FRAMES_BALANCED, // frames skipped to keep the labels balanced
+        COUNTER_WRITE_ERRORS,   // asynchronous writes that failed after the frame was counted as saved
+        COUNTER_FRAMES_STREAMED, // frames sent to stream subscribers, once per subscriber
+        COUNTER_FRAMES_STREAM_DROPPED, // frames a slow stream subscriber did not get
+        COUNTER_COUNT
+    };
+
+    // Instantaneous values; the maximum is kept next to the current value.
+    enum Gauge
+    {
+        GAUGE_QUEUE_DEPTH = 0,
+        GAUGE_STREAM_SUBSCRIBERS,
+        GAUGE_COUNT
+    };
+
+    const char *StageName(Stage _stage);
+    const char *CounterName(Counter _counter);
+    const char *GaugeName(Gauge _gauge);
+
+    // HDR style log-linear histogram: every power of two is split in 16
+    // linear sub buckets, so the relative error is below 6.25% from 1ns up to
+    // the full 64 bit range. Only the owning thread records into it.
+    class LatencyHistogram
+    {
+        public: static const int SUB_BITS = 4;
+        public: static const int SUB_COUNT = 1 << SUB_BITS;
+        public: static const int BUCKET_COUNT = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+        public: LatencyHistogram();
+        public: void Record(uint64_t _value);
+        // Add the contents of this histogram to _total (plain counts).
+        public: void MergeInto(std::vector<uint64_t> &_total) const;
+
+        public: static int BucketIndex(uint64_t _value);
+        public: static uint64_t BucketValue(int _index);//midpoint of the bucket
+
+        private: std::atomic<uint64_t> buckets[BUCKET_COUNT];
+    };
+
+    // Summary of a merged histogram, values in nanoseconds.
+    struct LatencySummary
+    {
+        uint64_t count;
+        uint64_t p50;
+        uint64_t p90;
+        uint64_t p99;
+        uint64_t p999;
+    };
+
+    LatencySummary Summarize(const std::vector<uint64_t> &_buckets);
+
+    // Statistics of a single thread. Written without locks by its owner,
+    // read with relaxed loads by whoever takes a snapshot.
+    struct ThreadStats
+    {
+        std::atomic<uint64_t> counters[COUNTER_COUNT];
+        std::atomic<uint64_t> sums[STAGE_COUNT];
+        std::atomic<uint64_t> maxima[STAGE_COUNT];
+        LatencyHistogram histograms[STAGE_COUNT];
+        ThreadStats();
+    };
+
+    // Process wide registry. Every thread lazily registers its own
+    // ThreadStats the first time it records something.
+    class CaptureStats
+    {
+        public: static CaptureStats &Instance();
+
+        public: void Add(Counter _counter, uint64_t _n = 1);
+        public: void Record(Stage _stage, uint64_t _ns);
+        public: void SetGauge(Gauge _gauge, uint64_t _value);
+        public: uint64_t Total(Counter _counter);
+
+        // Machine readable snapshot of everything recorded so far.
+        public: std::string ToJson();
+
+        private: CaptureStats();
+        private: ThreadStats &Local();
+
+        private: std::mutex mutex;//only taken when a thread registers
+        private: std::vector<std::unique_ptr<ThreadStats> > threads;
+        private: std::atomic<uint64_t> gauges[GAUGE_COUNT];
+        private: std::atomic<uint64_t> gaugeMaxima[GAUGE_COUNT];
+        private: uint64_t startNs;
+    };
+
+    // Records the lifetime of the object as one sample of _stage.
+    class ScopedStageTimer
+    {
+        public: explicit ScopedStageTimer(Stage _stage)
+            : stage(_stage), start(NowNs()) {}
+        public: ~ScopedStageTimer()
+        {
+            CaptureStats::Instance().Record(stage, NowNs() - start);
+        }
+        private: Stage stage;
+        private: uint64_t start;
+    };
+
+    // Background thread that periodically writes CaptureStats::ToJson to a
+    // file. The file is replaced atomically so readers never see half a dump.
+    class StatsDumper
+    {
+        public: StatsDumper();
+        public: ~StatsDumper();
+        public: void Start(const std::string &_path, double _intervalSeconds);
+        public: void Stop();
+        public: bool Dump();
+
+        private: void Run();
+
+        private: std::string path;
+        private: double interval;
+        private: bool running;
+        private: std::mutex mutex;
+        private: std::condition_variable wake;
+        private: std::thread thread;
+    };
+}
+#endif
@@ -0,0 +1,382 @@
+#include "color_convert.hh"
+
+#include <string.h>
+#include <immintrin.h>
+
+namespace camera_common
+{
+    bool ParsePixelFormat(const std::string &_name, PixelFormat &_format)
+    {
+        if(_name == "rgb") _format = PIXEL_RGB;
+        else if(_name == "gray") _format = PIXEL_GRAY;
+        else if(_name == "yuv420") _format = PIXEL_YUV420;
+        else if(_name == "chw_f32") _format = PIXEL_CHW_F32;
+        else return false;
+        return true;
+    }
+
+    const char *PixelFormatName(PixelFormat _format)
+    {
+        switch(_format){
+            case PIXEL_RGB: return "rgb";
+            case PIXEL_GRAY: return "gray";
+            case PIXEL_YUV420: return "yuv420";
+            case PIXEL_CHW_F32: return "chw_f32";
+            default: return "unknown";
+        }
+    }
+
+    SimdLevel DetectSimd()
+    {
+        static const SimdLevel level = []{
+            __builtin_cpu_init();
+            if(__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+            if(__builtin_cpu_supports("ssse3")) return SIMD_SSSE3;
+            return SIMD_SCALAR;
+        }();
+        return level;
+    }
+
+    const char *SimdLevelName(SimdLevel _level)
+    {
+        switch(_level){
+            case SIMD_SCALAR: return "scalar";
+            case SIMD_SSSE3: return "ssse3";
+            case SIMD_AVX2: return "avx2";
+            default: return "unknown";
+        }
+    }
+
+    static SimdLevel Usable(SimdLevel _level)
+    {
+        SimdLevel cpu = DetectSimd();
+        return _level < cpu ? _level : cpu;
+    }
+
+    /////////////////////////////////////////////////
+    // Scalar reference, the vector kernels give the same bytes
+    static inline unsigned char Luma(int _r, int _g, int _b)
+    {
+        return (unsigned char)((77 * _r + 150 * _g + 29 * _b + 128) >> 8);
+    }
+
+    static inline unsigned char Y601(int _r, int _g, int _b)
+    {
+        return (unsigned char)(((66 * _r + 129 * _g + 25 * _b + 128) >> 8) + 16);
+    }
+
+    static inline unsigned char U601(int _r, int _g, int _b)
+    {
+        return (unsigned char)(((-38 * _r - 74 * _g + 112 * _b + 128) >> 8) + 128);
+    }
+
+    static inline unsigned char V601(int _r, int _g, int _b)
+    {
+        return (unsigned char)(((112 * _r - 94 * _g - 18 * _b + 128) >> 8) + 128);
+    }
+
+    // Columns _x0.._width of the rows _row0 and _row1.
+    static void Yuv420Rows(const unsigned char *_row0, const unsigned char *_row1, unsigned int _channels,
+        unsigned int _x0, unsigned int _width, unsigned char *_y0, unsigned char *_y1,
+        unsigned char *_u, unsigned char *_v)
+    {
+        const unsigned int c = _channels;
+        const unsigned char *row[2] = {_row0, _row1};
+        unsigned char *luma[2] = {_y0, _y1};
+        for(unsigned int x = _x0; x < _width; x += 2){
+            int sr = 0, sg = 0, sb = 0;
+            for(int dy = 0; dy < 2; dy++){
+                for(int dx = 0; dx < 2; dx++){
+                    const unsigned char *p = row[dy] + (x + dx) * c;
+                    int r = p[0], g = c >= 3 ? p[1] : r, b = c >= 3 ? p[2] : r;
+                    luma[dy][x + dx] = Y601(r, g, b);
+                    sr += r;
+                    sg += g;
+                    sb += b;
+                }
+            }
+            sr = (sr + 2) >> 2;
+            sg = (sg + 2) >> 2;
+            sb = (sb + 2) >> 2;
+            _u[x / 2] = U601(sr, sg, sb);
+            _v[x / 2] = V601(sr, sg, sb);
+        }
+    }
+
+    /////////////////////////////////////////////////
+    // SSSE3: splits 16 packed rgb pixels (48 bytes) into r, g and b bytes
+    __attribute__((target("ssse3")))
+    static inline void SplitRgb16(const unsigned char *_p, __m128i &_r, __m128i &_g, __m128i &_b)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i *)_p);
+        const __m128i b = _mm_loadu_si128((const __m128i *)(_p + 16));
+        const __m128i c = _mm_loadu_si128((const __m128i *)(_p + 32));
+        _r = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+        _g = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+        _b = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+    }
+
+    // ((_wr r + _wg g + _wb b + 128) >> 8) + _offset of 8 pixels in 16 bit
+    // lanes. The weights are unsigned and sum to at most 256, so the sum
+    // fits in 16 bits.
+    __attribute__((target("ssse3")))
+    static inline __m128i Weigh8(__m128i _r, __m128i _g, __m128i _b, int _wr, int _wg, int _wb)
+    {
+        __m128i s = _mm_add_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(_r, _mm_set1_epi16(_wr)), _mm_mullo_epi16(_g, _mm_set1_epi16(_wg))),
+            _mm_add_epi16(_mm_mullo_epi16(_b, _mm_set1_epi16(_wb)), _mm_set1_epi16(128)));
+        return _mm_srli_epi16(s, 8);
+    }
+
+    __attribute__((target("ssse3")))
+    static inline __m128i Weigh16(__m128i _r, __m128i _g, __m128i _b, int _wr, int _wg, int _wb, int _offset)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i lo = Weigh8(_mm_unpacklo_epi8(_r, zero), _mm_unpacklo_epi8(_g, zero),
+            _mm_unpacklo_epi8(_b, zero), _wr, _wg, _wb);
+        __m128i hi = Weigh8(_mm_unpackhi_epi8(_r, zero), _mm_unpackhi_epi8(_g, zero),
+            _mm_unpackhi_epi8(_b, zero), _wr, _wg, _wb);
+        return _mm_add_epi8(_mm_packus_epi16(lo, hi), _mm_set1_epi8(_offset));
+    }
+
+    // U or V of 8 averaged blocks in 16 bit lanes, signed weights.
+    __attribute__((target("ssse3")))
+    static inline __m128i Chroma8(__m128i _r, __m128i _g, __m128i _b, int _wr, int _wg, int _wb)
+    {
+        __m128i s = _mm_add_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(_r, _mm_set1_epi16(_wr)), _mm_mullo_epi16(_g, _mm_set1_epi16(_wg))),
+            _mm_add_epi16(_mm_mullo_epi16(_b, _mm_set1_epi16(_wb)), _mm_set1_epi16(128)));
+        s = _mm_add_epi16(_mm_srai_epi16(s, 8), _mm_set1_epi16(128));
+        return _mm_packus_epi16(s, s);
+    }
+
+    // 2x2 block averages of 8 blocks of the 16 pixel rows _a and _b.
+    __attribute__((target("ssse3")))
+    static inline __m128i Average2x2(__m128i _a, __m128i _b)
+    {
+        const __m128i ones = _mm_set1_epi8(1);
+        __m128i s = _mm_add_epi16(_mm_maddubs_epi16(_a, ones), _mm_maddubs_epi16(_b, ones));
+        return _mm_srli_epi16(_mm_add_epi16(s, _mm_set1_epi16(2)), 2);
+    }
+
+    __attribute__((target("ssse3")))
+    static inline void StoreFloat16(__m128i _v, float *_out)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+        __m128i lo = _mm_unpacklo_epi8(_v, zero);
+        __m128i hi = _mm_unpackhi_epi8(_v, zero);
+        _mm_storeu_ps(_out, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+        _mm_storeu_ps(_out + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+        _mm_storeu_ps(_out + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+        _mm_storeu_ps(_out + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+    }
+
+    // The kernels return the pixels (or columns) done, the scalar code does the rest.
+    __attribute__((target("ssse3")))
+    static size_t RgbToGraySsse3(const unsigned char *_rgb, size_t _count, unsigned char *_gray)
+    {
+        size_t i = 0;
+        for(; i + 16 <= _count; i += 16){
+            __m128i r, g, b;
+            SplitRgb16(_rgb + 3 * i, r, g, b);
+            _mm_storeu_si128((__m128i *)(_gray + i), Weigh16(r, g, b, 77, 150, 29, 0));
+        }
+        return i;
+    }
+
+    __attribute__((target("ssse3")))
+    static unsigned int Yuv420RowsSsse3(const unsigned char *_row0, const unsigned char *_row1, unsigned int _width,
+        unsigned char *_y0, unsigned char *_y1, unsigned char *_u, unsigned char *_v)
+    {
+        unsigned int x = 0;
+        for(; x + 16 <= _width; x += 16){
+            __m128i r0, g0, b0, r1, g1, b1;
+            SplitRgb16(_row0 + 3 * x, r0, g0, b0);
+            SplitRgb16(_row1 + 3 * x, r1, g1, b1);
+            _mm_storeu_si128((__m128i *)(_y0 + x), Weigh16(r0, g0, b0, 66, 129, 25, 16));
+            _mm_storeu_si128((__m128i *)(_y1 + x), Weigh16(r1, g1, b1, 66, 129, 25, 16));
+            __m128i r = Average2x2(r0, r1), g = Average2x2(g0, g1), b = Average2x2(b0, b1);
+            _mm_storel_epi64((__m128i *)(_u + x / 2), Chroma8(r, g, b, -38, -74, 112));
+            _mm_storel_epi64((__m128i *)(_v + x / 2), Chroma8(r, g, b, 112, -94, -18));
+        }
+        return x;
+    }
+
+    __attribute__((target("ssse3")))
+    static size_t RgbToPlanarFloatSsse3(const unsigned char *_rgb, size_t _count, float *_planes)
+    {
+        size_t i = 0;
+        for(; i + 16 <= _count; i += 16){
+            __m128i r, g, b;
+            SplitRgb16(_rgb + 3 * i, r, g, b);
+            StoreFloat16(r, _planes + i);
+            StoreFloat16(g, _planes + _count + i);
+            StoreFloat16(b, _planes + 2 * _count + i);
+        }
+        return i;
+    }
+
+    /////////////////////////////////////////////////
+    // AVX2: the same shuffles, the arithmetic of 16 pixels in one register
+    __attribute__((target("avx2")))
+    static inline __m128i Weigh16Avx2(__m128i _r, __m128i _g, __m128i _b, int _wr, int _wg, int _wb, int _offset)
+    {
+        __m256i s = _mm256_add_epi16(
+            _mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(_r), _mm256_set1_epi16(_wr)),
+                _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_g), _mm256_set1_epi16(_wg))),
+            _mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(_b), _mm256_set1_epi16(_wb)),
+                _mm256_set1_epi16(128)));
+        s = _mm256_srli_epi16(s, 8);
+        return _mm_add_epi8(_mm_packus_epi16(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1)),
+            _mm_set1_epi8(_offset));
+    }
+
+    __attribute__((target("avx2")))
+    static inline void StoreFloat16Avx2(__m128i _v, float *_out)
+    {
+        const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+        _mm256_storeu_ps(_out, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_v)), scale));
+        _mm256_storeu_ps(_out + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(_v, 8))), scale));
+    }
+
+    __attribute__((target("avx2")))
+    static size_t RgbToGrayAvx2(const unsigned char *_rgb, size_t _count, unsigned char *_gray)
+    {
+        size_t i = 0;
+        for(; i + 16 <= _count; i += 16){
+            __m128i r, g, b;
+            SplitRgb16(_rgb + 3 * i, r, g, b);
+            _mm_storeu_si128((__m128i *)(_gray + i), Weigh16Avx2(r, g, b, 77, 150, 29, 0));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    static unsigned int Yuv420RowsAvx2(const unsigned char *_row0, const unsigned char *_row1, unsigned int _width,
+        unsigned char *_y0, unsigned char *_y1, unsigned char *_u, unsigned char *_v)
+    {
+        unsigned int x = 0;
+        for(; x + 16 <= _width; x += 16){
+            __m128i r0, g0, b0, r1, g1, b1;
+            SplitRgb16(_row0 + 3 * x, r0, g0, b0);
+            SplitRgb16(_row1 + 3 * x, r1, g1, b1);
+            _mm_storeu_si128((__m128i *)(_y0 + x), Weigh16Avx2(r0, g0, b0, 66, 129, 25, 16));
+            _mm_storeu_si128((__m128i *)(_y1 + x), Weigh16Avx2(r1, g1, b1, 66, 129, 25, 16));
+            __m128i r = Average2x2(r0, r1), g = Average2x2(g0, g1), b = Average2x2(b0, b1);
+            _mm_storel_epi64((__m128i *)(_u + x / 2), Chroma8(r, g, b, -38, -74, 112));
+            _mm_storel_epi64((__m128i *)(_v + x / 2), Chroma8(r, g, b, 112, -94, -18));
+        }
+        return x;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t RgbToPlanarFloatAvx2(const unsigned char *_rgb, size_t _count, float *_planes)
+    {
+        size_t i = 0;
+        for(; i + 16 <= _count; i += 16){
+            __m128i r, g, b;
+            SplitRgb16(_rgb + 3 * i, r, g, b);
+            StoreFloat16Avx2(r, _planes + i);
+            StoreFloat16Avx2(g, _planes + _count + i);
+            StoreFloat16Avx2(b, _planes + 2 * _count + i);
+        }
+        return i;
+    }
+
+    /////////////////////////////////////////////////
+    void RgbToGray(const unsigned char *_pixels, unsigned int _channels, size_t _count,
+        unsigned char *_gray, SimdLevel _level)
+    {
+        if(_channels == 1){
+            memcpy(_gray, _pixels, _count);
+            return;
+        }
+        SimdLevel level = Usable(_level);
+        size_t i = 0;
+        if(_channels == 3 && level == SIMD_AVX2) i = RgbToGrayAvx2(_pixels, _count, _gray);
+        else if(_channels == 3 && level == SIMD_SSSE3) i = RgbToGraySsse3(_pixels, _count, _gray);
+        for(; i < _count; i++){
+            const unsigned char *p = _pixels + i * _channels;
+            _gray[i] = Luma(p[0], p[1], p[2]);
+        }
+    }
+
+    void RgbToYuv420(const unsigned char *_pixels, unsigned int _channels, size_t _stride,
+        unsigned int _width, unsigned int _height,
+        unsigned char *_y, size_t _yStride, unsigned char *_u, unsigned char *_v, size_t _uvStride,
+        SimdLevel _level)
+    {
+        SimdLevel level = _channels == 3 ? Usable(_level) : SIMD_SCALAR;
+        for(unsigned int row = 0; row + 1 < _height; row += 2){
+            const unsigned char *row0 = _pixels + row * _stride;
+            const unsigned char *row1 = row0 + _stride;
+            unsigned char *y0 = _y + row * _yStride;
+            unsigned char *y1 = y0 + _yStride;
+            unsigned char *u = _u + (row / 2) * _uvStride;
+            unsigned char *v = _v + (row / 2) * _uvStride;
+            unsigned int x = 0;
+            if(level == SIMD_AVX2) x = Yuv420RowsAvx2(row0, row1, _width, y0, y1, u, v);
+            else if(level == SIMD_SSSE3) x = Yuv420RowsSsse3(row0, row1, _width, y0, y1, u, v);
+            Yuv420Rows(row0, row1, _channels, x, _width, y0, y1, u, v);
+        }
+    }
+
+    void RgbToPlanarFloat(const unsigned char *_pixels, unsigned int _channels, size_t _count,
+        float *_planes, SimdLevel _level)
+    {
+        SimdLevel level = Usable(_level);
+        size_t i = 0;
+        if(_channels == 3 && level == SIMD_AVX2) i = RgbToPlanarFloatAvx2(_pixels, _count, _planes);
+        else if(_channels == 3 && level == SIMD_SSSE3) i = RgbToPlanarFloatSsse3(_pixels, _count, _planes);
+        for(; i < _count; i++){
+            const unsigned char *p = _pixels + i * _channels;
+            for(unsigned int c = 0; c < _channels; c++) _planes[c * _count + i] = p[c] * (1.0f / 255.0f);
+        }
+    }
+
+    bool ConvertPixels(PixelFormat _format, const unsigned char *_pixels,
+        unsigned int &_width, unsigned int &_height, unsigned int &_channels,
+        std::vector<unsigned char> &_out, SimdLevel _level)
+    {
+        const size_t count = (size_t)_width * _height;
+        if(count == 0 || _channels == 0) return false;
+        switch(_format){
+            case PIXEL_GRAY:
+                _out.resize(count);
+                RgbToGray(_pixels, _channels, count, &_out[0], _level);
+                _channels = 1;
+                return true;
+            case PIXEL_YUV420:{
+                const unsigned int w = _width & ~1u, h = _height & ~1u;
+                if(w == 0 || h == 0) return false;
+                const size_t luma = (size_t)w * h;
+                _out.resize(luma * 3 / 2);
+                unsigned char *y = &_out[0];
+                unsigned char *u = y + luma;
+                unsigned char *v = u + luma / 4;
+                RgbToYuv420(_pixels, _channels, (size_t)_width * _channels, w, h, y, w, u, v, w / 2, _level);
+                _width = w;
+                _height = h;
+                _channels = 3;
+                return true;
+            }
+            case PIXEL_CHW_F32:
+                _out.resize(count * _channels * sizeof(float));
+                RgbToPlanarFloat(_pixels, _channels, count, (float *)&_out[0], _level);
+                return true;
+            default:
+                _out.assign(_pixels, _pixels + count * _channels);
+                return true;
+        }
+    }
+}
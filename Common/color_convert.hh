@@ -0,0 +1,62 @@
+#ifndef _CAMERA_COMMON_COLOR_CONVERT_HH_
+#define _CAMERA_COMMON_COLOR_CONVERT_HH_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace camera_common
+{
+    // Pixel layout of the frames the pipeline encodes. The camera renders
+    // packed rgb (or gray); the others are converted on the workers.
+    enum PixelFormat
+    {
+        PIXEL_RGB = 0,//as rendered, packed
+        PIXEL_GRAY,//BT.601 luma, 1 channel
+        PIXEL_YUV420,//I420: full size Y plane, then U and V at half size; odd last rows and columns are cropped
+        PIXEL_CHW_F32,//float planes R, G, B in 0..1, the layout of a network input
+        PIXEL_COUNT
+    };
+
+    // "rgb", "gray", "yuv420" or "chw_f32"; returns false for anything else.
+    bool ParsePixelFormat(const std::string &_name, PixelFormat &_format);
+    const char *PixelFormatName(PixelFormat _format);
+
+    // Instruction sets of the conversion kernels. Every level gives the
+    // same bytes as the scalar code.
+    enum SimdLevel
+    {
+        SIMD_SCALAR = 0,
+        SIMD_SSSE3,//byte shuffles to split 16 rgb pixels into planes
+        SIMD_AVX2,//and 256 bit arithmetic on them
+        SIMD_COUNT
+    };
+
+    // Best level this cpu supports.
+    SimdLevel DetectSimd();
+    const char *SimdLevelName(SimdLevel _level);
+
+    // The kernels take packed pixels with _channels 3 (rgb) or 1 (gray,
+    // used as r = g = b) and use at most _level, lowered to what the cpu
+    // has. Only rgb input is vectorized.
+    // (77 r + 150 g + 29 b + 128) >> 8, the luma of frame_similarity.
+    void RgbToGray(const unsigned char *_pixels, unsigned int _channels, size_t _count,
+        unsigned char *_gray, SimdLevel _level);
+    // BT.601 limited range, chroma of every 2x2 block averaged; _width and
+    // _height must be even. _stride is the row size of _pixels in bytes.
+    void RgbToYuv420(const unsigned char *_pixels, unsigned int _channels, size_t _stride,
+        unsigned int _width, unsigned int _height,
+        unsigned char *_y, size_t _yStride, unsigned char *_u, unsigned char *_v, size_t _uvStride,
+        SimdLevel _level);
+    // _channels planes of _count floats, value / 255.
+    void RgbToPlanarFloat(const unsigned char *_pixels, unsigned int _channels, size_t _count,
+        float *_planes, SimdLevel _level);
+
+    // Converts a packed frame to _format in _out. Updates the size of the
+    // frame (yuv420 crops to even) and its channels (1 for gray, the planes
+    // otherwise). Returns false for a frame that is empty after cropping.
+    bool ConvertPixels(PixelFormat _format, const unsigned char *_pixels,
+        unsigned int &_width, unsigned int &_height, unsigned int &_channels,
+        std::vector<unsigned char> &_out, SimdLevel _level = DetectSimd());
+}
+#endif
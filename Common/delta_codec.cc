@@ -0,0 +1,237 @@
+#include "delta_codec.hh"
+
+#include <string.h>
+#include <emmintrin.h>
+#include <zlib.h>
+
+namespace camera_common
+{
+    // _dst = _a - _b, modulo 256
+    static void SubtractBytes(unsigned char *_dst, const unsigned char *_a, const unsigned char *_b, size_t _n)
+    {
+        size_t i = 0;
+        for(; i + 16 <= _n; i += 16){
+            __m128i a = _mm_loadu_si128((const __m128i *)(_a + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(_b + i));
+            _mm_storeu_si128((__m128i *)(_dst + i), _mm_sub_epi8(a, b));
+        }
+        for(; i < _n; i++) _dst[i] = _a[i] - _b[i];
+    }
+
+    // _dst = _a + _b, modulo 256
+    static void AddBytes(unsigned char *_dst, const unsigned char *_a, const unsigned char *_b, size_t _n)
+    {
+        size_t i = 0;
+        for(; i + 16 <= _n; i += 16){
+            __m128i a = _mm_loadu_si128((const __m128i *)(_a + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(_b + i));
+            _mm_storeu_si128((__m128i *)(_dst + i), _mm_add_epi8(a, b));
+        }
+        for(; i < _n; i++) _dst[i] = _a[i] + _b[i];
+    }
+
+    DeltaOptions::DeltaOptions() : keyint(30), threads(2), level(1) {}
+
+    DeltaEncoder::DeltaEncoder(const DeltaOptions &_options)
+        : options(_options), havePrevious(false), previousId(0), sinceKey(0),
+          width(0), height(0), channels(0), pixels(NULL), key(true), tiles(0),
+          nextTile(0), job(0), busy(0), stopping(false)
+    {
+        if(options.keyint == 0) options.keyint = 1;
+        if(options.threads == 0) options.threads = 1;
+        residual.resize(options.threads);
+        for(unsigned int i = 0; i < options.threads; i++){
+            z_stream *z = new z_stream();
+            memset(z, 0, sizeof(*z));
+            deflateInit(z, options.level);
+            streams.push_back(z);
+        }
+        //the thread calling Encode is slot 0
+        for(unsigned int i = 1; i < options.threads; i++) helpers.push_back(std::thread(&DeltaEncoder::Run, this, i));
+    }
+
+    DeltaEncoder::~DeltaEncoder()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        start.notify_all();
+        for(size_t i = 0; i < helpers.size(); i++) helpers[i].join();
+        for(size_t i = 0; i < streams.size(); i++){
+            deflateEnd((z_stream *)streams[i]);
+            delete (z_stream *)streams[i];
+        }
+    }
+
+    void DeltaEncoder::Run(unsigned int _slot)
+    {
+        uint64_t seen = 0;
+        while(true){
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start.wait(lock, [this, seen]{ return stopping || job != seen; });
+                if(stopping) return;
+                seen = job;
+            }
+            EncodeTiles(_slot);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busy--;
+                if(busy == 0) done.notify_all();
+            }
+        }
+    }
+
+    void DeltaEncoder::EncodeTiles(unsigned int _slot)
+    {
+        unsigned int t;
+        while((t = nextTile++) < tiles) tileOk[t] = EncodeTile(_slot, t);
+    }
+
+    bool DeltaEncoder::EncodeTile(unsigned int _slot, unsigned int _tile)
+    {
+        const size_t stride = (size_t)width * channels;
+        unsigned int y0 = _tile * TILE_ROWS;
+        unsigned int rows = height - y0 < TILE_ROWS ? height - y0 : TILE_ROWS;
+        size_t n = rows * stride;
+        std::vector<unsigned char> &r = residual[_slot];
+        r.resize(n);
+        const unsigned char *p = pixels + y0 * stride;
+        if(key){
+            for(unsigned int y = 0; y < rows; y++){
+                const unsigned char *row = p + y * stride;
+                memcpy(&r[y * stride], row, channels);
+                SubtractBytes(&r[y * stride + channels], row + channels, row, stride - channels);
+            }
+        }else SubtractBytes(&r[0], p, &previous[y0 * stride], n);
+
+        z_stream *z = (z_stream *)streams[_slot];
+        if(deflateReset(z) != Z_OK) return false;
+        std::vector<unsigned char> &out = tileData[_tile];
+        out.resize(deflateBound(z, n));
+        z->next_in = &r[0];
+        z->avail_in = n;
+        z->next_out = &out[0];
+        z->avail_out = out.size();
+        if(deflate(z, Z_FINISH) != Z_STREAM_END) return false;
+        out.resize(z->total_out);
+        return true;
+    }
+
+    bool DeltaEncoder::Encode(uint64_t _id, const unsigned char *_pixels, unsigned int _width,
+        unsigned int _height, unsigned int _channels, std::vector<unsigned char> &_out)
+    {
+        if(_width == 0 || _height == 0 || _channels == 0) return false;
+        key = !havePrevious || _width != width || _height != height || _channels != channels ||
+            sinceKey >= options.keyint;
+        width = _width;
+        height = _height;
+        channels = _channels;
+        pixels = _pixels;
+        tiles = (height + TILE_ROWS - 1) / TILE_ROWS;
+        tileData.resize(tiles);
+        tileOk.assign(tiles, 0);
+        nextTile = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job++;
+            busy = helpers.size();
+        }
+        start.notify_all();
+        EncodeTiles(0);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [this]{ return busy == 0; });
+        }
+
+        DeltaFrameHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = DELTA_MAGIC;
+        header.type = key ? DELTA_KEYFRAME : DELTA_INTER;
+        header.channels = channels;
+        header.tileRows = TILE_ROWS;
+        header.width = width;
+        header.height = height;
+        header.tiles = tiles;
+        header.id = _id;
+        header.reference = key ? _id : previousId;
+        size_t size = sizeof(header) + tiles * sizeof(uint32_t);
+        for(unsigned int t = 0; t < tiles; t++){
+            if(!tileOk[t]){
+                havePrevious = false;
+                return false;
+            }
+            size += tileData[t].size();
+        }
+        _out.resize(size);
+        unsigned char *o = &_out[0];
+        memcpy(o, &header, sizeof(header));
+        o += sizeof(header);
+        for(unsigned int t = 0; t < tiles; t++){
+            uint32_t n = tileData[t].size();
+            memcpy(o, &n, sizeof(n));
+            o += sizeof(n);
+        }
+        for(unsigned int t = 0; t < tiles; t++){
+            memcpy(o, &tileData[t][0], tileData[t].size());
+            o += tileData[t].size();
+        }
+
+        previous.assign(_pixels, _pixels + (size_t)width * height * channels);
+        havePrevious = true;
+        previousId = _id;
+        sinceKey = key ? 1 : sinceKey + 1;
+        return true;
+    }
+
+    /////////////////////////////////////////////////
+    DeltaDecoder::DeltaDecoder() : havePrevious(false), previousId(0) {}
+
+    bool DeltaDecoder::Decode(const unsigned char *_data, size_t _size,
+        std::vector<unsigned char> &_pixels, DeltaFrameHeader &_header)
+    {
+        if(_size < sizeof(_header)) return false;
+        memcpy(&_header, _data, sizeof(_header));
+        const DeltaFrameHeader &h = _header;
+        if(h.magic != DELTA_MAGIC || h.channels == 0 || h.tileRows == 0 || h.width == 0 || h.height == 0 ||
+            h.tiles != (h.height + h.tileRows - 1) / h.tileRows ||
+            (uint64_t)h.width * h.height * h.channels > (1ULL << 31)) return false;
+        const size_t stride = (size_t)h.width * h.channels;
+        const size_t total = stride * h.height;
+        if(h.type == DELTA_INTER){
+            if(!havePrevious || previousId != h.reference || previous.size() != total) return false;
+        }else if(h.type != DELTA_KEYFRAME) return false;
+        havePrevious = false;//until this frame is complete
+        previous.resize(total);
+
+        size_t offset = sizeof(h) + h.tiles * sizeof(uint32_t);
+        if(offset > _size) return false;
+        for(unsigned int t = 0; t < h.tiles; t++){
+            uint32_t compressed;
+            memcpy(&compressed, _data + sizeof(h) + t * sizeof(uint32_t), sizeof(compressed));
+            if(offset + compressed > _size) return false;
+            unsigned int y0 = t * h.tileRows;
+            unsigned int rows = h.height - y0 < h.tileRows ? h.height - y0 : h.tileRows;
+            size_t n = rows * stride;
+            residual.resize(n);
+            uLongf length = n;
+            if(uncompress(&residual[0], &length, _data + offset, compressed) != Z_OK || length != n) return false;
+            offset += compressed;
+
+            unsigned char *p = &previous[y0 * stride];
+            if(h.type == DELTA_KEYFRAME){
+                for(unsigned int y = 0; y < rows; y++){
+                    unsigned char *row = p + y * stride;
+                    const unsigned char *r = &residual[y * stride];
+                    memcpy(row, r, h.channels);
+                    for(size_t i = h.channels; i < stride; i++) row[i] = r[i] + row[i - h.channels];
+                }
+            }else AddBytes(p, p, &residual[0], n);
+        }
+        _pixels = previous;
+        havePrevious = true;
+        previousId = h.id;
+        return true;
+    }
+}
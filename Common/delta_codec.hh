@@ -0,0 +1,111 @@
+#ifndef _CAMERA_COMMON_DELTA_CODEC_HH_
+#define _CAMERA_COMMON_DELTA_CODEC_HH_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace camera_common
+{
+    // Lossless frames for the "delta" codec. A keyframe stores every row as
+    // differences to the pixel on its left, an inter frame the difference
+    // to the previous frame of the same encoder (mostly zeros along a
+    // smooth trajectory). Both are cut in bands of tileRows rows that are
+    // deflated independently, in parallel.
+    //
+    // Layout: DeltaFrameHeader, uint32_t compressed size of every tile, the
+    // tiles. Decoding an inter frame needs the frame 'reference', so a
+    // reader starts at the last keyframe before the frame it wants.
+    static const uint32_t DELTA_MAGIC = 0x31444643;//"CFD1"
+
+    enum DeltaFrameType
+    {
+        DELTA_KEYFRAME = 0,
+        DELTA_INTER = 1
+    };
+
+    struct DeltaFrameHeader
+    {
+        uint32_t magic;
+        uint8_t type;//DeltaFrameType
+        uint8_t channels;
+        uint16_t tileRows;
+        uint32_t width;
+        uint32_t height;
+        uint32_t tiles;
+        uint32_t reserved;
+        uint64_t id;//of this frame
+        uint64_t reference;//id of the frame an inter frame is relative to
+    };
+
+    struct DeltaOptions
+    {
+        unsigned int keyint;//frames between keyframes
+        unsigned int threads;//tiles encoded in parallel
+        int level;//zlib level, 1 is fastest
+        DeltaOptions();
+    };
+
+    // Encodes the frames in the order they are given; not thread safe, it
+    // runs its own tile threads.
+    class DeltaEncoder
+    {
+        public: explicit DeltaEncoder(const DeltaOptions &_options);
+        public: ~DeltaEncoder();
+        public: bool Encode(uint64_t _id, const unsigned char *_pixels, unsigned int _width,
+            unsigned int _height, unsigned int _channels, std::vector<unsigned char> &_out);
+        // The next frame is a keyframe, e.g. for a new output directory.
+        public: void Reset() { havePrevious = false; }
+
+        private: static const unsigned int TILE_ROWS = 32;
+        private: void Run(unsigned int _slot);
+        private: void EncodeTiles(unsigned int _slot);
+        private: bool EncodeTile(unsigned int _slot, unsigned int _tile);
+
+        private: DeltaOptions options;
+        private: std::vector<unsigned char> previous;
+        private: bool havePrevious;
+        private: uint64_t previousId;
+        private: unsigned int sinceKey;//frames since the last keyframe
+        private: unsigned int width;
+        private: unsigned int height;
+        private: unsigned int channels;
+
+        // the frame being encoded
+        private: const unsigned char *pixels;
+        private: bool key;
+        private: unsigned int tiles;
+        private: std::vector<std::vector<unsigned char> > tileData;
+        private: std::vector<char> tileOk;
+        private: std::vector<std::vector<unsigned char> > residual;//per slot
+        private: std::vector<void *> streams;//z_stream per slot
+        private: std::atomic<unsigned int> nextTile;
+
+        private: std::mutex mutex;
+        private: std::condition_variable start;
+        private: std::condition_variable done;
+        private: uint64_t job;//incremented for every frame
+        private: unsigned int busy;//helper threads still encoding the frame
+        private: bool stopping;
+        private: std::vector<std::thread> helpers;
+    };
+
+    // Decodes the frames of one encoder in order.
+    class DeltaDecoder
+    {
+        public: DeltaDecoder();
+        // _pixels gets the frame. Fails on corrupt data and on an inter frame
+        // whose reference is not the frame decoded before.
+        public: bool Decode(const unsigned char *_data, size_t _size,
+            std::vector<unsigned char> &_pixels, DeltaFrameHeader &_header);
+
+        private: std::vector<unsigned char> previous;
+        private: bool havePrevious;
+        private: uint64_t previousId;
+        private: std::vector<unsigned char> residual;
+    };
+}
+#endif
@@ -0,0 +1,41 @@
+#include "file_util.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace camera_common
+{
+    bool WriteFileAtomically(const std::string &_path, const std::string &_contents)
+    {
+        std::string tmp = _path + ".tmp";
+        FILE *f = fopen(tmp.c_str(), "w");
+        if(f == NULL) return false;
+        bool ok = fwrite(_contents.data(), 1, _contents.size(), f) == _contents.size();
+        ok = (fclose(f) == 0) && ok;
+        return ok && rename(tmp.c_str(), _path.c_str()) == 0;
+    }
+
+    bool ReadFile(const std::string &_path, std::vector<unsigned char> &_data)
+    {
+        int fd = open(_path.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        if(ok){
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            _data.resize(st.st_size);
+            size_t done = 0;
+            while(ok && done < _data.size()){
+                ssize_t n = pread(fd, &_data[done], _data.size() - done, done);
+                if(n < 0 && errno == EINTR) continue;
+                if(n <= 0) ok = false;
+                else done += n;
+            }
+        }
+        close(fd);
+        return ok;
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef _CAMERA_COMMON_FILE_UTIL_HH_
+#define _CAMERA_COMMON_FILE_UTIL_HH_
+
+#include <string>
+#include <vector>
+
+namespace camera_common
+{
+    // Write _contents to _path through a temporary file and rename, so
+    // readers see either the old or the new file, never half of it.
+    bool WriteFileAtomically(const std::string &_path, const std::string &_contents);
+    // The whole file in one sequential read.
+    bool ReadFile(const std::string &_path, std::vector<unsigned char> &_data);
+}
+#endif
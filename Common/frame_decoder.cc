@@ -0,0 +1,181 @@
+#include "frame_decoder.hh"
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include <jpeglib.h>
+#include <png.h>
+
+namespace camera_common
+{
+    bool ReadJpegInfo(const unsigned char *_data, size_t _size, unsigned int &_width,
+        unsigned int &_height, unsigned int &_channels)
+    {
+        const unsigned char *d = _data;
+        if(_size < 4 || d[0] != 0xFF || d[1] != 0xD8) return false;
+        size_t end = _size;
+        while(end > 4 && d[end - 1] == 0) end--;
+        if(d[end - 2] != 0xFF || d[end - 1] != 0xD9) return false;
+        size_t p = 2;
+        while(p + 4 <= end){
+            if(d[p] != 0xFF) return false;
+            unsigned char marker = d[p + 1];
+            if(marker == 0xFF){//fill byte
+                p++;
+                continue;
+            }
+            size_t length = (d[p + 2] << 8) | d[p + 3];
+            if(length < 2 || p + 2 + length > end) return false;
+            //SOF0..SOF15, except DHT, JPG and DAC
+            if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC){
+                if(length < 8) return false;
+                _height = (d[p + 5] << 8) | d[p + 6];
+                _width = (d[p + 7] << 8) | d[p + 8];
+                _channels = d[p + 9];
+                return _width > 0 && _height > 0 && _channels > 0;
+            }
+            if(marker == 0xDA) return false;//scan before the frame header
+            p += 2 + length;
+        }
+        return false;
+    }
+
+    struct DecodeError
+    {
+        jpeg_error_mgr pub;
+        jmp_buf jump;
+    };
+
+    static void DecodeErrorExit(j_common_ptr _cinfo)
+    {
+        longjmp(((DecodeError *)_cinfo->err)->jump, 1);
+    }
+
+    static void DecodeMessage(j_common_ptr) {}
+
+    bool DecodeJpeg(const unsigned char *_data, size_t _size, std::vector<unsigned char> &_pixels,
+        unsigned int &_width, unsigned int &_height, unsigned int &_channels)
+    {
+        jpeg_decompress_struct cinfo;
+        DecodeError err;
+        cinfo.err = jpeg_std_error(&err.pub);
+        err.pub.error_exit = DecodeErrorExit;
+        err.pub.output_message = DecodeMessage;
+        if(setjmp(err.jump)){
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+        jpeg_create_decompress(&cinfo);
+        jpeg_mem_src(&cinfo, (unsigned char *)_data, _size);
+        if(jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK){
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+        jpeg_start_decompress(&cinfo);
+        _width = cinfo.output_width;
+        _height = cinfo.output_height;
+        _channels = cinfo.output_components;
+        const size_t stride = (size_t)_width * _channels;
+        _pixels.resize(stride * _height);
+        while(cinfo.output_scanline < cinfo.output_height){
+            JSAMPROW row = &_pixels[cinfo.output_scanline * stride];
+            jpeg_read_scanlines(&cinfo, &row, 1);
+        }
+        jpeg_finish_decompress(&cinfo);
+        //corrupt data (e.g. a truncated scan) is only a warning
+        bool ok = err.pub.num_warnings == 0;
+        jpeg_destroy_decompress(&cinfo);
+        return ok;
+    }
+
+    struct PngSource
+    {
+        const unsigned char *data;
+        size_t size;
+        size_t offset;
+    };
+
+    static void PngRead(png_structp _png, png_bytep _out, png_size_t _length)
+    {
+        PngSource *source = (PngSource *)png_get_io_ptr(_png);
+        if(source->offset + _length > source->size) png_error(_png, "truncated");
+        memcpy(_out, source->data + source->offset, _length);
+        source->offset += _length;
+    }
+
+    static bool DecodePng(const unsigned char *_data, size_t _size, std::vector<unsigned char> &_pixels,
+        unsigned int &_width, unsigned int &_height, unsigned int &_channels)
+    {
+        if(_size < 8 || png_sig_cmp((png_const_bytep)_data, 0, 8) != 0) return false;
+        png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        if(png == NULL) return false;
+        png_infop info = png_create_info_struct(png);
+        if(info == NULL || setjmp(png_jmpbuf(png))){
+            png_destroy_read_struct(&png, &info, NULL);
+            return false;
+        }
+        PngSource source = {_data, _size, 0};
+        png_set_read_fn(png, &source, PngRead);
+        png_read_info(png, info);
+        //8 bit gray or rgb, as the encoder writes them
+        png_set_strip_16(png);
+        png_set_strip_alpha(png);
+        png_set_packing(png);
+        png_set_palette_to_rgb(png);
+        png_read_update_info(png, info);
+        _width = png_get_image_width(png, info);
+        _height = png_get_image_height(png, info);
+        _channels = png_get_channels(png, info);
+        const size_t stride = png_get_rowbytes(png, info);
+        _pixels.resize(stride * _height);
+        for(unsigned int y = 0; y < _height; y++) png_read_row(png, &_pixels[y * stride], NULL);
+        png_read_end(png, NULL);
+        png_destroy_read_struct(&png, &info, NULL);
+        return stride == (size_t)_width * _channels;
+    }
+
+    // P5 or P6 header, maxval 255.
+    static bool DecodeRaw(const unsigned char *_data, size_t _size, std::vector<unsigned char> &_pixels,
+        unsigned int &_width, unsigned int &_height, unsigned int &_channels)
+    {
+        if(_size < 3 || _data[0] != 'P' || (_data[1] != '5' && _data[1] != '6')) return false;
+        _channels = _data[1] == '5' ? 1 : 3;
+        unsigned long values[3];
+        size_t p = 2;
+        for(int i = 0; i < 3; i++){
+            while(p < _size && (_data[p] == ' ' || _data[p] == '\n' || _data[p] == '\r' || _data[p] == '\t')) p++;
+            if(p >= _size || _data[p] < '0' || _data[p] > '9') return false;
+            values[i] = 0;
+            while(p < _size && _data[p] >= '0' && _data[p] <= '9' && values[i] < 1000000)
+                values[i] = values[i] * 10 + (_data[p++] - '0');
+        }
+        p++;//one white space before the pixels
+        _width = values[0];
+        _height = values[1];
+        size_t bytes = (size_t)_width * _height * _channels;
+        if(values[2] != 255 || bytes == 0 || p + bytes != _size) return false;
+        _pixels.assign(_data + p, _data + _size);
+        return true;
+    }
+
+    bool FrameDecoder::Decode(Codec _codec, const unsigned char *_data, size_t _size,
+        std::vector<unsigned char> &_pixels, unsigned int &_width, unsigned int &_height,
+        unsigned int &_channels)
+    {
+        switch(_codec){
+            case CODEC_JPEG: return DecodeJpeg(_data, _size, _pixels, _width, _height, _channels);
+            case CODEC_PNG: return DecodePng(_data, _size, _pixels, _width, _height, _channels);
+            case CODEC_RAW: return DecodeRaw(_data, _size, _pixels, _width, _height, _channels);
+            case CODEC_DELTA:{
+                DeltaFrameHeader header;
+                if(!delta.Decode(_data, _size, _pixels, header)) return false;
+                _width = header.width;
+                _height = header.height;
+                _channels = header.channels;
+                return true;
+            }
+            default: return false;
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef _CAMERA_COMMON_FRAME_DECODER_HH_
+#define _CAMERA_COMMON_FRAME_DECODER_HH_
+
+#include <stddef.h>
+#include <vector>
+
+#include "delta_codec.hh"
+#include "frame_encoder.hh"
+
+namespace camera_common
+{
+    // Size and channels of a JPEG from its frame header, without decoding.
+    // Fails unless the data starts with SOI, ends with EOI (zero padding
+    // after it is allowed) and the segments before the frame header are
+    // intact; catches truncated and empty files.
+    bool ReadJpegInfo(const unsigned char *_data, size_t _size, unsigned int &_width,
+        unsigned int &_height, unsigned int &_channels);
+
+    // Decodes a JPEG into packed pixels. Fails on libjpeg errors and on
+    // corrupt data libjpeg only warns about.
+    bool DecodeJpeg(const unsigned char *_data, size_t _size, std::vector<unsigned char> &_pixels,
+        unsigned int &_width, unsigned int &_height, unsigned int &_channels);
+
+    // Decodes the frames of one output directory (or one set of shards)
+    // back into packed pixels, in the order they were encoded: a delta
+    // frame needs the frame before it. Raw frames are the ppm/pgm of
+    // CODEC_RAW; the bare planes of yuv420 and chw_f32 frames carry no
+    // size and are not decoded.
+    class FrameDecoder
+    {
+        public: bool Decode(Codec _codec, const unsigned char *_data, size_t _size,
+            std::vector<unsigned char> &_pixels, unsigned int &_width, unsigned int &_height,
+            unsigned int &_channels);
+        // The next delta frame has to be a keyframe, e.g. for a new directory.
+        public: void Reset() { delta = DeltaDecoder(); }
+
+        private: DeltaDecoder delta;
+    };
+}
+#endif
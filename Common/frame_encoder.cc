@@ -0,0 +1,232 @@
+#include "frame_encoder.hh"
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include <jpeglib.h>
+#include <png.h>
+
+namespace camera_common
+{
+    bool ParseCodec(const std::string &_name, Codec &_codec)
+    {
+        if(_name == "jpg" || _name == "jpeg") _codec = CODEC_JPEG;
+        else if(_name == "png") _codec = CODEC_PNG;
+        else if(_name == "raw") _codec = CODEC_RAW;
+        else if(_name == "delta") _codec = CODEC_DELTA;
+        else return false;
+        return true;
+    }
+
+    const char *CodecName(Codec _codec)
+    {
+        switch(_codec){
+            case CODEC_JPEG: return "jpg";
+            case CODEC_PNG: return "png";
+            case CODEC_RAW: return "raw";
+            case CODEC_DELTA: return "delta";
+            default: return "unknown";
+        }
+    }
+
+    const char *CodecExtension(Codec _codec, unsigned int _channels)
+    {
+        switch(_codec){
+            case CODEC_JPEG: return "jpg";
+            case CODEC_PNG: return "png";
+            case CODEC_RAW: return _channels == 1 ? "pgm" : "ppm";
+            case CODEC_DELTA: return "cfd";
+            default: return "bin";
+        }
+    }
+
+    const char *FrameExtension(Codec _codec, PixelFormat _format, unsigned int _channels)
+    {
+        if(_codec == CODEC_RAW && _format == PIXEL_YUV420) return "yuv";
+        if(_codec == CODEC_RAW && _format == PIXEL_CHW_F32) return "f32";
+        return CodecExtension(_codec, _format == PIXEL_GRAY ? 1 : _channels);
+    }
+
+    bool CodecSupports(Codec _codec, PixelFormat _format)
+    {
+        if(_codec == CODEC_JPEG || _codec == CODEC_PNG) return _format == PIXEL_RGB || _format == PIXEL_GRAY;
+        return true;
+    }
+
+    /////////////////////////////////////////////////
+    // libjpeg destination that appends straight into a std::vector
+    struct VectorDestination
+    {
+        jpeg_destination_mgr pub;
+        std::vector<unsigned char> *out;
+    };
+
+    static const size_t JPEG_CHUNK = 64 * 1024;
+
+    static void InitDestination(j_compress_ptr _cinfo)
+    {
+        VectorDestination *dest = (VectorDestination *)_cinfo->dest;
+        dest->out->resize(JPEG_CHUNK);
+        dest->pub.next_output_byte = &(*dest->out)[0];
+        dest->pub.free_in_buffer = dest->out->size();
+    }
+
+    static boolean EmptyOutputBuffer(j_compress_ptr _cinfo)
+    {
+        VectorDestination *dest = (VectorDestination *)_cinfo->dest;
+        size_t used = dest->out->size();
+        dest->out->resize(used * 2);
+        dest->pub.next_output_byte = &(*dest->out)[used];
+        dest->pub.free_in_buffer = dest->out->size() - used;
+        return TRUE;
+    }
+
+    static void TermDestination(j_compress_ptr _cinfo)
+    {
+        VectorDestination *dest = (VectorDestination *)_cinfo->dest;
+        dest->out->resize(dest->out->size() - dest->pub.free_in_buffer);
+    }
+
+    struct JpegError
+    {
+        jpeg_error_mgr pub;
+        jmp_buf jump;
+    };
+
+    static void JpegErrorExit(j_common_ptr _cinfo)
+    {
+        JpegError *err = (JpegError *)_cinfo->err;
+        (*_cinfo->err->output_message)(_cinfo);
+        longjmp(err->jump, 1);
+    }
+
+    /////////////////////////////////////////////////
+    FrameEncoder::FrameEncoder(Codec _codec, int _quality, int _compression, const DeltaOptions &_delta)
+        : codec(_codec), quality(_quality), compression(_compression),
+          jpeg(NULL), jpegError(NULL), delta(NULL)
+    {
+        if(codec == CODEC_DELTA) delta = new DeltaEncoder(_delta);
+        if(codec == CODEC_JPEG){
+            JpegError *err = new JpegError();
+            jpegError = &err->pub;
+            jpeg = new jpeg_compress_struct();
+            jpeg->err = jpeg_std_error(jpegError);
+            jpegError->error_exit = JpegErrorExit;
+            jpeg_create_compress(jpeg);
+        }
+    }
+
+    FrameEncoder::~FrameEncoder()
+    {
+        if(jpeg != NULL){
+            jpeg_destroy_compress(jpeg);
+            delete jpeg;
+            delete (JpegError *)jpegError;
+        }
+        delete delta;
+    }
+
+    void FrameEncoder::Reset()
+    {
+        if(delta != NULL) delta->Reset();
+    }
+
+    bool FrameEncoder::Encode(CaptureFrame &_frame)
+    {
+        if(!CodecSupports(codec, _frame.format)) return false;
+        switch(codec){
+            case CODEC_JPEG: return EncodeJpeg(_frame);
+            case CODEC_PNG: return EncodePng(_frame);
+            case CODEC_RAW: return EncodeRaw(_frame);
+            case CODEC_DELTA:
+                if(_frame.format == PIXEL_YUV420 || _frame.format == PIXEL_CHW_F32){
+                    size_t row = (size_t)_frame.width * (_frame.format == PIXEL_CHW_F32 ? sizeof(float) : 1);
+                    return delta->Encode(_frame.id, &_frame.pixels[0], row, _frame.pixels.size() / row,
+                        1, _frame.encoded);
+                }
+                return delta->Encode(_frame.id, &_frame.pixels[0], _frame.width, _frame.height,
+                    _frame.channels, _frame.encoded);
+            default: return false;
+        }
+    }
+
+    bool FrameEncoder::EncodeJpeg(CaptureFrame &_frame)
+    {
+        VectorDestination dest;
+        dest.pub.init_destination = InitDestination;
+        dest.pub.empty_output_buffer = EmptyOutputBuffer;
+        dest.pub.term_destination = TermDestination;
+        dest.out = &_frame.encoded;
+
+        JpegError *err = (JpegError *)jpegError;
+        if(setjmp(err->jump)){
+            jpeg_abort_compress(jpeg);
+            return false;
+        }
+        jpeg->dest = &dest.pub;
+        jpeg->image_width = _frame.width;
+        jpeg->image_height = _frame.height;
+        jpeg->input_components = _frame.channels;
+        jpeg->in_color_space = _frame.channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+        jpeg_set_defaults(jpeg);
+        jpeg_set_quality(jpeg, quality, TRUE);
+        jpeg_start_compress(jpeg, TRUE);
+        size_t stride = (size_t)_frame.width * _frame.channels;
+        while(jpeg->next_scanline < jpeg->image_height){
+            JSAMPROW row = &_frame.pixels[jpeg->next_scanline * stride];
+            jpeg_write_scanlines(jpeg, &row, 1);
+        }
+        jpeg_finish_compress(jpeg);
+        jpeg->dest = NULL;
+        return true;
+    }
+
+    static void PngWrite(png_structp _png, png_bytep _data, png_size_t _length)
+    {
+        std::vector<unsigned char> *out = (std::vector<unsigned char> *)png_get_io_ptr(_png);
+        out->insert(out->end(), _data, _data + _length);
+    }
+
+    static void PngFlush(png_structp) {}
+
+    bool FrameEncoder::EncodePng(CaptureFrame &_frame)
+    {
+        _frame.encoded.clear();
+        png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        if(png == NULL) return false;
+        png_infop info = png_create_info_struct(png);
+        if(info == NULL || setjmp(png_jmpbuf(png))){
+            png_destroy_write_struct(&png, &info);
+            return false;
+        }
+        png_set_write_fn(png, &_frame.encoded, PngWrite, PngFlush);
+        png_set_compression_level(png, compression);
+        png_set_IHDR(png, info, _frame.width, _frame.height, 8,
+            _frame.channels == 1 ? PNG_COLOR_TYPE_GRAY : PNG_COLOR_TYPE_RGB,
+            PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png, info);
+        size_t stride = (size_t)_frame.width * _frame.channels;
+        for(unsigned int y = 0; y < _frame.height; y++)
+            png_write_row(png, &_frame.pixels[y * stride]);
+        png_write_end(png, NULL);
+        png_destroy_write_struct(&png, &info);
+        return true;
+    }
+
+    bool FrameEncoder::EncodeRaw(CaptureFrame &_frame)
+    {
+        if(_frame.format == PIXEL_YUV420 || _frame.format == PIXEL_CHW_F32){
+            _frame.encoded = _frame.pixels;
+            return true;
+        }
+        char header[64];
+        int n = snprintf(header, sizeof(header), "P%d\n%u %u\n255\n",
+            _frame.channels == 1 ? 5 : 6, _frame.width, _frame.height);
+        size_t size = (size_t)_frame.width * _frame.height * _frame.channels;
+        _frame.encoded.resize(n + size);
+        memcpy(&_frame.encoded[0], header, n);
+        memcpy(&_frame.encoded[n], &_frame.pixels[0], size);
+        return true;
+    }
+}
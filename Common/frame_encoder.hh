@@ -0,0 +1,79 @@
+#ifndef _CAMERA_COMMON_FRAME_ENCODER_HH_
+#define _CAMERA_COMMON_FRAME_ENCODER_HH_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "color_convert.hh"
+#include "delta_codec.hh"
+
+struct jpeg_compress_struct;
+struct jpeg_error_mgr;
+
+namespace camera_common
+{
+    enum Codec
+    {
+        CODEC_JPEG = 0,
+        CODEC_PNG,
+        CODEC_RAW,//binary ppm/pgm, no compression
+        CODEC_DELTA,//lossless keyframes and differences to the previous frame, see delta_codec.hh
+        CODEC_COUNT
+    };
+
+    // "jpg", "png", "raw" or "delta"; returns false for anything else.
+    bool ParseCodec(const std::string &_name, Codec &_codec);
+    const char *CodecName(Codec _codec);
+    // File extension for a frame with _channels channels.
+    const char *CodecExtension(Codec _codec, unsigned int _channels);
+    // File extension for a frame converted to _format: the bare planes of
+    // raw yuv420 and chw_f32 frames are .yuv and .f32.
+    const char *FrameExtension(Codec _codec, PixelFormat _format, unsigned int _channels);
+    // jpg and png only take packed rgb and gray.
+    bool CodecSupports(Codec _codec, PixelFormat _format);
+
+    // A frame on its way through the capture pipeline: the copied pixels and,
+    // once encoded, the bytes that go to disk.
+    struct CaptureFrame
+    {
+        uint64_t id;
+        int label;
+        std::string name;//file name relative to the output directory
+        unsigned int width;
+        unsigned int height;
+        unsigned int channels;//1 (gray) or 3 (rgb), the planes for yuv420 and chw_f32
+        PixelFormat format;//of pixels
+        std::vector<unsigned char> pixels;
+        std::vector<unsigned char> encoded;
+        uint64_t submitted;//NowNs when it entered the pipeline
+    };
+
+    // Encodes frames with one codec. Keeps the codec state between frames, so
+    // every thread needs its own encoder. CODEC_DELTA frames depend on the
+    // frame encoded before, so they have to be encoded in order. Planar
+    // frames are encoded as their bare bytes: raw without a header, delta
+    // as one channel rows of width * sample size bytes.
+    class FrameEncoder
+    {
+        public: FrameEncoder(Codec _codec, int _quality, int _compression,
+            const DeltaOptions &_delta = DeltaOptions());
+        public: ~FrameEncoder();
+        // Encode _frame.pixels into _frame.encoded.
+        public: bool Encode(CaptureFrame &_frame);
+        // Forget the previous frame, the next delta frame is a keyframe.
+        public: void Reset();
+
+        private: bool EncodeJpeg(CaptureFrame &_frame);
+        private: bool EncodePng(CaptureFrame &_frame);
+        private: bool EncodeRaw(CaptureFrame &_frame);
+
+        private: Codec codec;
+        private: int quality;//jpeg quality 1..100
+        private: int compression;//png zlib level 0..9
+        private: jpeg_compress_struct *jpeg;
+        private: jpeg_error_mgr *jpegError;
+        private: DeltaEncoder *delta;
+    };
+}
+#endif
@@ -0,0 +1,80 @@
+#include "frame_layout.hh"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+namespace camera_common
+{
+    bool ParseLayout(const std::string &_name, LayoutMode &_mode)
+    {
+        if(_name == "flat") _mode = LAYOUT_FLAT;
+        else if(_name == "chunked") _mode = LAYOUT_CHUNKED;
+        else if(_name == "hashed") _mode = LAYOUT_HASHED;
+        else return false;
+        return true;
+    }
+
+    const char *LayoutName(LayoutMode _mode)
+    {
+        switch(_mode){
+            case LAYOUT_FLAT: return "flat";
+            case LAYOUT_CHUNKED: return "chunked";
+            case LAYOUT_HASHED: return "hashed";
+            default: return "unknown";
+        }
+    }
+
+    FrameLayout::FrameLayout(LayoutMode _mode, unsigned int _framesPerDir, unsigned int _hashDirs)
+        : mode(_mode), framesPerDir(_framesPerDir == 0 ? 1 : _framesPerDir),
+          hashDirs(_hashDirs == 0 ? 1 : _hashDirs) {}
+
+    std::string FrameLayout::SubDirectory(uint64_t _id) const
+    {
+        char name[32];
+        switch(mode){
+            case LAYOUT_CHUNKED:
+                snprintf(name, sizeof(name), "%06llu", (unsigned long long)(_id / framesPerDir));
+                return name;
+            case LAYOUT_HASHED:{
+                //splitmix64 finalizer, consecutive ids land in different directories
+                uint64_t h = _id + 0x9e3779b97f4a7c15ULL;
+                h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+                h ^= h >> 31;
+                snprintf(name, sizeof(name), hashDirs <= 256 ? "%02x" : "%04x", (unsigned int)(h % hashDirs));
+                return name;
+            }
+            default:
+                return "";
+        }
+    }
+
+    std::string FrameLayout::Describe() const
+    {
+        char text[64];
+        if(mode == LAYOUT_CHUNKED) snprintf(text, sizeof(text), "chunked/%u", framesPerDir);
+        else if(mode == LAYOUT_HASHED) snprintf(text, sizeof(text), "hashed/%u", hashDirs);
+        else snprintf(text, sizeof(text), "%s", LayoutName(mode));
+        return text;
+    }
+
+    bool DirectoryCache::Ensure(const std::string &_path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(created.count(_path)) return true;
+        if(mkdir(_path.c_str(), 0755) != 0 && errno != EEXIST){
+            fprintf(stderr, "[CAPTURE]: cannot create %s: %s\n", _path.c_str(), strerror(errno));
+            return false;
+        }
+        created.insert(_path);
+        return true;
+    }
+
+    void DirectoryCache::Clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        created.clear();
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef _CAMERA_COMMON_FRAME_LAYOUT_HH_
+#define _CAMERA_COMMON_FRAME_LAYOUT_HH_
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace camera_common
+{
+    enum LayoutMode
+    {
+        LAYOUT_FLAT = 0,//every frame in the output directory
+        LAYOUT_CHUNKED,//<id / framesPerDir>/, e.g. 000012/ for frames 12000-12999
+        LAYOUT_HASHED,//<hash(id) % hashDirs>/ in hex, spreads frames evenly
+        LAYOUT_COUNT
+    };
+
+    bool ParseLayout(const std::string &_name, LayoutMode &_mode);
+    const char *LayoutName(LayoutMode _mode);
+
+    // Maps a frame id to the sub directory it is written to, so no directory
+    // holds more than a bounded number of frames.
+    class FrameLayout
+    {
+        public: FrameLayout(LayoutMode _mode, unsigned int _framesPerDir, unsigned int _hashDirs);
+
+        // Empty for LAYOUT_FLAT.
+        public: std::string SubDirectory(uint64_t _id) const;
+        // e.g. "chunked/1000", for the manifest
+        public: std::string Describe() const;
+
+        private: LayoutMode mode;
+        private: unsigned int framesPerDir;
+        private: unsigned int hashDirs;
+    };
+
+    // Creates directories on first use and remembers them, so writing a
+    // frame does not cost a mkdir system call. Safe to use from several
+    // threads.
+    class DirectoryCache
+    {
+        public: bool Ensure(const std::string &_path);
+        public: void Clear();
+
+        private: std::mutex mutex;
+        private: std::unordered_set<std::string> created;
+    };
+}
+#endif
@@ -0,0 +1,311 @@
+#include "frame_server.hh"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "capture_stats.hh"
+
+namespace camera_common
+{
+    bool ParseStreamAddress(const std::string &_address, bool &_unix, std::string &_path, int &_port)
+    {
+        if(_address.compare(0, 5, "unix:") == 0 && _address.size() > 5){
+            _unix = true;
+            _path = _address.substr(5);
+            return _path.size() < sizeof(((struct sockaddr_un *)0)->sun_path);
+        }
+        if(_address.compare(0, 4, "tcp:") == 0){
+            char *end;
+            long port = strtol(_address.c_str() + 4, &end, 10);
+            if(*end != '\0' || port <= 0 || port > 65535) return false;
+            _unix = false;
+            _port = (int)port;
+            return true;
+        }
+        return false;
+    }
+
+    FrameServer::FrameServer(unsigned int _queueFrames, unsigned int _batchFrames)
+        : queueFrames(_queueFrames == 0 ? 1 : _queueFrames),
+          batchFrames(_batchFrames == 0 ? 1 : (_batchFrames > 256 ? 256 : _batchFrames)),
+          listenFd(-1), wakeFd(-1), stopping(false), subscriberCount(0) {}
+
+    FrameServer::~FrameServer()
+    {
+        Stop();
+    }
+
+    bool FrameServer::Start(const std::string &_address)
+    {
+        bool isUnix = false;
+        std::string path;
+        int port = 0;
+        if(!ParseStreamAddress(_address, isUnix, path, port)){
+            fprintf(stderr, "[STREAM]: bad address %s, use unix:<path> or tcp:<port>\n", _address.c_str());
+            return false;
+        }
+        listenFd = socket(isUnix ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(listenFd < 0){
+            fprintf(stderr, "[STREAM]: socket: %s\n", strerror(errno));
+            return false;
+        }
+        int ok;
+        if(isUnix){
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            unlink(path.c_str());//left behind by a previous run
+            ok = bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
+            if(ok == 0) unixPath = path;
+        }else{
+            int one = 1;
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            ok = bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
+        }
+        if(ok != 0 || listen(listenFd, 16) != 0){
+            fprintf(stderr, "[STREAM]: cannot listen on %s: %s\n", _address.c_str(), strerror(errno));
+            Stop();
+            return false;
+        }
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(wakeFd < 0){
+            fprintf(stderr, "[STREAM]: eventfd: %s\n", strerror(errno));
+            Stop();
+            return false;
+        }
+        stopping = false;
+        thread = std::thread(&FrameServer::Run, this);
+        fprintf(stderr, "[STREAM]: serving frames on %s\n", _address.c_str());
+        return true;
+    }
+
+    void FrameServer::Stop()
+    {
+        if(thread.joinable()){
+            stopping = true;
+            Wake();
+            thread.join();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(size_t i = 0; i < subscribers.size(); i++) close(subscribers[i]->fd);
+            subscribers.clear();
+            subscriberCount = 0;
+        }
+        if(listenFd >= 0) close(listenFd);
+        if(wakeFd >= 0) close(wakeFd);
+        if(unixPath != "") unlink(unixPath.c_str());
+        listenFd = -1;
+        wakeFd = -1;
+        unixPath = "";
+    }
+
+    void FrameServer::Wake()
+    {
+        uint64_t one = 1;
+        if(write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            fprintf(stderr, "[STREAM]: cannot wake the server: %s\n", strerror(errno));
+    }
+
+    void FrameServer::Publish(const CaptureFrame &_frame, Codec _codec)
+    {
+        if(subscriberCount.load() == 0) return;
+        ShardRecordHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = SHARD_RECORD_MAGIC;
+        header.codec = RecordCodec(_codec, _frame.format);
+        header.id = _frame.id;
+        header.label = _frame.label;
+        header.width = _frame.width;
+        header.height = _frame.height;
+        header.channels = _frame.channels;
+        header.size = _frame.encoded.size();
+        std::shared_ptr<std::vector<unsigned char> > record(
+            new std::vector<unsigned char>(sizeof(header) + _frame.encoded.size()));
+        memcpy(&(*record)[0], &header, sizeof(header));
+        if(!_frame.encoded.empty()) memcpy(&(*record)[sizeof(header)], &_frame.encoded[0], _frame.encoded.size());
+
+        uint64_t dropped = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(size_t i = 0; i < subscribers.size(); i++){
+                Subscriber &s = *subscribers[i];
+                if(s.queue.size() >= queueFrames){
+                    s.queue.pop_front();
+                    s.dropped++;
+                    dropped++;
+                }
+                s.queue.push_back(record);
+            }
+        }
+        if(dropped > 0) CaptureStats::Instance().Add(COUNTER_FRAMES_STREAM_DROPPED, dropped);
+        Wake();
+    }
+
+    void FrameServer::Accept()
+    {
+        while(true){
+            int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(fd < 0){
+                if(errno == EINTR) continue;
+                if(errno != EAGAIN && errno != EWOULDBLOCK)
+                    fprintf(stderr, "[STREAM]: accept: %s\n", strerror(errno));
+                return;
+            }
+            if(unixPath == ""){
+                //batches are complete sends, do not wait for more data
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            std::unique_ptr<Subscriber> s(new Subscriber());
+            s->fd = fd;
+            s->batchBytes = 0;
+            s->sent = 0;
+            s->frames = 0;
+            s->dropped = 0;
+            std::lock_guard<std::mutex> lock(mutex);
+            subscribers.push_back(std::move(s));
+            subscriberCount = subscribers.size();
+            CaptureStats::Instance().SetGauge(GAUGE_STREAM_SUBSCRIBERS, subscribers.size());
+            fprintf(stderr, "[STREAM]: subscriber %d connected, %u in total\n", fd, subscriberCount.load());
+        }
+    }
+
+    bool FrameServer::Send(Subscriber &_s)
+    {
+        std::vector<struct iovec> iov;
+        while(true){
+            if(_s.batch.empty()){
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    while(!_s.queue.empty() && _s.batch.size() < batchFrames){
+                        _s.batch.push_back(_s.queue.front());
+                        _s.queue.pop_front();
+                    }
+                }
+                if(_s.batch.empty()) return true;
+                _s.header.magic = STREAM_BATCH_MAGIC;
+                _s.header.frames = _s.batch.size();
+                _s.header.bytes = 0;
+                for(size_t i = 0; i < _s.batch.size(); i++) _s.header.bytes += _s.batch[i]->size();
+                _s.batchBytes = sizeof(_s.header) + _s.header.bytes;
+                _s.sent = 0;
+            }
+            //what is left of the batch after a partial send
+            iov.clear();
+            size_t skip = _s.sent;
+            struct iovec v;
+            if(skip < sizeof(_s.header)){
+                v.iov_base = (char *)&_s.header + skip;
+                v.iov_len = sizeof(_s.header) - skip;
+                iov.push_back(v);
+                skip = 0;
+            }else skip -= sizeof(_s.header);
+            for(size_t i = 0; i < _s.batch.size(); i++){
+                size_t size = _s.batch[i]->size();
+                if(skip >= size){
+                    skip -= size;
+                    continue;
+                }
+                v.iov_base = (void *)(&(*_s.batch[i])[0] + skip);
+                v.iov_len = size - skip;
+                iov.push_back(v);
+                skip = 0;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov[0];
+            msg.msg_iovlen = iov.size();
+            ssize_t n = sendmsg(_s.fd, &msg, MSG_NOSIGNAL);
+            if(n < 0){
+                if(errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            _s.sent += n;
+            if(_s.sent == _s.batchBytes){
+                _s.frames += _s.batch.size();
+                CaptureStats::Instance().Add(COUNTER_FRAMES_STREAMED, _s.batch.size());
+                _s.batch.clear();
+            }
+        }
+    }
+
+    void FrameServer::Run()
+    {
+        std::vector<struct pollfd> fds;
+        while(!stopping){
+            size_t count;
+            fds.resize(2);
+            fds[0].fd = listenFd;
+            fds[0].events = POLLIN;
+            fds[1].fd = wakeFd;
+            fds[1].events = POLLIN;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                count = subscribers.size();
+                fds.resize(2 + count);
+                for(size_t i = 0; i < count; i++){
+                    Subscriber &s = *subscribers[i];
+                    fds[2 + i].fd = s.fd;
+                    fds[2 + i].events = POLLIN | (s.batch.empty() && s.queue.empty() ? 0 : POLLOUT);
+                }
+            }
+            for(size_t i = 0; i < fds.size(); i++) fds[i].revents = 0;
+            if(poll(&fds[0], fds.size(), -1) < 0 && errno != EINTR){
+                fprintf(stderr, "[STREAM]: poll: %s\n", strerror(errno));
+                return;
+            }
+            if(stopping) return;
+            if(fds[1].revents & POLLIN){
+                uint64_t value;
+                if(read(wakeFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                    fprintf(stderr, "[STREAM]: cannot read the wake up: %s\n", strerror(errno));
+            }
+
+            //subscribers are only added and removed by this thread
+            std::vector<size_t> gone;
+            for(size_t i = 0; i < count; i++){
+                Subscriber &s = *subscribers[i];
+                short revents = fds[2 + i].revents;
+                bool alive = (revents & (POLLERR | POLLNVAL)) == 0;
+                if(alive && (revents & (POLLIN | POLLHUP))){
+                    //subscribers do not send anything, this is the end of the connection
+                    char discard[256];
+                    ssize_t n = recv(s.fd, discard, sizeof(discard), MSG_DONTWAIT);
+                    if(n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) alive = false;
+                }
+                if(alive) alive = Send(s);
+                if(!alive) gone.push_back(i);
+            }
+            if(!gone.empty()){
+                std::lock_guard<std::mutex> lock(mutex);
+                for(size_t g = gone.size(); g-- > 0; ){
+                    Subscriber &s = *subscribers[gone[g]];
+                    fprintf(stderr, "[STREAM]: subscriber %d left after %llu frames, %llu dropped\n", s.fd,
+                        (unsigned long long)s.frames, (unsigned long long)s.dropped);
+                    close(s.fd);
+                    subscribers.erase(subscribers.begin() + gone[g]);
+                }
+                subscriberCount = subscribers.size();
+                CaptureStats::Instance().SetGauge(GAUGE_STREAM_SUBSCRIBERS, subscribers.size());
+            }
+            if(fds[0].revents & POLLIN) Accept();
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef _CAMERA_COMMON_FRAME_SERVER_HH_
+#define _CAMERA_COMMON_FRAME_SERVER_HH_
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_encoder.hh"
+#include "frame_writer.hh"
+
+namespace camera_common
+{
+    // Stream protocol: the server only sends. Every send is a batch, a
+    // StreamBatchHeader followed by 'bytes' bytes holding 'frames' records
+    // exactly as in a shard: a ShardRecordHeader and 'size' bytes of the
+    // encoded frame.
+    static const uint32_t STREAM_BATCH_MAGIC = 0x31424643;//"CFB1"
+
+    struct StreamBatchHeader
+    {
+        uint32_t magic;
+        uint32_t frames;
+        uint64_t bytes;//of the records that follow
+    };
+
+    // "unix:/path/to/socket" or "tcp:port" (bound to 127.0.0.1).
+    bool ParseStreamAddress(const std::string &_address, bool &_unix, std::string &_path, int &_port);
+
+    // Serves encoded frames to any number of subscribers over a Unix domain
+    // or localhost TCP socket. One thread accepts and sends with non
+    // blocking sockets. Every subscriber has its own queue of at most
+    // queueFrames frames: a slow subscriber loses its oldest frames (counted
+    // as frames_stream_dropped) without holding back the capture or the
+    // other subscribers. Queued frames are sent in batches of at most
+    // batchFrames with one sendmsg.
+    class FrameServer
+    {
+        public: FrameServer(unsigned int _queueFrames, unsigned int _batchFrames);
+        public: ~FrameServer();
+        public: bool Start(const std::string &_address);
+        public: void Stop();
+        // Called by the capture workers once a frame is encoded; copies the
+        // frame once for all subscribers, nothing without subscribers.
+        public: void Publish(const CaptureFrame &_frame, Codec _codec);
+        public: unsigned int Subscribers() const { return subscriberCount.load(); }
+
+        private: typedef std::shared_ptr<const std::vector<unsigned char> > Record;
+        private: struct Subscriber
+        {
+            int fd;
+            std::deque<Record> queue;//guarded by mutex
+            std::vector<Record> batch;//being sent, server thread only
+            StreamBatchHeader header;
+            size_t batchBytes;//header included
+            size_t sent;//of batchBytes
+            uint64_t frames;
+            uint64_t dropped;
+        };
+        private: void Run();
+        private: void Accept();
+        // false when the subscriber is gone
+        private: bool Send(Subscriber &_subscriber);
+        private: void Wake();
+
+        private: unsigned int queueFrames;
+        private: unsigned int batchFrames;
+        private: std::string unixPath;//unlinked on Stop
+        private: int listenFd;
+        private: int wakeFd;//eventfd, Publish wakes the server thread
+        private: std::atomic<bool> stopping;
+        private: std::thread thread;
+        private: std::mutex mutex;
+        private: std::vector<std::unique_ptr<Subscriber> > subscribers;
+        private: std::atomic<unsigned int> subscriberCount;
+    };
+}
+#endif
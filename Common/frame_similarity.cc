@@ -0,0 +1,93 @@
+#include "frame_similarity.hh"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace camera_common
+{
+    // pixels sampled per cell in each direction
+    static const unsigned int SAMPLES = 8;
+
+    void ComputeSignature(const unsigned char *_pixels, unsigned int _width,
+        unsigned int _height, unsigned int _channels, FrameSignature &_signature)
+    {
+        const int n = FrameSignature::SIZE;
+        memset(_signature.luma, 0, sizeof(_signature.luma));
+        if(_width < (unsigned int)n || _height < (unsigned int)n) return;
+        size_t stride = (size_t)_width * _channels;
+        for(int cy = 0; cy < n; cy++){
+            unsigned int y0 = cy * _height / n, y1 = (cy + 1) * _height / n;
+            unsigned int dy = (y1 - y0 + SAMPLES - 1) / SAMPLES;
+            for(int cx = 0; cx < n; cx++){
+                unsigned int x0 = cx * _width / n, x1 = (cx + 1) * _width / n;
+                unsigned int dx = (x1 - x0 + SAMPLES - 1) / SAMPLES;
+                uint32_t sum = 0, count = 0;
+                for(unsigned int y = y0; y < y1; y += dy){
+                    const unsigned char *row = _pixels + y * stride;
+                    for(unsigned int x = x0; x < x1; x += dx){
+                        const unsigned char *p = row + x * _channels;
+                        //BT.601 luma in 8 bit fixed point
+                        sum += _channels >= 3 ? (77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8 : p[0];
+                        count++;
+                    }
+                }
+                _signature.luma[cy * n + cx] = (uint8_t)(sum / count);
+            }
+        }
+    }
+
+    double SignatureDistance(const FrameSignature &_a, const FrameSignature &_b)
+    {
+        const int bytes = FrameSignature::SIZE * FrameSignature::SIZE;
+        uint32_t sad = 0;
+#ifdef __SSE2__
+        __m128i total = _mm_setzero_si128();
+        for(int i = 0; i < bytes; i += 16){
+            __m128i a = _mm_loadu_si128((const __m128i *)(_a.luma + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(_b.luma + i));
+            total = _mm_add_epi64(total, _mm_sad_epu8(a, b));
+        }
+        sad = _mm_cvtsi128_si32(total) + _mm_cvtsi128_si32(_mm_srli_si128(total, 8));
+#else
+        for(int i = 0; i < bytes; i++)
+            sad += _a.luma[i] > _b.luma[i] ? _a.luma[i] - _b.luma[i] : _b.luma[i] - _a.luma[i];
+#endif
+        return (double)sad / bytes;
+    }
+
+    unsigned int SignatureMax(const FrameSignature &_signature)
+    {
+        const int bytes = FrameSignature::SIZE * FrameSignature::SIZE;
+#ifdef __SSE2__
+        __m128i m = _mm_setzero_si128();
+        for(int i = 0; i < bytes; i += 16)
+            m = _mm_max_epu8(m, _mm_loadu_si128((const __m128i *)(_signature.luma + i)));
+        uint8_t lanes[16];
+        _mm_storeu_si128((__m128i *)lanes, m);
+        unsigned int max = 0;
+        for(int i = 0; i < 16; i++) if(lanes[i] > max) max = lanes[i];
+        return max;
+#else
+        unsigned int max = 0;
+        for(int i = 0; i < bytes; i++) if(_signature.luma[i] > max) max = _signature.luma[i];
+        return max;
+#endif
+    }
+
+    FrameFilter::FrameFilter(unsigned int _blankThreshold, double _dedupThreshold)
+        : blankThreshold(_blankThreshold), dedupThreshold(_dedupThreshold), haveReference(false) {}
+
+    FrameFilter::Verdict FrameFilter::Check(const unsigned char *_pixels, unsigned int _width,
+        unsigned int _height, unsigned int _channels)
+    {
+        if(!Enabled()) return KEEP;
+        ComputeSignature(_pixels, _width, _height, _channels, current);
+        if(blankThreshold > 0 && SignatureMax(current) <= blankThreshold) return BLANK;
+        if(dedupThreshold > 0 && haveReference && SignatureDistance(current, reference) < dedupThreshold)
+            return DUPLICATE;
+        return KEEP;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef _CAMERA_COMMON_FRAME_SIMILARITY_HH_
+#define _CAMERA_COMMON_FRAME_SIMILARITY_HH_
+
+#include <stdint.h>
+
+namespace camera_common
+{
+    // 16x16 luminance thumbnail of a frame, the mean of a sparse grid of
+    // pixels per cell. Cheap enough to compute for every rendered frame.
+    struct FrameSignature
+    {
+        static const int SIZE = 16;
+        uint8_t luma[SIZE * SIZE];
+    };
+
+    // _channels 1 (L8) or 3/4 (RGB8/RGBA8)
+    void ComputeSignature(const unsigned char *_pixels, unsigned int _width,
+        unsigned int _height, unsigned int _channels, FrameSignature &_signature);
+    // Mean absolute luminance difference of the thumbnails, 0..255.
+    double SignatureDistance(const FrameSignature &_a, const FrameSignature &_b);
+    // Brightest cell of the thumbnail.
+    unsigned int SignatureMax(const FrameSignature &_signature);
+
+    // Decides per frame whether it is worth saving: blank frames (e.g. the
+    // black frames before the scene is rendered) and frames nearly identical
+    // to the last kept frame (e.g. while turning slowly) are skipped.
+    class FrameFilter
+    {
+        public: enum Verdict
+        {
+            KEEP = 0,
+            BLANK,
+            DUPLICATE
+        };
+
+        // _blankThreshold: frames whose brightest cell is not above it are
+        // blank (0 disables). _dedupThreshold: frames closer than this to the
+        // last kept frame are duplicates (0 disables).
+        public: FrameFilter(unsigned int _blankThreshold, double _dedupThreshold);
+
+        public: bool Enabled() const { return blankThreshold > 0 || dedupThreshold > 0; }
+        // Classify a frame against the last kept frame.
+        public: Verdict Check(const unsigned char *_pixels, unsigned int _width,
+            unsigned int _height, unsigned int _channels);
+        // The frame of the last KEEP verdict is saved and becomes the
+        // reference; frames that pass the filter but are not saved (label
+        // balance) are not.
+        public: void Keep() { reference = current; haveReference = true; }
+        // Forget the reference, e.g. at a new episode.
+        public: void Reset() { haveReference = false; }
+
+        private: unsigned int blankThreshold;
+        private: double dedupThreshold;
+        private: bool haveReference;
+        private: FrameSignature reference;
+        private: FrameSignature current;
+    };
+}
+#endif
@@ -0,0 +1,454 @@
+#include "frame_writer.hh"
+
+#include "capture_stats.hh"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace camera_common
+{
+    bool ParseOutputMode(const std::string &_name, OutputMode &_mode)
+    {
+        if(_name == "files") _mode = OUTPUT_FILES;
+        else if(_name == "shards") _mode = OUTPUT_SHARDS;
+        else if(_name == "video") _mode = OUTPUT_VIDEO;
+        else if(_name == "npy") _mode = OUTPUT_NPY;
+        else return false;
+        return true;
+    }
+
+    const char *OutputModeName(OutputMode _mode)
+    {
+        switch(_mode){
+            case OUTPUT_FILES: return "files";
+            case OUTPUT_SHARDS: return "shards";
+            case OUTPUT_VIDEO: return "video";
+            case OUTPUT_NPY: return "npy";
+            default: return "unknown";
+        }
+    }
+
+    bool ParseDurability(const std::string &_name, Durability &_durability)
+    {
+        if(_name == "none") _durability = DURABILITY_NONE;
+        else if(_name == "shard") _durability = DURABILITY_SHARD;
+        else if(_name == "interval") _durability = DURABILITY_INTERVAL;
+        else return false;
+        return true;
+    }
+
+    const char *DurabilityName(Durability _durability)
+    {
+        switch(_durability){
+            case DURABILITY_NONE: return "none";
+            case DURABILITY_SHARD: return "shard";
+            case DURABILITY_INTERVAL: return "interval";
+            default: return "unknown";
+        }
+    }
+
+    std::string ShardFileName(unsigned int _shard, const char *_extension)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "shard-%05u.%s", _shard, _extension);
+        return name;
+    }
+
+    bool WriteAll(int _fd, const void *_data, size_t _size)
+    {
+        const char *p = (const char *)_data;
+        while(_size > 0){
+            ssize_t n = write(_fd, p, _size);
+            if(n < 0){
+                if(errno == EINTR) continue;
+                return false;
+            }
+            p += n;
+            _size -= n;
+        }
+        return true;
+    }
+
+    /////////////////////////////////////////////////
+    FileFrameWriter::FileFrameWriter(const FrameLayout &_layout, IoBackend *_io) : layout(_layout), io(_io) {}
+
+    bool FileFrameWriter::Open(const std::string &_directory)
+    {
+        directory = _directory;
+        directories.Clear();
+        return true;
+    }
+
+    bool FileFrameWriter::Write(const CaptureFrame &_frame)
+    {
+        std::string path = directory + "/";
+        std::string sub = layout.SubDirectory(_frame.id);
+        if(sub != ""){
+            path += sub;
+            if(!directories.Ensure(path)) return false;
+            path += "/";
+        }
+        path += _frame.name;
+        int fd = open(path.c_str(), CreateFlags(), 0644);
+        if(fd < 0){
+            fprintf(stderr, "[CAPTURE]: cannot open %s: %s\n", path.c_str(), strerror(errno));
+            return false;
+        }
+        if(io != NULL){
+            IoRequest *r = new IoRequest();
+            r->owned = _frame.encoded;
+            r->Reset(fd, r->owned.data(), r->owned.size(), 0);
+            r->closeFd = true;
+            r->release = true;
+            if(completion){
+                Completion done = completion;
+                uint64_t id = _frame.id;
+                int label = _frame.label;
+                size_t size = _frame.encoded.size();
+                r->onFinish = [done, id, label, size](int _error){ done(id, label, size, _error == 0); };
+            }
+            io->Submit(r);
+            return true;
+        }
+        bool ok = WriteAll(fd, &_frame.encoded[0], _frame.encoded.size());
+        return (close(fd) == 0) && ok;
+    }
+
+    void FileFrameWriter::Flush()
+    {
+        if(io != NULL) io->Drain();
+    }
+
+    static void ScanFrames(const std::string &_directory, CaptureManifest &_manifest, int _depth)
+    {
+        DIR *d = opendir(_directory.c_str());
+        if(d == NULL) return;
+        struct dirent *e;
+        while((e = readdir(d)) != NULL){
+            const char *name = e->d_name;
+            if(name[0] == '.') continue;
+            char *end;
+            unsigned long long id = strtoull(name, &end, 10);
+            if(end != name && strncmp(end, "-gt", 3) == 0){
+                int label = end[3] >= '0' && end[3] <= '9' ? atoi(end + 3) : -1;
+                _manifest.AddFrame(id, label);
+            }else if(_depth > 0 && (e->d_type == DT_DIR || e->d_type == DT_UNKNOWN)){
+                //sub directory of a chunked or hashed layout
+                ScanFrames(_directory + "/" + name, _manifest, _depth - 1);
+            }
+        }
+        closedir(d);
+    }
+
+    void FileFrameWriter::Scan(const std::string &_directory, CaptureManifest &_manifest)
+    {
+        ScanFrames(_directory, _manifest, 1);
+    }
+
+    /////////////////////////////////////////////////
+    static const size_t DIRECT_ALIGNMENT = 4096;
+
+    ShardOptions::ShardOptions()
+        : shardBytes(256ULL << 20), bufferBytes(4 << 20), durability(DURABILITY_NONE),
+          syncInterval(5), direct(false), dropCache(false) {}
+
+    ShardFrameWriter::ShardFrameWriter(Codec _codec, const ShardOptions &_options, IoBackend *_io)
+        : codec(_codec), options(_options), io(_io), shard(0), recordFd(-1), indexFd(-1),
+          direct(false), offset(0), written(0), kicked(0), cached(0), lastSync(0), broken(false),
+          current(0), used(0), carried(0)
+    {
+        //a multiple of the O_DIRECT alignment, at least 64kB
+        size_t size = options.bufferBytes < (64 << 10) ? (64 << 10) : options.bufferBytes;
+        options.bufferBytes = (size + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+        buffers.resize(io != NULL ? SHARD_BUFFERS : 1);
+        for(size_t i = 0; i < buffers.size(); i++){
+            void *p = NULL;
+            buffers[i].data = posix_memalign(&p, DIRECT_ALIGNMENT, options.bufferBytes) == 0 ? (unsigned char *)p : NULL;
+            buffers[i].start = 0;
+            buffers[i].inFlight = false;
+        }
+    }
+
+    ShardFrameWriter::~ShardFrameWriter()
+    {
+        Close();
+        for(size_t i = 0; i < buffers.size(); i++) free(buffers[i].data);
+    }
+
+    bool ShardFrameWriter::Open(const std::string &_directory)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CloseShard();
+        directory = _directory;
+        // continue after the shards already in the directory
+        shard = 0;
+        struct stat st;
+        while(stat((directory + "/" + ShardFileName(shard, "rec")).c_str(), &st) == 0) shard++;
+        for(size_t i = 0; i < buffers.size(); i++) if(buffers[i].data == NULL) return false;
+        return true;
+    }
+
+    bool ShardFrameWriter::OpenShard()
+    {
+        std::string rec = directory + "/" + ShardFileName(shard, "rec");
+        std::string idx = directory + "/" + ShardFileName(shard, "idx");
+        direct = false;
+        if(options.direct){
+            recordFd = open(rec.c_str(), CreateFlags() | O_DIRECT, 0644);
+            if(recordFd >= 0) direct = true;
+            else if(errno == EINVAL) fprintf(stderr, "[CAPTURE]: no O_DIRECT for %s, using the page cache\n", rec.c_str());
+        }
+        if(recordFd < 0) recordFd = open(rec.c_str(), CreateFlags(), 0644);
+        indexFd = open(idx.c_str(), CreateFlags(), 0644);
+        offset = 0;
+        written = 0;
+        kicked = 0;
+        cached = 0;
+        current = 0;
+        used = 0;
+        carried = 0;
+        broken = false;
+        lastSync = NowNs();
+        pendingIndex.clear();
+        if(recordFd < 0 || indexFd < 0){
+            fprintf(stderr, "[CAPTURE]: cannot open %s: %s\n", rec.c_str(), strerror(errno));
+            CloseShard();
+            return false;
+        }
+        return true;
+    }
+
+    bool ShardFrameWriter::CloseShard()
+    {
+        bool ok = true;
+        if(recordFd >= 0){
+            ok = FlushBuffer(true);
+            ok = ReapAll() && ok;
+            if(!ok) broken = true;
+            ok = WriteIndex() && ok;
+            if(options.durability != DURABILITY_NONE || options.dropCache)
+                ok = fdatasync(recordFd) == 0 && fdatasync(indexFd) == 0 && ok;
+            if(options.dropCache) posix_fadvise(recordFd, 0, 0, POSIX_FADV_DONTNEED);
+            close(recordFd);
+            shard++;
+        }
+        if(indexFd >= 0) close(indexFd);
+        recordFd = -1;
+        indexFd = -1;
+        return ok;
+    }
+
+    bool ShardFrameWriter::Append(const void *_data, size_t _size)
+    {
+        const unsigned char *p = (const unsigned char *)_data;
+        while(_size > 0){
+            size_t n = options.bufferBytes - used;
+            if(n > _size) n = _size;
+            memcpy(buffers[current].data + used, p, n);
+            used += n;
+            p += n;
+            _size -= n;
+            if(used == options.bufferBytes && !FlushBuffer(false)) return false;
+        }
+        return true;
+    }
+
+    bool ShardFrameWriter::FlushBuffer(bool _final)
+    {
+        if(used == carried){
+            //nothing new since the last partial write, only the padding may have to go
+            if(_final && carried > 0 && !(ReapAll() && ftruncate(recordFd, written) == 0)) return false;
+            return WriteIndex();
+        }
+        Buffer &b = buffers[current];
+        size_t size = used;
+        if(direct && size % DIRECT_ALIGNMENT != 0){
+            //a partial block, at the end of the shard or of a partial write
+            size = (size + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+            memset(b.data + used, 0, size - used);
+        }
+        b.start = written - carried;
+        if(io != NULL){
+            b.request.Reset(recordFd, b.data, size, b.start);
+            io->Submit(&b.request);
+            b.inFlight = true;
+        }else if(lseek(recordFd, b.start, SEEK_SET) < 0 || !WriteAll(recordFd, b.data, size)){
+            broken = true;
+            return false;
+        }
+        written = b.start + used;
+        bool padded = size != used;
+        //with direct the partial block is written again at the start of the next buffer
+        size_t tail = padded && !_final ? used % DIRECT_ALIGNMENT : 0;
+        if(padded && !(Reap(current) && (!_final || ftruncate(recordFd, written) == 0))) return false;
+        unsigned int previous = current;
+        //fill the next buffer once its previous write is done
+        current = (current + 1) % buffers.size();
+        if(!Reap(current)) return false;
+        if(tail > 0) memmove(buffers[current].data, buffers[previous].data + used - tail, tail);
+        used = tail;
+        carried = tail;
+        if(!WriteIndex()) return false;
+
+        uint64_t done = Completed();
+        if(options.dropCache && !direct && done > kicked){
+            //start writing back the new data, wait for the previous piece and drop it
+            sync_file_range(recordFd, kicked, done - kicked, SYNC_FILE_RANGE_WRITE);
+            if(kicked > cached){
+                sync_file_range(recordFd, cached, kicked - cached, SYNC_FILE_RANGE_WAIT_BEFORE |
+                    SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+                posix_fadvise(recordFd, cached, kicked - cached, POSIX_FADV_DONTNEED);
+                cached = kicked;
+            }
+            kicked = done;
+        }
+        return true;
+    }
+
+    bool ShardFrameWriter::SyncIfDue()
+    {
+        if(options.durability != DURABILITY_INTERVAL || recordFd < 0) return true;
+        uint64_t now = NowNs();
+        if(now - lastSync < options.syncInterval * 1e9) return true;
+        lastSync = now;
+        if(!FlushBuffer(false) || !ReapAll() || !WriteIndex()) return false;
+        if(fdatasync(recordFd) != 0 || fdatasync(indexFd) != 0){
+            fprintf(stderr, "[CAPTURE]: cannot sync shard %u: %s\n", shard, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    void ShardFrameWriter::Fail()
+    {
+        broken = true;
+        CloseShard();
+    }
+
+    bool ShardFrameWriter::Reap(unsigned int _buffer)
+    {
+        Buffer &b = buffers[_buffer];
+        if(!b.inFlight) return true;
+        io->Wait(&b.request);
+        b.inFlight = false;
+        if(b.request.error != 0){
+            fprintf(stderr, "[CAPTURE]: cannot write shard %u: %s\n", shard, strerror(b.request.error));
+            broken = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool ShardFrameWriter::ReapAll()
+    {
+        bool ok = true;
+        for(unsigned int i = 0; i < buffers.size(); i++) ok = Reap(i) && ok;
+        return ok;
+    }
+
+    uint64_t ShardFrameWriter::Completed() const
+    {
+        uint64_t done = written;
+        for(size_t i = 0; i < buffers.size(); i++)
+            if(buffers[i].inFlight && buffers[i].start < done) done = buffers[i].start;
+        return done;
+    }
+
+    bool ShardFrameWriter::WriteIndex()
+    {
+        //entries of records that are completely written, all of them fail in a broken shard
+        size_t n = 0;
+        if(broken){
+            n = pendingIndex.size();
+        }else{
+            uint64_t done = Completed();
+            while(n < pendingIndex.size() &&
+                pendingIndex[n].offset + sizeof(ShardRecordHeader) + pendingIndex[n].size <= done) n++;
+        }
+        if(n == 0) return !broken;
+        bool ok = !broken && WriteAll(indexFd, &pendingIndex[0], n * sizeof(ShardIndexEntry));
+        if(!ok) broken = true;
+        if(completion){
+            for(size_t i = 0; i < n; i++)
+                completion(pendingIndex[i].id, pendingIndex[i].label, pendingIndex[i].size, ok);
+        }
+        pendingIndex.erase(pendingIndex.begin(), pendingIndex.begin() + n);
+        return ok;
+    }
+
+    bool ShardFrameWriter::Write(const CaptureFrame &_frame)
+    {
+        ShardRecordHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = SHARD_RECORD_MAGIC;
+        header.codec = RecordCodec(codec, _frame.format);
+        header.id = _frame.id;
+        header.label = _frame.label;
+        header.width = _frame.width;
+        header.height = _frame.height;
+        header.channels = _frame.channels;
+        header.size = _frame.encoded.size();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if(recordFd >= 0 && offset + sizeof(header) + header.size > options.shardBytes && offset > 0 && !CloseShard())
+            fprintf(stderr, "[CAPTURE]: could not complete shard %u\n", shard - 1);
+        if(recordFd < 0 && !OpenShard()) return false;
+
+        ShardIndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.id = _frame.id;
+        entry.offset = offset;
+        entry.size = header.size;
+        entry.label = _frame.label;
+        pendingIndex.push_back(entry);
+        offset += sizeof(header) + header.size;
+        if(!Append(&header, sizeof(header)) || !Append(&_frame.encoded[0], _frame.encoded.size())){
+            //this frame fails through the return value, the others of the shard through the completion
+            pendingIndex.pop_back();
+            Fail();
+            return false;
+        }
+        if(!SyncIfDue()) Fail();
+        return true;
+    }
+
+    bool ShardFrameWriter::Close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(recordFd < 0 || CloseShard()) return true;
+        fprintf(stderr, "[CAPTURE]: could not complete shard %u\n", shard - 1);
+        return false;
+    }
+
+    void ShardFrameWriter::Flush()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(recordFd >= 0 && !(FlushBuffer(false) && ReapAll() && WriteIndex())) Fail();
+    }
+
+    void ShardFrameWriter::Poll()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!SyncIfDue()) Fail();
+    }
+
+    void ShardFrameWriter::Scan(const std::string &_directory, CaptureManifest &_manifest)
+    {
+        struct stat st;
+        for(unsigned int s = 0; stat((_directory + "/" + ShardFileName(s, "rec")).c_str(), &st) == 0; s++){
+            FILE *f = fopen((_directory + "/" + ShardFileName(s, "idx")).c_str(), "rb");
+            if(f == NULL) continue;
+            ShardIndexEntry entry;
+            //a partial entry at the end of a crashed run is ignored
+            while(fread(&entry, sizeof(entry), 1, f) == 1) _manifest.AddFrame(entry.id, entry.label);
+            fclose(f);
+        }
+    }
+}
@@ -0,0 +1,217 @@
+#ifndef _CAMERA_COMMON_FRAME_WRITER_HH_
+#define _CAMERA_COMMON_FRAME_WRITER_HH_
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "capture_manifest.hh"
+#include "frame_encoder.hh"
+#include "frame_layout.hh"
+#include "io_backend.hh"
+
+namespace camera_common
+{
+    enum OutputMode
+    {
+        OUTPUT_FILES = 0,//one file per frame, named CaptureFrame::name
+        OUTPUT_SHARDS,//frames appended to shard-NNNNN.rec with an index
+        OUTPUT_VIDEO,//an H.264 stream per episode with an index, see video_writer.hh
+        OUTPUT_NPY,//NumPy arrays of the pixels, labels and ids per episode, see npy_writer.hh
+        OUTPUT_COUNT
+    };
+
+    bool ParseOutputMode(const std::string &_name, OutputMode &_mode);
+    const char *OutputModeName(OutputMode _mode);
+
+    // When shard data is forced to disk.
+    enum Durability
+    {
+        DURABILITY_NONE = 0,//whenever the kernel writes it back
+        DURABILITY_SHARD,//fdatasync when a shard is closed
+        DURABILITY_INTERVAL,//fdatasync at most every ShardOptions::syncInterval seconds
+        DURABILITY_COUNT
+    };
+
+    bool ParseDurability(const std::string &_name, Durability &_durability);
+    const char *DurabilityName(Durability _durability);
+
+    // Shard layout: shard-NNNNN.rec is a sequence of ShardRecordHeader, each
+    // followed by 'size' bytes of the encoded frame. shard-NNNNN.idx holds one
+    // ShardIndexEntry per record, so a reader can seek without scanning.
+    static const uint32_t SHARD_RECORD_MAGIC = 0x31524643;//"CFR1"
+
+    struct ShardRecordHeader
+    {
+        uint32_t magic;
+        uint32_t codec;//Codec, PixelFormat << 16 (0 is packed rgb/gray), see RecordCodec
+        uint64_t id;
+        int32_t label;
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        uint64_t size;
+    };
+
+    inline uint32_t RecordCodec(Codec _codec, PixelFormat _format)
+    {
+        return (uint32_t)_codec | (uint32_t)_format << 16;
+    }
+
+    struct ShardIndexEntry
+    {
+        uint64_t id;
+        uint64_t offset;//of the record header in the .rec file
+        uint64_t size;//of the encoded frame
+        int32_t label;
+        uint32_t reserved;
+    };
+
+    std::string ShardFileName(unsigned int _shard, const char *_extension);
+
+    // Destination of encoded frames. Write may be called from several
+    // threads at once; Open and Close are only called while no frames are
+    // in flight. An exclusive writer never replaces an existing file, a
+    // Write that would fails instead. With an IoBackend Write may return
+    // before the data is written; Flush waits for it. An Asynchronous
+    // writer reports the outcome of every frame its Write accepted through
+    // the completion, from the thread that finished the write.
+    class FrameWriter
+    {
+        public: typedef std::function<void(uint64_t _id, int _label, size_t _size, bool _ok)> Completion;
+
+        public: FrameWriter() : exclusive(false) {}
+        public: virtual ~FrameWriter() {}
+        public: void SetExclusive(bool _exclusive) { exclusive = _exclusive; }
+        public: void SetCompletion(const Completion &_completion) { completion = _completion; }
+        public: virtual bool Asynchronous() const { return false; }
+        public: virtual bool Open(const std::string &_directory) = 0;
+        public: virtual bool Write(const CaptureFrame &_frame) = 0;
+        // False if frames could not be completed (final flush or sync).
+        public: virtual bool Close() = 0;
+        public: virtual void Flush() {}
+        // Called about once a second while no frames arrive, for writers
+        // with deadlines of their own.
+        public: virtual void Poll() {}
+        // Add the frames already in _directory to _manifest, to resume a run.
+        public: virtual void Scan(const std::string &_directory, CaptureManifest &_manifest) = 0;
+
+        protected: int CreateFlags() const
+        {
+            return O_WRONLY | O_CREAT | (exclusive ? O_EXCL : O_TRUNC);
+        }
+        protected: bool exclusive;
+        protected: Completion completion;
+    };
+
+    // Frames go to _layout's sub directory of the output directory. With
+    // _io the file is opened (and an existing one detected) in Write, the
+    // data is copied and written and the file closed by _io.
+    class FileFrameWriter : public FrameWriter
+    {
+        public: FileFrameWriter(const FrameLayout &_layout, IoBackend *_io);
+        public: virtual bool Open(const std::string &_directory);
+        public: virtual bool Write(const CaptureFrame &_frame);
+        public: virtual bool Close() { Flush(); return true; }
+        public: virtual void Flush();
+        public: virtual bool Asynchronous() const { return io != NULL; }
+        // Frames named <id>-gt<label>.<ext>, as Camera_gt names them, in
+        // _directory and its sub directories.
+        public: virtual void Scan(const std::string &_directory, CaptureManifest &_manifest);
+
+        private: FrameLayout layout;
+        private: IoBackend *io;
+        private: DirectoryCache directories;
+        private: std::string directory;
+    };
+
+    struct ShardOptions
+    {
+        uint64_t shardBytes;//start a new shard beyond this size
+        size_t bufferBytes;//records are coalesced into writes of this size
+        Durability durability;
+        double syncInterval;//s, DURABILITY_INTERVAL
+        bool direct;//O_DIRECT, bypass the page cache
+        bool dropCache;//write back and drop written data from the page cache
+        ShardOptions();
+    };
+
+    // Records are copied into an aligned buffer and written in bufferBytes
+    // pieces, the index entries of a record only after its data. With
+    // direct the last, partial block of a shard is padded and the file
+    // truncated to its real size afterwards. With _io SHARD_BUFFERS
+    // buffers are used in turn, so the next one fills while the previous
+    // ones are written.
+    //
+    // Asynchronous: a frame is reported to the completion once its index
+    // entry is written, or as failed when a write of its shard fails; the
+    // frames of that shard not yet indexed are lost and the next frame
+    // starts a new shard. Flush writes the partly filled buffer, and with
+    // DURABILITY_INTERVAL so do Write and Poll when the interval is over,
+    // followed by fdatasync. With direct a partly filled buffer is written
+    // padded to whole blocks, its last block is written again with the
+    // next buffer.
+    class ShardFrameWriter : public FrameWriter
+    {
+        public: ShardFrameWriter(Codec _codec, const ShardOptions &_options, IoBackend *_io);
+        public: virtual ~ShardFrameWriter();
+        public: virtual bool Open(const std::string &_directory);
+        public: virtual bool Write(const CaptureFrame &_frame);
+        public: virtual bool Close();
+        public: virtual void Flush();
+        public: virtual void Poll();
+        public: virtual bool Asynchronous() const { return true; }
+        // Reads the index of every shard in _directory.
+        public: virtual void Scan(const std::string &_directory, CaptureManifest &_manifest);
+
+        private: bool OpenShard();
+        // Close the shard after a failed write, its unindexed frames fail.
+        private: void Fail();
+        // Write the buffer and fdatasync if the DURABILITY_INTERVAL is over.
+        private: bool SyncIfDue();
+        private: bool CloseShard();
+        private: bool Append(const void *_data, size_t _size);
+        private: bool FlushBuffer(bool _final);
+        private: bool WriteIndex();
+        private: bool Reap(unsigned int _buffer);
+        private: bool ReapAll();
+        // End of the data known to be written, index entries up to here are safe.
+        private: uint64_t Completed() const;
+
+        private: Codec codec;
+        private: ShardOptions options;
+        private: IoBackend *io;
+        private: std::string directory;
+        private: std::mutex mutex;
+        private: unsigned int shard;
+        private: int recordFd;
+        private: int indexFd;
+        private: bool direct;//recordFd was opened with O_DIRECT
+        private: uint64_t offset;//logical end of the shard, buffered records included
+        private: uint64_t written;//bytes of the shard on disk (or in the page cache)
+        private: uint64_t kicked;//end of the range whose write back was started
+        private: uint64_t cached;//start of the written range not yet dropped from the page cache
+        private: uint64_t lastSync;//NowNs of the last fdatasync
+        private: bool broken;//a write of this shard failed
+        private: static const unsigned int SHARD_BUFFERS = 4;
+        private: struct Buffer
+        {
+            unsigned char *data;//aligned for O_DIRECT
+            uint64_t start;//offset in the shard
+            bool inFlight;
+            IoRequest request;
+        };
+        private: std::vector<Buffer> buffers;//one without _io
+        private: unsigned int current;//buffer being filled
+        private: size_t used;//of the current buffer
+        private: size_t carried;//bytes at the start of the current buffer already written (direct)
+        private: std::vector<ShardIndexEntry> pendingIndex;//entries of records still in the buffer
+    };
+
+    // Write all of _size bytes, retrying on short writes and EINTR.
+    bool WriteAll(int _fd, const void *_data, size_t _size);
+}
+#endif
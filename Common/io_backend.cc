@@ -0,0 +1,325 @@
+#include "io_backend.hh"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capture_stats.hh"
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace camera_common
+{
+    bool ParseIoBackend(const std::string &_name, IoBackendMode &_mode)
+    {
+        if(_name == "sync") _mode = IO_SYNC;
+        else if(_name == "uring") _mode = IO_URING;
+        else if(_name == "threads") _mode = IO_THREADS;
+        else return false;
+        return true;
+    }
+
+    const char *IoBackendName(IoBackendMode _mode)
+    {
+        switch(_mode){
+            case IO_SYNC: return "sync";
+            case IO_URING: return "uring";
+            case IO_THREADS: return "threads";
+            default: return "unknown";
+        }
+    }
+
+    IoRequest::IoRequest()
+        : fd(-1), data(NULL), size(0), offset(0), closeFd(false), release(false),
+          done(0), error(0), finished(false)
+    {
+        iov.iov_base = NULL;
+        iov.iov_len = 0;
+    }
+
+    void IoRequest::Reset(int _fd, const unsigned char *_data, size_t _size, uint64_t _offset)
+    {
+        fd = _fd;
+        data = _data;
+        size = _size;
+        offset = _offset;
+    }
+
+    /////////////////////////////////////////////////
+    std::unique_ptr<IoBackend> IoBackend::Create(IoBackendMode _mode, unsigned int _depth)
+    {
+        if(_mode == IO_SYNC) return std::unique_ptr<IoBackend>();
+        if(_depth == 0) _depth = 1;
+        if(_mode == IO_URING){
+            std::unique_ptr<UringIoBackend> uring(new UringIoBackend(_depth));
+            if(uring->Ready()) return std::unique_ptr<IoBackend>(uring.release());
+            fprintf(stderr, "[CAPTURE]: falling back to %u pwrite threads\n", _depth);
+        }
+        return std::unique_ptr<IoBackend>(new ThreadIoBackend(_depth));
+    }
+
+    IoBackend::IoBackend(unsigned int _depth) : depth(_depth), inFlight(0) {}
+
+    void IoBackend::Submit(IoRequest *_request)
+    {
+        _request->done = 0;
+        _request->error = 0;
+        _request->finished = false;
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]{ return inFlight < depth; });
+        inFlight++;
+        Start(_request);
+    }
+
+    void IoBackend::Wait(IoRequest *_request)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [_request]{ return _request->finished; });
+    }
+
+    void IoBackend::Drain()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]{ return inFlight == 0; });
+    }
+
+    void IoBackend::Finish(IoRequest *_request, int _error)
+    {
+        if(_request->closeFd && close(_request->fd) != 0 && _error == 0) _error = errno;
+        bool release = _request->release;
+        if(_error != 0 && release){
+            fprintf(stderr, "[CAPTURE]: write failed: %s\n", strerror(_error));
+            CaptureStats::Instance().Add(COUNTER_WRITE_ERRORS);
+        }
+        if(_request->onFinish) _request->onFinish(_error);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            _request->error = _error;
+            _request->finished = true;
+            inFlight--;
+        }
+        changed.notify_all();
+        if(release) delete _request;
+    }
+
+    /////////////////////////////////////////////////
+    ThreadIoBackend::ThreadIoBackend(unsigned int _depth) : IoBackend(_depth), stopping(false)
+    {
+        for(unsigned int i = 0; i < depth; i++) threads.push_back(std::thread(&ThreadIoBackend::Run, this));
+    }
+
+    ThreadIoBackend::~ThreadIoBackend()
+    {
+        Drain();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        notEmpty.notify_all();
+        for(size_t i = 0; i < threads.size(); i++) threads[i].join();
+    }
+
+    void ThreadIoBackend::Start(IoRequest *_request)
+    {
+        queue.push_back(_request);
+        notEmpty.notify_one();
+    }
+
+    void ThreadIoBackend::Run()
+    {
+        while(true){
+            IoRequest *r;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                notEmpty.wait(lock, [this]{ return stopping || !queue.empty(); });
+                if(queue.empty()) return;//stopping
+                r = queue.front();
+                queue.pop_front();
+            }
+            int error = 0;
+            while(r->done < r->size){
+                ssize_t n = pwrite(r->fd, r->data + r->done, r->size - r->done, r->offset + r->done);
+                if(n < 0){
+                    if(errno == EINTR) continue;
+                    error = errno;
+                    break;
+                }
+                if(n == 0){
+                    error = EIO;
+                    break;
+                }
+                r->done += n;
+            }
+            Finish(r, error);
+        }
+    }
+
+    /////////////////////////////////////////////////
+    UringIoBackend::UringIoBackend(unsigned int _depth)
+        : IoBackend(_depth), ring(-1), sqMap(NULL), sqMapSize(0), cqMap(NULL),
+          cqMapSize(0), sqeMap(NULL), sqeMapSize(0), sqTail(NULL), sqMask(0), sqArray(NULL),
+          cqHead(NULL), cqTail(NULL), cqMask(0), cqes(NULL)
+    {
+#if defined(HAVE_IO_URING) && defined(__NR_io_uring_setup)
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        //room for the wake ups and the request that stops the reaper
+        int fd = syscall(__NR_io_uring_setup, 2 * depth + 2, &p);
+        if(fd < 0){
+            fprintf(stderr, "[CAPTURE]: no io_uring: %s\n", strerror(errno));
+            return;
+        }
+        sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+        cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if(single) sqMapSize = cqMapSize = sqMapSize > cqMapSize ? sqMapSize : cqMapSize;
+        sqeMapSize = p.sq_entries * sizeof(struct io_uring_sqe);
+        void *sq = mmap(NULL, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        void *cq = single ? sq : mmap(NULL, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        void *sqe = mmap(NULL, sqeMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if(sq == MAP_FAILED || cq == MAP_FAILED || sqe == MAP_FAILED){
+            fprintf(stderr, "[CAPTURE]: cannot map the io_uring: %s\n", strerror(errno));
+            if(sq != MAP_FAILED) munmap(sq, sqMapSize);
+            if(cq != MAP_FAILED && !single) munmap(cq, cqMapSize);
+            if(sqe != MAP_FAILED) munmap(sqe, sqeMapSize);
+            close(fd);
+            return;
+        }
+        sqMap = sq;
+        cqMap = cq;
+        sqeMap = sqe;
+        sqTail = (unsigned int *)((char *)sq + p.sq_off.tail);
+        sqMask = *(unsigned int *)((char *)sq + p.sq_off.ring_mask);
+        sqArray = (unsigned int *)((char *)sq + p.sq_off.array);
+        cqHead = (unsigned int *)((char *)cq + p.cq_off.head);
+        cqTail = (unsigned int *)((char *)cq + p.cq_off.tail);
+        cqMask = *(unsigned int *)((char *)cq + p.cq_off.ring_mask);
+        cqes = (char *)cq + p.cq_off.cqes;
+        ring = fd;
+        reaper = std::thread(&UringIoBackend::Run, this);
+#else
+        fprintf(stderr, "[CAPTURE]: built without io_uring\n");
+#endif
+    }
+
+    UringIoBackend::~UringIoBackend()
+    {
+#if defined(HAVE_IO_URING) && defined(__NR_io_uring_setup)
+        if(ring < 0) return;
+        Drain();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Queue(IORING_OP_NOP, NULL, STOP);
+            Enter(1);
+        }
+        reaper.join();
+        munmap(sqeMap, sqeMapSize);
+        if(cqMap != sqMap) munmap(cqMap, cqMapSize);
+        munmap(sqMap, sqMapSize);
+        close(ring);
+#endif
+    }
+
+    void UringIoBackend::Start(IoRequest *_request)
+    {
+#if defined(HAVE_IO_URING) && defined(__NR_io_uring_setup)
+        //writes are submitted by the reaper: buffered writes the kernel hands
+        //to its workers are cancelled when the submitting thread exits
+        pending.push_back(_request);
+        if(pending.size() == 1){
+            Queue(IORING_OP_NOP, NULL, WAKE);
+            Enter(1);
+        }
+#endif
+    }
+
+    void UringIoBackend::Queue(uint8_t _opcode, IoRequest *_request, uint64_t _tag)
+    {
+#if defined(HAVE_IO_URING) && defined(__NR_io_uring_setup)
+        //mutex held: one thread at a time fills the submission ring, and with
+        //at most depth writes and depth + 1 wake ups in flight it cannot be full
+        unsigned int tail = *sqTail;
+        unsigned int index = tail & sqMask;
+        struct io_uring_sqe *sqe = (struct io_uring_sqe *)sqeMap + index;
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = _opcode;
+        sqe->fd = -1;
+        sqe->user_data = _tag;
+        if(_request != NULL){
+            //the rest of a short write
+            _request->iov.iov_base = (void *)(_request->data + _request->done);
+            _request->iov.iov_len = _request->size - _request->done;
+            sqe->fd = _request->fd;
+            sqe->addr = (uint64_t)(uintptr_t)&_request->iov;
+            sqe->len = 1;
+            sqe->off = _request->offset + _request->done;
+            sqe->user_data = (uint64_t)(uintptr_t)_request;
+        }
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+#endif
+    }
+
+    void UringIoBackend::Enter(unsigned int _count)
+    {
+#if defined(HAVE_IO_URING) && defined(__NR_io_uring_setup)
+        while(_count > 0){
+            long n = syscall(__NR_io_uring_enter, ring, _count, 0, 0, NULL, 0);
+            if(n > 0){
+                _count -= n;
+            }else if(n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY){
+                fprintf(stderr, "[CAPTURE]: io_uring submit failed: %s\n", strerror(errno));
+                return;
+            }
+        }
+#endif
+    }
+
+    void UringIoBackend::Run()
+    {
+#if defined(HAVE_IO_URING) && defined(__NR_io_uring_setup)
+        bool stopping = false;
+        std::vector<IoRequest *> submit;
+        while(!stopping){
+            if(syscall(__NR_io_uring_enter, ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+                fprintf(stderr, "[CAPTURE]: io_uring wait failed: %s\n", strerror(errno));
+            unsigned int head = *cqHead;
+            unsigned int tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for(; head != tail; head++){
+                struct io_uring_cqe *cqe = (struct io_uring_cqe *)cqes + (head & cqMask);
+                int result = cqe->res;
+                if(cqe->user_data == STOP){
+                    stopping = true;
+                    continue;
+                }
+                if(cqe->user_data == WAKE) continue;
+                IoRequest *r = (IoRequest *)(uintptr_t)cqe->user_data;
+                if(result == -EINTR || result == -EAGAIN || (result > 0 && r->done + result < r->size)){
+                    if(result > 0) r->done += result;
+                    submit.push_back(r);
+                }else if(result < 0){
+                    Finish(r, -result);
+                }else if(result == 0){
+                    Finish(r, r->size > 0 ? EIO : 0);
+                }else{
+                    r->done += result;
+                    Finish(r, 0);
+                }
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            submit.insert(submit.end(), pending.begin(), pending.end());
+            pending.clear();
+            for(size_t i = 0; i < submit.size(); i++) Queue(IORING_OP_WRITEV, submit[i], 0);
+            Enter(submit.size());
+            submit.clear();
+        }
+#endif
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef _CAMERA_COMMON_IO_BACKEND_HH_
+#define _CAMERA_COMMON_IO_BACKEND_HH_
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace camera_common
+{
+    enum IoBackendMode
+    {
+        IO_SYNC = 0,//blocking writes on the pipeline workers
+        IO_URING,//io_uring, many writes in flight from one thread
+        IO_THREADS,//pwrite on a pool of threads
+        IO_COUNT
+    };
+
+    bool ParseIoBackend(const std::string &_name, IoBackendMode &_mode);
+    const char *IoBackendName(IoBackendMode _mode);
+
+    // One write of an IoBackend. data must stay valid until the request is
+    // finished; a released request owns its data and is deleted by the
+    // backend when done.
+    struct IoRequest
+    {
+        int fd;
+        const unsigned char *data;
+        size_t size;
+        uint64_t offset;//in the file
+        bool closeFd;//close fd once written
+        bool release;//deleted by the backend, nobody waits for it
+        std::vector<unsigned char> owned;//data of a released request
+        std::function<void(int _error)> onFinish;//optional, called when done, before Drain returns
+
+        // set by the backend
+        size_t done;//bytes written so far
+        int error;//errno of a failed write, 0 if it succeeded
+        bool finished;
+        struct iovec iov;//io_uring
+
+        IoRequest();
+        void Reset(int _fd, const unsigned char *_data, size_t _size, uint64_t _offset);
+    };
+
+    // Writes that complete asynchronously. Submit blocks while depth writes
+    // are in flight. Failed released requests are logged and counted as
+    // COUNTER_WRITE_ERRORS, the others report their error to the waiter.
+    class IoBackend
+    {
+        // IO_SYNC gives NULL. IO_URING falls back to IO_THREADS when this
+        // build or the kernel has no io_uring.
+        public: static std::unique_ptr<IoBackend> Create(IoBackendMode _mode, unsigned int _depth);
+        public: virtual ~IoBackend() {}
+        public: virtual IoBackendMode Mode() const = 0;
+
+        public: void Submit(IoRequest *_request);
+        public: void Wait(IoRequest *_request);
+        public: void Drain();
+
+        protected: explicit IoBackend(unsigned int _depth);
+        // Start _request, called with mutex held.
+        protected: virtual void Start(IoRequest *_request) = 0;
+        protected: void Finish(IoRequest *_request, int _error);
+
+        protected: std::mutex mutex;
+        protected: std::condition_variable changed;
+        protected: unsigned int depth;
+        protected: unsigned int inFlight;
+    };
+
+    class ThreadIoBackend : public IoBackend
+    {
+        public: explicit ThreadIoBackend(unsigned int _depth);
+        public: virtual ~ThreadIoBackend();
+        public: virtual IoBackendMode Mode() const { return IO_THREADS; }
+
+        protected: virtual void Start(IoRequest *_request);
+        private: void Run();
+
+        private: std::deque<IoRequest *> queue;
+        private: std::condition_variable notEmpty;
+        private: bool stopping;
+        private: std::vector<std::thread> threads;
+    };
+
+    // Without liburing: the rings are set up with the raw system calls.
+    // One thread submits and reaps every write and restarts short writes;
+    // Submit only queues the request and wakes it with a no-op.
+    class UringIoBackend : public IoBackend
+    {
+        // Check Ready, setup fails on kernels without io_uring or where
+        // it is disabled (seccomp, kernel.io_uring_disabled).
+        public: explicit UringIoBackend(unsigned int _depth);
+        public: virtual ~UringIoBackend();
+        public: virtual IoBackendMode Mode() const { return IO_URING; }
+        public: bool Ready() const { return ring >= 0; }
+
+        protected: virtual void Start(IoRequest *_request);
+        private: void Queue(uint8_t _opcode, IoRequest *_request, uint64_t _tag);
+        private: void Enter(unsigned int _count);
+        private: void Run();
+
+        private: static const uint64_t STOP = 0;//user_data of the no-ops
+        private: static const uint64_t WAKE = 1;
+
+        private: int ring;
+        private: void *sqMap;
+        private: size_t sqMapSize;
+        private: void *cqMap;
+        private: size_t cqMapSize;
+        private: void *sqeMap;
+        private: size_t sqeMapSize;
+        private: unsigned int *sqTail;
+        private: unsigned int sqMask;
+        private: unsigned int *sqArray;
+        private: unsigned int *cqHead;
+        private: unsigned int *cqTail;
+        private: unsigned int cqMask;
+        private: void *cqes;
+        private: std::deque<IoRequest *> pending;//to be submitted by the reaper
+        private: std::thread reaper;
+    };
+}
+#endif
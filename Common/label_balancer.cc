@@ -0,0 +1,112 @@
+#include "label_balancer.hh"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <sstream>
+
+namespace camera_common
+{
+    // ratio mode: recompute the rates every so many offered frames
+    static const uint64_t RATIO_UPDATE = 64;
+
+    static bool ParseList(const std::string &_s, std::vector<double> &_values)
+    {
+        _values.clear();
+        std::stringstream ss(_s);
+        std::string part;
+        while(std::getline(ss, part, ',')){
+            char *end;
+            double v = strtod(part.c_str(), &end);
+            if(end == part.c_str() || v < 0) return false;
+            _values.push_back(v);
+        }
+        return !_values.empty();
+    }
+
+    LabelBalancer::LabelBalancer() : mode(MODE_OFF), totalOffered(0) {}
+
+    bool LabelBalancer::SetRates(const std::string &_rates)
+    {
+        if(!ParseList(_rates, targets)) return false;
+        for(size_t i = 0; i < targets.size(); i++) if(targets[i] > 1) targets[i] = 1;
+        mode = MODE_RATES;
+        rates = targets;
+        Grow(targets.size() - 1);
+        return true;
+    }
+
+    bool LabelBalancer::SetRatios(const std::string &_ratios)
+    {
+        if(!ParseList(_ratios, targets)) return false;
+        double sum = 0;
+        for(size_t i = 0; i < targets.size(); i++) sum += targets[i];
+        if(sum <= 0) return false;
+        for(size_t i = 0; i < targets.size(); i++) targets[i] /= sum;
+        mode = MODE_RATIOS;
+        rates.assign(targets.size(), 1.0);
+        Grow(targets.size() - 1);
+        return true;
+    }
+
+    void LabelBalancer::Grow(int _label)
+    {
+        if((size_t)_label < offered.size()) return;
+        rates.resize(_label + 1, 1.0);
+        credit.resize(_label + 1, 0.0);
+        offered.resize(_label + 1, 0);
+        kept.resize(_label + 1, 0);
+    }
+
+    void LabelBalancer::UpdateRatioRates()
+    {
+        //how many frames per unit of target share the rarest label allows
+        double scale = -1;
+        for(size_t i = 0; i < targets.size(); i++){
+            if(targets[i] <= 0 || offered[i] == 0) continue;
+            double s = offered[i] / targets[i];
+            if(scale < 0 || s < scale) scale = s;
+        }
+        for(size_t i = 0; i < targets.size(); i++){
+            if(targets[i] <= 0) rates[i] = 0;
+            else if(offered[i] == 0 || scale < 0) rates[i] = 1;
+            else rates[i] = std::min(1.0, scale * targets[i] / offered[i]);
+        }
+    }
+
+    bool LabelBalancer::Offer(int _label)
+    {
+        if(mode == MODE_OFF || _label < 0) return true;
+        Grow(_label);
+        offered[_label]++;
+        totalOffered++;
+        if(mode == MODE_RATIOS && totalOffered % RATIO_UPDATE == 0) UpdateRatioRates();
+        credit[_label] += rates[_label];
+        if(credit[_label] < 1) return false;
+        credit[_label] -= 1;
+        kept[_label]++;
+        return true;
+    }
+
+    double LabelBalancer::Rate(int _label) const
+    {
+        return _label >= 0 && (size_t)_label < rates.size() ? rates[_label] : 1.0;
+    }
+
+    uint64_t LabelBalancer::Offered(int _label) const
+    {
+        return _label >= 0 && (size_t)_label < offered.size() ? offered[_label] : 0;
+    }
+
+    uint64_t LabelBalancer::Kept(int _label) const
+    {
+        return _label >= 0 && (size_t)_label < kept.size() ? kept[_label] : 0;
+    }
+
+    std::string LabelBalancer::Describe() const
+    {
+        std::ostringstream out;
+        for(size_t i = 0; i < offered.size(); i++)
+            out << (i ? ", " : "") << i << ": " << kept[i] << "/" << offered[i] << " (rate " << Rate(i) << ")";
+        return out.str();
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef _CAMERA_COMMON_LABEL_BALANCER_HH_
+#define _CAMERA_COMMON_LABEL_BALANCER_HH_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace camera_common
+{
+    // Subsamples frames online per label, so the saved dataset is balanced
+    // without capturing everything and throwing frames away later.
+    //
+    // Rates: a fixed fraction of the frames of every label is kept, e.g.
+    // "1,0.25,0.5,1" keeps a quarter of the label 1 frames.
+    // Ratios: the target share of every label, e.g. "1,1,1,1" for equal
+    // counts. The rates are derived from the label frequencies seen so far:
+    // the label that is rarest relative to its target keeps every frame, the
+    // others are thinned to match it.
+    //
+    // Frames are kept deterministically (error diffusion), not randomly, so
+    // the kept frames are spread evenly over the trajectory.
+    class LabelBalancer
+    {
+        public: LabelBalancer();
+
+        // Comma separated values for label 0, 1, ...; false on a parse error.
+        public: bool SetRates(const std::string &_rates);
+        public: bool SetRatios(const std::string &_ratios);
+        public: bool Enabled() const { return mode != MODE_OFF; }
+
+        // Returns true if a frame with _label should be saved.
+        public: bool Offer(int _label);
+
+        public: double Rate(int _label) const;
+        public: uint64_t Offered(int _label) const;
+        public: uint64_t Kept(int _label) const;
+        public: std::string Describe() const;
+
+        private: enum Mode { MODE_OFF, MODE_RATES, MODE_RATIOS };
+        private: void Grow(int _label);
+        private: void UpdateRatioRates();
+
+        private: Mode mode;
+        private: std::vector<double> targets;//rates or ratios as configured
+        private: std::vector<double> rates;//current keep fraction per label
+        private: std::vector<double> credit;
+        private: std::vector<uint64_t> offered;
+        private: std::vector<uint64_t> kept;
+        private: uint64_t totalOffered;
+    };
+}
+#endif
@@ -0,0 +1,219 @@
+#include "npy_writer.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace camera_common
+{
+    std::string NpyFileName(const char *_array, unsigned int _episode)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "%s-%05u.npy", _array, _episode);
+        return name;
+    }
+
+    // Version 1.0 header of an array of _count items of _shape, padded to
+    // NPY_HEADER bytes. Empty if the description does not fit.
+    static std::string NpyHeader(const char *_descr, uint64_t _count, const std::vector<uint64_t> &_shape)
+    {
+        std::ostringstream dict;
+        dict << "{'descr': '" << _descr << "', 'fortran_order': False, 'shape': (" << _count;
+        if(_shape.empty()) dict << ",";
+        for(size_t i = 0; i < _shape.size(); i++) dict << ", " << _shape[i];
+        dict << "), }";
+        if(dict.str().size() + 11 > NPY_HEADER) return "";
+        std::string header("\x93NUMPY\x01\x00", 8);
+        uint16_t length = NPY_HEADER - 10;//little endian, as the data
+        header.append((const char *)&length, sizeof(length));
+        header += dict.str();
+        header.resize(NPY_HEADER - 1, ' ');
+        header += '\n';
+        return header;
+    }
+
+    static bool WriteHeader(int _fd, const char *_descr, uint64_t _count, const std::vector<uint64_t> &_shape)
+    {
+        std::string header = NpyHeader(_descr, _count, _shape);
+        return header.size() == NPY_HEADER && pwrite(_fd, header.data(), NPY_HEADER, 0) == (ssize_t)NPY_HEADER;
+    }
+
+    // The data of the .npy file _path, after its header.
+    static bool ReadNpyData(const std::string &_path, std::vector<char> &_data)
+    {
+        FILE *f = fopen(_path.c_str(), "rb");
+        if(f == NULL) return false;
+        char magic[10];
+        bool ok = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, "\x93NUMPY", 6) == 0;
+        if(ok){
+            uint16_t length;
+            memcpy(&length, magic + 8, sizeof(length));
+            ok = fseek(f, 0, SEEK_END) == 0;
+            long size = ftell(f);
+            long start = sizeof(magic) + length;
+            ok = ok && size >= start && fseek(f, start, SEEK_SET) == 0;
+            if(ok){
+                _data.resize(size - start);
+                ok = _data.empty() || fread(&_data[0], 1, _data.size(), f) == _data.size();
+            }
+        }
+        fclose(f);
+        return ok;
+    }
+
+    // Shape of one frame, numpy dtype and size in bytes.
+    static size_t FrameShape(const CaptureFrame &_frame, std::vector<uint64_t> &_shape, const char *&_descr)
+    {
+        const uint64_t w = _frame.width, h = _frame.height, c = _frame.channels;
+        size_t item = 1;
+        _descr = "|u1";
+        switch(_frame.format){
+            case PIXEL_GRAY: _shape = {h, w}; break;
+            case PIXEL_YUV420: _shape = {h * 3 / 2, w}; break;
+            case PIXEL_CHW_F32:
+                _shape = {c, h, w};
+                _descr = "<f4";
+                item = sizeof(float);
+                break;
+            default: _shape = {h, w, c}; break;
+        }
+        size_t bytes = item;
+        for(size_t i = 0; i < _shape.size(); i++) bytes *= _shape[i];
+        return bytes;
+    }
+
+    NpyFrameWriter::NpyFrameWriter()
+        : episode(0), framesFd(-1), labelsFd(-1), idsFd(-1), descr("|u1"), frameBytes(0), frames(0) {}
+
+    NpyFrameWriter::~NpyFrameWriter()
+    {
+        Close();
+    }
+
+    bool NpyFrameWriter::Open(const std::string &_directory)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CloseEpisode();
+        directory = _directory;
+        // continue after the episodes already in the directory
+        episode = 0;
+        struct stat st;
+        while(stat((directory + "/" + NpyFileName("frames", episode)).c_str(), &st) == 0) episode++;
+        return true;
+    }
+
+    bool NpyFrameWriter::Close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(CloseEpisode()) return true;
+        fprintf(stderr, "[CAPTURE]: could not complete the arrays of episode %u\n", episode);
+        return false;
+    }
+
+    void NpyFrameWriter::Flush()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!Sync()) fprintf(stderr, "[CAPTURE]: could not update the arrays of episode %u\n", episode);
+    }
+
+    void NpyFrameWriter::Scan(const std::string &_directory, CaptureManifest &_manifest)
+    {
+        struct stat st;
+        for(unsigned int e = 0; stat((_directory + "/" + NpyFileName("ids", e)).c_str(), &st) == 0; e++){
+            std::vector<char> idData, labelData;
+            if(!ReadNpyData(_directory + "/" + NpyFileName("ids", e), idData) ||
+                !ReadNpyData(_directory + "/" + NpyFileName("labels", e), labelData)) continue;
+            size_t n = std::min(idData.size() / sizeof(uint64_t), labelData.size() / sizeof(int32_t));
+            for(size_t i = 0; i < n; i++){
+                uint64_t id;
+                int32_t label;
+                memcpy(&id, &idData[i * sizeof(id)], sizeof(id));
+                memcpy(&label, &labelData[i * sizeof(label)], sizeof(label));
+                _manifest.AddFrame(id, label);
+            }
+        }
+    }
+
+    bool NpyFrameWriter::OpenEpisode(const CaptureFrame &_frame)
+    {
+        frameBytes = FrameShape(_frame, shape, descr);
+        if(frameBytes == 0) return false;
+        std::string names[3] = {NpyFileName("frames", episode), NpyFileName("labels", episode), NpyFileName("ids", episode)};
+        int *fds[3] = {&framesFd, &labelsFd, &idsFd};
+        for(int i = 0; i < 3; i++){
+            std::string path = directory + "/" + names[i];
+            *fds[i] = open(path.c_str(), CreateFlags(), 0644);
+            if(*fds[i] < 0){
+                fprintf(stderr, "[CAPTURE]: cannot open %s: %s\n", path.c_str(), strerror(errno));
+                CloseEpisode();
+                return false;
+            }
+        }
+        frames = 0;
+        labels.clear();
+        ids.clear();
+        //the data follows the headers
+        if(!Sync() || lseek(framesFd, NPY_HEADER, SEEK_SET) < 0 || lseek(labelsFd, NPY_HEADER, SEEK_SET) < 0 ||
+            lseek(idsFd, NPY_HEADER, SEEK_SET) < 0){
+            CloseEpisode();
+            return false;
+        }
+        return true;
+    }
+
+    bool NpyFrameWriter::Sync()
+    {
+        if(framesFd < 0) return true;
+        bool ok = labels.empty() || (WriteAll(labelsFd, &labels[0], labels.size() * sizeof(int32_t)) &&
+            WriteAll(idsFd, &ids[0], ids.size() * sizeof(uint64_t)));
+        labels.clear();
+        ids.clear();
+        std::vector<uint64_t> item;
+        return ok && WriteHeader(framesFd, descr, frames, shape) && WriteHeader(labelsFd, "<i4", frames, item) &&
+            WriteHeader(idsFd, "<u8", frames, item);
+    }
+
+    bool NpyFrameWriter::Write(const CaptureFrame &_frame)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<uint64_t> frameShape;
+        const char *frameDescr;
+        size_t bytes = FrameShape(_frame, frameShape, frameDescr);
+        if(bytes != _frame.pixels.size()) return false;
+        if(framesFd >= 0 && (frameShape != shape || strcmp(frameDescr, descr) != 0))
+            CloseEpisode();//a camera with another size, start new arrays
+        if(framesFd < 0 && !OpenEpisode(_frame)) return false;
+        if(!WriteAll(framesFd, &_frame.pixels[0], bytes)){
+            //drop what was written of the frame, so the next one is in place
+            off_t end = NPY_HEADER + frames * frameBytes;
+            if(ftruncate(framesFd, end) != 0 || lseek(framesFd, end, SEEK_SET) != end) CloseEpisode();
+            return false;
+        }
+        labels.push_back(_frame.label);
+        ids.push_back(_frame.id);
+        frames++;
+        if(labels.size() >= NPY_SYNC_FRAMES) return Sync();
+        return true;
+    }
+
+    bool NpyFrameWriter::CloseEpisode()
+    {
+        bool ok = Sync();
+        if(framesFd >= 0){
+            close(framesFd);
+            episode++;
+        }
+        if(labelsFd >= 0) close(labelsFd);
+        if(idsFd >= 0) close(idsFd);
+        framesFd = -1;
+        labelsFd = -1;
+        idsFd = -1;
+        return ok;
+    }
+}
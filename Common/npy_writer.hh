@@ -0,0 +1,64 @@
+#ifndef _CAMERA_COMMON_NPY_WRITER_HH_
+#define _CAMERA_COMMON_NPY_WRITER_HH_
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "frame_writer.hh"
+
+namespace camera_common
+{
+    // Array layout: every episode (every Open, and every change of frame
+    // size) is three NumPy .npy files that only grow at the end:
+    //   frames-NNNNN.npy  the pixels, shape (N, H, W, C) for rgb, (N, H, W)
+    //                     for gray, (N, H * 3 / 2, W) for yuv420 (the I420
+    //                     planes) and (N, C, H, W) float32 for chw_f32
+    //   labels-NNNNN.npy  int32 label of every frame, shape (N,)
+    //   ids-NNNNN.npy     uint64 frame id of every frame, shape (N,)
+    // so a trainer maps them without decoding:
+    //   np.load("frames-00000.npy", mmap_mode="r")
+    // The headers are NPY_HEADER bytes with room for any N and are
+    // rewritten in place, together with the labels and ids, every
+    // NPY_SYNC_FRAMES frames, on Flush and when the episode is closed. After
+    // a crash the three files agree on the frames up to the last update.
+    static const size_t NPY_HEADER = 128;
+    static const unsigned int NPY_SYNC_FRAMES = 256;
+
+    std::string NpyFileName(const char *_array, unsigned int _episode);
+
+    // Writes the unencoded pixels (CaptureFrame::encoded is not used) in the
+    // order Write is called; frames of several workers are appended one at
+    // a time. Frames keep the layout of CaptureFrame::format.
+    class NpyFrameWriter : public FrameWriter
+    {
+        public: NpyFrameWriter();
+        public: virtual ~NpyFrameWriter();
+        public: virtual bool Open(const std::string &_directory);
+        public: virtual bool Write(const CaptureFrame &_frame);
+        public: virtual bool Close();
+        // Appends the labels and ids written so far and updates the headers.
+        public: virtual void Flush();
+        // Reads the ids and labels of every episode in _directory.
+        public: virtual void Scan(const std::string &_directory, CaptureManifest &_manifest);
+
+        private: bool OpenEpisode(const CaptureFrame &_frame);
+        private: bool CloseEpisode();
+        private: bool Sync();
+
+        private: std::string directory;
+        private: std::mutex mutex;
+        private: unsigned int episode;
+        private: int framesFd;
+        private: int labelsFd;
+        private: int idsFd;
+        private: std::vector<uint64_t> shape;//of one frame
+        private: const char *descr;//numpy dtype of the pixels
+        private: size_t frameBytes;
+        private: uint64_t frames;//appended to the episode
+        private: std::vector<int32_t> labels;//not yet appended
+        private: std::vector<uint64_t> ids;
+    };
+}
+#endif
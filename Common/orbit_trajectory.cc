@@ -0,0 +1,124 @@
+#include "orbit_trajectory.hh"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace camera_common
+{
+    OrbitOptions::OrbitOptions()
+        : standoff(0.75), pitch(0.5), coverage(1), clearance(0.25), spacing(0.05),
+          frameRate(30), dt(0.001) {}
+
+    // Start pose of the camera next to the focus object, as placed by the world plugins
+    static Vec3 NominalStart(const Vec3 &_size)
+    {
+        return Vec3(-0.75 - _size.y / 2, 0, 0.05);
+    }
+
+    OrbitTrajectory::OrbitTrajectory(const OrbitOptions &_options)
+        : options(_options), size(1, 1, 1), started(false), phase(PHASE_APPROACH)
+    {
+        Plan(NominalStart(size));
+        travelled = 0;
+    }
+
+    void OrbitTrajectory::SetOptions(const OrbitOptions &_options)
+    {
+        options = _options;
+        Plan(started ? start : NominalStart(size));
+    }
+
+    void OrbitTrajectory::SetObjectSize(double _x, double _y, double _z)
+    {
+        size = Vec3(_x, _y, _z);
+        Plan(started ? start : NominalStart(size));
+    }
+
+    void OrbitTrajectory::Plan(const Vec3 &_start)
+    {
+        start = _start;
+        radius = sqrt(size.x * size.x + size.y * size.y) / 2 + options.standoff;
+        top = std::max(start.z, size.z + options.clearance);
+        revolutions = options.coverage;
+        if(options.pitch > 0) revolutions = std::max(revolutions, (top - start.z) / options.pitch);
+        double climb = revolutions > 0 ? (top - start.z) / revolutions : 0;//per revolution
+        approachLength = fabs(sqrt(start.x * start.x + start.y * start.y) - radius);
+        orbitLength = revolutions * sqrt(4 * M_PI * M_PI * radius * radius + climb * climb);
+        landLength = top - start.z;
+    }
+
+    double OrbitTrajectory::PathLength() const
+    {
+        return approachLength + orbitLength + landLength;
+    }
+
+    uint64_t OrbitTrajectory::Updates() const
+    {
+        double step = Speed() * options.dt;
+        return step > 0 ? (uint64_t)ceil(PathLength() / step) : 0;
+    }
+
+    uint64_t OrbitTrajectory::Frames() const
+    {
+        return (uint64_t)(Updates() * options.dt * options.frameRate);
+    }
+
+    void OrbitTrajectory::Reset()
+    {
+        started = false;
+        phase = PHASE_APPROACH;
+        travelled = 0;
+    }
+
+    Pose3 OrbitTrajectory::PathPose(double _s) const
+    {
+        double angle = atan2(start.y, start.x);
+        Vec3 p;
+        if(_s < approachLength){
+            double d = sqrt(start.x * start.x + start.y * start.y);
+            double r = d + (radius - d) * (_s / approachLength);
+            p = Vec3(r * cos(angle), r * sin(angle), start.z);
+        }else{
+            double f = orbitLength > 0 ? std::min(1.0, (_s - approachLength) / orbitLength) : 1;
+            angle += 2 * M_PI * revolutions * f;
+            p = Vec3(radius * cos(angle), radius * sin(angle), start.z + (top - start.z) * f);
+            if(_s > approachLength + orbitLength)
+                p.z = std::max(start.z, top - (_s - approachLength - orbitLength));
+        }
+        Pose3 pose;
+        pose.pos = p;
+        pose.rot = Quat::FromEuler(0, 0, atan2(-p.y, -p.x));//look at the object axis
+        return pose;
+    }
+
+    bool OrbitTrajectory::Step(const Pose3 &_pose, TrajectoryCommand &_cmd)
+    {
+        if(phase == PHASE_DONE) return false;
+        if(!started){
+            Plan(_pose.pos);
+            started = true;
+        }
+        const double total = PathLength();
+        travelled = std::min(total, travelled + Speed() * options.dt);
+        Phase next = PHASE_LAND;
+        if(travelled >= total || Speed() <= 0) next = PHASE_DONE;
+        else if(travelled < approachLength) next = PHASE_APPROACH;
+        else if(travelled < approachLength + orbitLength) next = PHASE_ORBIT;
+        _cmd.stateChanged = next != phase;
+        _cmd.finished = next == PHASE_DONE;
+        _cmd.label = next == PHASE_LAND || next == PHASE_DONE ? 3 : 1;
+        phase = next;
+
+        // velocities that reach the next point of the path in this update
+        Pose3 target = PathPose(travelled);
+        Quat inverse(_pose.rot.w, -_pose.rot.x, -_pose.rot.y, -_pose.rot.z);
+        _cmd.linear = inverse * ((target.pos - _pose.pos) * (1.0 / options.dt));
+        Quat error = target.rot * inverse;
+        if(error.w < 0) error = Quat(-error.w, -error.x, -error.y, -error.z);
+        double angle = 2 * acos(std::min(1.0, error.w));
+        double s = sqrt(1 - std::min(1.0, error.w * error.w));
+        _cmd.angular = s > 1e-9 ? Vec3(error.x, error.y, error.z) * (angle / s / options.dt) : Vec3();
+        return true;
+    }
+}
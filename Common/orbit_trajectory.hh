@@ -0,0 +1,85 @@
+#ifndef _CAMERA_COMMON_ORBIT_TRAJECTORY_HH_
+#define _CAMERA_COMMON_ORBIT_TRAJECTORY_HH_
+
+#include <stdint.h>
+
+#include "pose_math.hh"
+#include "trajectory.hh"
+
+namespace camera_common
+{
+    struct OrbitOptions
+    {
+        double standoff;//m between the bounding box and the path, horizontally
+        double pitch;//m climbed per revolution
+        double coverage;//revolutions at least, also around flat objects
+        double clearance;//m above the object where the last revolution ends
+        double spacing;//m of path between two saved frames
+        double frameRate;//frames Camera_gt saves per simulated second, the update_rate of the camera sensor
+        double dt;//simulated seconds per update
+        OrbitOptions();
+    };
+
+    // Helix around the focus object as an alternative to the stochastic
+    // trajectory: fly horizontally from the start pose to the helix
+    // (label 1), climb around the object at a fixed distance from its
+    // bounding box while looking at its axis (label 1, flying sideways), and
+    // land back at the start height (label 3). The camera moves at
+    // spacing * frameRate m/s, so the frames are equally far apart on the
+    // path whatever the size of the object, and the number of updates and
+    // frames is known before the episode starts. The object stands on the
+    // ground centered on the origin, as spawned by the world plugins.
+    //
+    // Step steers towards the next point of the path from the current pose,
+    // so physics drift (gravity, collisions) does not accumulate.
+    class OrbitTrajectory
+    {
+        public: enum Phase
+        {
+            PHASE_APPROACH = 0,
+            PHASE_ORBIT,
+            PHASE_LAND,
+            PHASE_DONE
+        };
+
+        public: OrbitTrajectory(const OrbitOptions &_options = OrbitOptions());
+
+        public: void SetOptions(const OrbitOptions &_options);
+        public: const OrbitOptions &Options() const { return options; }
+        public: void SetObjectSize(double _x, double _y, double _z);
+        // Start a new trajectory (finished_state 0); the first Step takes the
+        // current pose as start.
+        public: void Reset();
+        // One update from the current pose. Returns false when finished.
+        public: bool Step(const Pose3 &_pose, TrajectoryCommand &_cmd);
+
+        // The plan for the current object size, from the start pose the
+        // world plugins give the camera.
+        public: double Radius() const { return radius; }
+        public: double Revolutions() const { return revolutions; }
+        public: double PathLength() const;
+        public: uint64_t Updates() const;
+        public: uint64_t Frames() const;
+        public: double Speed() const { return options.spacing * options.frameRate; }
+        public: Phase CurrentPhase() const { return phase; }
+
+        // Point of the path _s m after the start, and the orientation
+        // looking at the object axis from there.
+        private: Pose3 PathPose(double _s) const;
+        private: void Plan(const Vec3 &_start);
+
+        private: OrbitOptions options;
+        private: Vec3 size;
+        private: Vec3 start;
+        private: double radius;
+        private: double top;//height of the last revolution
+        private: double revolutions;
+        private: double approachLength;
+        private: double orbitLength;
+        private: double landLength;
+        private: double travelled;//m along the path
+        private: bool started;
+        private: Phase phase;
+    };
+}
+#endif
@@ -0,0 +1,149 @@
+#include "pose_log.hh"
+
+#include <string.h>
+
+namespace camera_common
+{
+    static int64_t Quantize(double _value, double _step)
+    {
+        return (int64_t)llround(_value / _step);
+    }
+
+    static void Quantize(uint64_t _tick, const Pose3 &_pose, int64_t *_q)
+    {
+        _q[0] = (int64_t)_tick;
+        _q[1] = Quantize(_pose.pos.x, POSE_LOG_POSITION_STEP);
+        _q[2] = Quantize(_pose.pos.y, POSE_LOG_POSITION_STEP);
+        _q[3] = Quantize(_pose.pos.z, POSE_LOG_POSITION_STEP);
+        _q[4] = Quantize(_pose.rot.w, POSE_LOG_ROTATION_STEP);
+        _q[5] = Quantize(_pose.rot.x, POSE_LOG_ROTATION_STEP);
+        _q[6] = Quantize(_pose.rot.y, POSE_LOG_ROTATION_STEP);
+        _q[7] = Quantize(_pose.rot.z, POSE_LOG_ROTATION_STEP);
+    }
+
+    PoseLogWriter::PoseLogWriter() : file(NULL), episode(0), samples(0)
+    {
+        memset(last, 0, sizeof(last));
+    }
+
+    PoseLogWriter::~PoseLogWriter()
+    {
+        Close();
+    }
+
+    bool PoseLogWriter::Open(const std::string &_path)
+    {
+        Close();
+        file = fopen(_path.c_str(), "wb");
+        episode = 0;
+        return file != NULL;
+    }
+
+    void PoseLogWriter::Put(int64_t _value)
+    {
+        uint64_t v = ((uint64_t)_value << 1) ^ (uint64_t)(_value >> 63);//zigzag
+        while(v >= 0x80){
+            buffer.push_back((unsigned char)(v | 0x80));
+            v >>= 7;
+        }
+        buffer.push_back((unsigned char)v);
+    }
+
+    void PoseLogWriter::Add(uint64_t _tick, int32_t _label, const Pose3 &_pose)
+    {
+        if(file == NULL) return;
+        int64_t q[8];
+        Quantize(_tick, _pose, q);
+        buffer.push_back((unsigned char)_label);
+        for(int i = 0; i < 8; i++){
+            Put(q[i] - last[i]);
+            last[i] = q[i];
+        }
+        samples++;
+    }
+
+    bool PoseLogWriter::EndEpisode()
+    {
+        if(file == NULL) return false;
+        PoseLogEpisodeHeader header;
+        header.magic = POSE_LOG_MAGIC;
+        header.episode = episode++;
+        header.samples = samples;
+        header.bytes = buffer.size();
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        if(ok && !buffer.empty()) ok = fwrite(&buffer[0], buffer.size(), 1, file) == 1;
+        ok = fflush(file) == 0 && ok;
+        DiscardEpisode();
+        return ok;
+    }
+
+    void PoseLogWriter::DiscardEpisode()
+    {
+        buffer.clear();
+        samples = 0;
+        memset(last, 0, sizeof(last));
+    }
+
+    void PoseLogWriter::Close()
+    {
+        if(file == NULL) return;
+        if(samples > 0) EndEpisode();
+        fclose(file);
+        file = NULL;
+    }
+
+    static bool Get(const unsigned char *&_p, const unsigned char *_end, int64_t &_value)
+    {
+        uint64_t v = 0;
+        for(int shift = 0; shift < 64; shift += 7){
+            if(_p == _end) return false;
+            unsigned char b = *_p++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if(!(b & 0x80)){
+                _value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ReadPoseLog(const std::string &_path, std::vector<PoseLogEpisode> &_episodes)
+    {
+        _episodes.clear();
+        FILE *f = fopen(_path.c_str(), "rb");
+        if(f == NULL) return false;
+        bool ok = true;
+        PoseLogEpisodeHeader header;
+        std::vector<unsigned char> bytes;
+        while(fread(&header, sizeof(header), 1, f) == 1){
+            if(header.magic != POSE_LOG_MAGIC){ ok = false; break; }
+            bytes.resize(header.bytes);
+            if(header.bytes > 0 && fread(&bytes[0], header.bytes, 1, f) != 1){ ok = false; break; }
+            _episodes.push_back(PoseLogEpisode());
+            PoseLogEpisode &episode = _episodes.back();
+            episode.reserve(header.samples);
+            const unsigned char *p = bytes.empty() ? NULL : &bytes[0];
+            const unsigned char *end = p + bytes.size();
+            int64_t q[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+            for(uint32_t s = 0; s < header.samples && ok; s++){
+                if(p == end){ ok = false; break; }
+                PoseLogSample sample;
+                sample.label = *p++;
+                for(int i = 0; i < 8 && ok; i++){
+                    int64_t delta = 0;
+                    ok = Get(p, end, delta);
+                    q[i] += delta;
+                }
+                sample.tick = q[0];
+                sample.pose.pos = Vec3(q[1] * POSE_LOG_POSITION_STEP, q[2] * POSE_LOG_POSITION_STEP,
+                    q[3] * POSE_LOG_POSITION_STEP);
+                sample.pose.rot = Quat(q[4] * POSE_LOG_ROTATION_STEP, q[5] * POSE_LOG_ROTATION_STEP,
+                    q[6] * POSE_LOG_ROTATION_STEP, q[7] * POSE_LOG_ROTATION_STEP);
+                episode.push_back(sample);
+            }
+            if(!ok) break;
+        }
+        fclose(f);
+        return ok;
+    }
+}
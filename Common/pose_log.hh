@@ -0,0 +1,68 @@
+#ifndef _CAMERA_COMMON_POSE_LOG_HH_
+#define _CAMERA_COMMON_POSE_LOG_HH_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "pose_math.hh"
+
+namespace camera_common
+{
+    // Pose log layout: a sequence of episodes, each a PoseLogEpisodeHeader
+    // followed by 'bytes' of samples. A sample is the label (one byte) and
+    // the tick, position and rotation as zigzag varint deltas to the previous
+    // sample of the episode. Positions are quantized to POSE_LOG_POSITION_STEP
+    // meter and quaternion components to POSE_LOG_ROTATION_STEP, so a camera
+    // that stands still or moves smoothly costs a few bytes per update.
+    // Replaying a log gives exactly the same (quantized) poses every time.
+    static const uint32_t POSE_LOG_MAGIC = 0x314c5043;//"CPL1"
+    static const double POSE_LOG_POSITION_STEP = 1e-5;
+    static const double POSE_LOG_ROTATION_STEP = 1e-7;
+
+    struct PoseLogEpisodeHeader
+    {
+        uint32_t magic;
+        uint32_t episode;
+        uint32_t samples;
+        uint32_t bytes;
+    };
+
+    struct PoseLogSample
+    {
+        uint64_t tick;
+        int32_t label;
+        Pose3 pose;
+    };
+
+    typedef std::vector<PoseLogSample> PoseLogEpisode;
+
+    // Appends episodes to a pose log. An episode is kept in memory and written
+    // in one go by EndEpisode.
+    class PoseLogWriter
+    {
+        public: PoseLogWriter();
+        public: ~PoseLogWriter();
+
+        public: bool Open(const std::string &_path);
+        public: bool IsOpen() const { return file != NULL; }
+        public: void Add(uint64_t _tick, int32_t _label, const Pose3 &_pose);
+        public: bool EndEpisode();
+        // Forget the samples of the current episode, e.g. when it restarts.
+        public: void DiscardEpisode();
+        public: void Close();
+
+        private: void Put(int64_t _value);
+
+        private: FILE *file;
+        private: uint32_t episode;
+        private: uint32_t samples;
+        private: std::vector<unsigned char> buffer;
+        private: int64_t last[8];//tick, x y z, qw qx qy qz of the previous sample
+    };
+
+    // Reads a whole pose log, false if the file is missing or corrupt.
+    bool ReadPoseLog(const std::string &_path, std::vector<PoseLogEpisode> &_episodes);
+}
+#endif
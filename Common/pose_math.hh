@@ -0,0 +1,89 @@
+#ifndef _CAMERA_COMMON_POSE_MATH_HH_
+#define _CAMERA_COMMON_POSE_MATH_HH_
+
+#include <math.h>
+
+namespace camera_common
+{
+    // Minimal vector/quaternion math for code that must not depend on
+    // gazebo::math. Same conventions as gazebo::math (w first, roll pitch yaw).
+    struct Vec3
+    {
+        double x, y, z;
+        Vec3() : x(0), y(0), z(0) {}
+        Vec3(double _x, double _y, double _z) : x(_x), y(_y), z(_z) {}
+        Vec3 operator+(const Vec3 &_o) const { return Vec3(x + _o.x, y + _o.y, z + _o.z); }
+        Vec3 operator-(const Vec3 &_o) const { return Vec3(x - _o.x, y - _o.y, z - _o.z); }
+        Vec3 operator*(double _s) const { return Vec3(x * _s, y * _s, z * _s); }
+        double operator[](int _i) const { return _i == 0 ? x : (_i == 1 ? y : z); }
+        double Length() const { return sqrt(x * x + y * y + z * z); }
+    };
+
+    struct Quat
+    {
+        double w, x, y, z;
+        Quat() : w(1), x(0), y(0), z(0) {}
+        Quat(double _w, double _x, double _y, double _z) : w(_w), x(_x), y(_y), z(_z) {}
+
+        static Quat FromEuler(double _roll, double _pitch, double _yaw)
+        {
+            double cr = cos(_roll / 2), sr = sin(_roll / 2);
+            double cp = cos(_pitch / 2), sp = sin(_pitch / 2);
+            double cy = cos(_yaw / 2), sy = sin(_yaw / 2);
+            return Quat(cr * cp * cy + sr * sp * sy, sr * cp * cy - cr * sp * sy,
+                cr * sp * cy + sr * cp * sy, cr * cp * sy - sr * sp * cy);
+        }
+
+        Vec3 Euler() const
+        {
+            double roll = atan2(2 * (w * x + y * z), 1 - 2 * (x * x + y * y));
+            double s = 2 * (w * y - z * x);
+            double pitch = fabs(s) >= 1 ? copysign(M_PI / 2, s) : asin(s);
+            double yaw = atan2(2 * (w * z + x * y), 1 - 2 * (y * y + z * z));
+            return Vec3(roll, pitch, yaw);
+        }
+
+        Quat operator*(const Quat &_q) const
+        {
+            return Quat(w * _q.w - x * _q.x - y * _q.y - z * _q.z,
+                w * _q.x + x * _q.w + y * _q.z - z * _q.y,
+                w * _q.y - x * _q.z + y * _q.w + z * _q.x,
+                w * _q.z + x * _q.y - y * _q.x + z * _q.w);
+        }
+
+        // Rotate a vector from the body frame into the world frame.
+        Vec3 operator*(const Vec3 &_v) const
+        {
+            Quat p = (*this) * Quat(0, _v.x, _v.y, _v.z) * Quat(w, -x, -y, -z);
+            return Vec3(p.x, p.y, p.z);
+        }
+
+        void Normalize()
+        {
+            double n = sqrt(w * w + x * x + y * y + z * z);
+            if(n > 0){ w /= n; x /= n; y /= n; z /= n; }
+        }
+    };
+
+    struct Pose3
+    {
+        Vec3 pos;
+        Quat rot;
+    };
+
+    // Kinematic stand in for the physics engine: moves _pose with a linear
+    // and angular velocity, both in the world frame, for _dt seconds.
+    // There is no gravity, collision or damping.
+    inline void IntegratePose(Pose3 &_pose, const Vec3 &_linear, const Vec3 &_angular, double _dt)
+    {
+        _pose.pos = _pose.pos + _linear * _dt;
+        double angle = _angular.Length() * _dt;
+        if(angle > 0){
+            Vec3 axis = _angular * (1.0 / _angular.Length());
+            double s = sin(angle / 2);
+            _pose.rot = Quat(cos(angle / 2), axis.x * s, axis.y * s, axis.z * s) * _pose.rot;
+            _pose.rot.Normalize();
+        }
+    }
+}
+#endif
@@ -0,0 +1,136 @@
+#include "spline_trajectory.hh"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace camera_common
+{
+    void WaypointSpline::Fit(const std::vector<double> &_times, const std::vector<double> &_values)
+    {
+        times = _times;
+        values = _values;
+    }
+
+    double WaypointSpline::Evaluate(double _t, double *_derivative) const
+    {
+        if(_derivative != NULL) *_derivative = 0;
+        if(times.empty()) return 0;
+        if(_t <= times.front()) return values.front();
+        if(_t >= times.back()) return values.back();
+        size_t i = std::upper_bound(times.begin(), times.end(), _t) - times.begin() - 1;
+        double h = times[i + 1] - times[i];
+        double u = (_t - times[i]) / h, u2 = u * u;
+        double delta = values[i + 1] - values[i];
+        if(_derivative != NULL) *_derivative = delta * 30 * u2 * (u - 1) * (u - 1) / h;
+        return values[i] + delta * u2 * u * (10 - 15 * u + 6 * u2);
+    }
+
+    SplineOptions::SplineOptions()
+        : dt(0.001), noiseInterval(500), positionNoise(0.02), angleNoise(0.03) {}
+
+    SplineTrajectory::SplineTrajectory(unsigned int _seed, bool _mirror, const SplineOptions &_options)
+        : options(_options), machine(_seed, _mirror), random(_seed ^ 0x5bd1e995u), ticks(0), tick(0),
+          waypoints(0), planned(false) {}
+
+    void SplineTrajectory::Plan(const Pose3 &_start)
+    {
+        std::vector<double> times, coordinates[4];
+        Pose3 pose = _start, previous = _start;
+        uint64_t t = 0;
+        labelEnds.clear();
+        labels.clear();
+        // waypoint at the end of update _t, yaw unwrapped from the waypoint before
+        auto addWaypoint = [&](uint64_t _t, const Pose3 &_pose){
+            if(!times.empty() && _t <= times.back()) return;
+            double yaw = _pose.rot.Euler().z;
+            if(!times.empty()) yaw = coordinates[3].back() + remainder(yaw - coordinates[3].back(), 2 * M_PI);
+            times.push_back(_t);
+            coordinates[0].push_back(_pose.pos.x);
+            coordinates[1].push_back(_pose.pos.y);
+            coordinates[2].push_back(_pose.pos.z);
+            coordinates[3].push_back(yaw);
+        };
+        addWaypoint(0, _start);
+        machine.Reset();
+        TrajectoryCommand cmd;
+        while(machine.Step(cmd)){
+            if(cmd.stateChanged) addWaypoint(t, previous);
+            IntegratePose(pose, pose.rot * cmd.linear, cmd.angular, options.dt);
+            t++;
+            if(labels.empty() || labels.back() != cmd.label){
+                labels.push_back(cmd.label);
+                labelEnds.push_back(t);
+            }else labelEnds.back() = t;
+            previous = pose;
+        }
+        addWaypoint(t, pose);
+        for(int i = 0; i < 4; i++) path[i].Fit(times, coordinates[i]);
+        ticks = t;
+        waypoints = times.size();
+
+        // noise offsets, zero at the start and the end so the camera starts and lands on the path
+        const double interval = std::max(1.0, options.noiseInterval);
+        size_t knots = (size_t)ceil(ticks / interval) + 4;
+        size_t last = (size_t)floor(ticks / interval);//the segment of the last update uses knots last..last+3
+        std::uniform_real_distribution<double> offset(-1, 1);
+        for(int c = 0; c < 6; c++){
+            double amplitude = c < 3 ? options.positionNoise : options.angleNoise;
+            noise[c].assign(knots, 0);
+            for(size_t k = 3; k < last; k++) noise[c][k] = amplitude * offset(random);
+        }
+        tick = 0;
+        planned = true;
+    }
+
+    double SplineTrajectory::Noise(int _channel, double _tick, double *_derivative) const
+    {
+        const std::vector<double> &c = noise[_channel];
+        const double interval = std::max(1.0, options.noiseInterval);
+        double u = _tick / interval;
+        size_t k = (size_t)u;
+        if(c.size() < 4 || k + 3 >= c.size()){
+            *_derivative = 0;
+            return 0;
+        }
+        double f = u - k, f2 = f * f, f3 = f2 * f;
+        *_derivative = (-(1 - f) * (1 - f) * c[k] + (3 * f2 - 4 * f) * c[k + 1] +
+            (-3 * f2 + 2 * f + 1) * c[k + 2] + f2 * c[k + 3]) / 2 / interval;
+        return ((1 - f) * (1 - f) * (1 - f) * c[k] + (3 * f3 - 6 * f2 + 4) * c[k + 1] +
+            (-3 * f3 + 3 * f2 + 3 * f + 1) * c[k + 2] + f3 * c[k + 3]) / 6;
+    }
+
+    Pose3 SplineTrajectory::PoseAt(double _tick, Vec3 *_linear, Vec3 *_angular) const
+    {
+        double p[4], v[4], n[6], dn[6];
+        for(int i = 0; i < 4; i++) p[i] = path[i].Evaluate(_tick, &v[i]);
+        for(int c = 0; c < 6; c++) n[c] = Noise(c, _tick, &dn[c]);
+        Pose3 pose;
+        pose.pos = Vec3(p[0] + n[0], p[1] + n[1], p[2] + n[2]);
+        pose.rot = Quat::FromEuler(n[3], n[4], p[3] + n[5]);
+        // per update to per second; roll and pitch rates are small, taken as world rates
+        const double perSecond = 1 / options.dt;
+        Vec3 linear((v[0] + dn[0]) * perSecond, (v[1] + dn[1]) * perSecond, (v[2] + dn[2]) * perSecond);
+        if(_linear != NULL) *_linear = Quat(pose.rot.w, -pose.rot.x, -pose.rot.y, -pose.rot.z) * linear;
+        if(_angular != NULL) *_angular = Vec3(dn[3] * perSecond, dn[4] * perSecond, (v[3] + dn[5]) * perSecond);
+        return pose;
+    }
+
+    int SplineTrajectory::LabelAt(uint64_t _tick) const
+    {
+        size_t i = std::lower_bound(labelEnds.begin(), labelEnds.end(), _tick) - labelEnds.begin();
+        return i < labels.size() ? labels[i] : (labels.empty() ? 0 : labels.back());
+    }
+
+    bool SplineTrajectory::Step(const Pose3 &_current, Pose3 &_pose, TrajectoryCommand &_cmd)
+    {
+        if(!planned) Plan(_current);
+        if(tick >= ticks) return false;
+        tick++;
+        _pose = PoseAt(tick, &_cmd.linear, &_cmd.angular);
+        _cmd.label = LabelAt(tick);
+        _cmd.stateChanged = tick > 1 && _cmd.label != LabelAt(tick - 1);
+        _cmd.finished = tick == ticks;
+        return true;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef _CAMERA_COMMON_SPLINE_TRAJECTORY_HH_
+#define _CAMERA_COMMON_SPLINE_TRAJECTORY_HH_
+
+#include <stdint.h>
+
+#include <random>
+#include <vector>
+
+#include "pose_math.hh"
+#include "trajectory.hh"
+
+namespace camera_common
+{
+    // Path through waypoints made of quintic Bezier segments from rest to
+    // rest (control points P0 P0 P0 P1 P1 P1, the minimum jerk profile):
+    // straight between the waypoints, zero velocity and acceleration at
+    // every waypoint, so the acceleration is continuous and the jerk is
+    // bounded (at most 60 * distance / duration^3 per segment).
+    class WaypointSpline
+    {
+        // _times strictly increasing, as many values as times
+        public: void Fit(const std::vector<double> &_times, const std::vector<double> &_values);
+        // Value and first derivative at _t, clamped to the first and last waypoint.
+        public: double Evaluate(double _t, double *_derivative = NULL) const;
+        public: bool Empty() const { return times.empty(); }
+
+        private: std::vector<double> times;
+        private: std::vector<double> values;
+    };
+
+    struct SplineOptions
+    {
+        double dt;//simulated seconds per update
+        double noiseInterval;//updates between the knots of the noise
+        double positionNoise;//m, largest offset from the path
+        double angleNoise;//rad, largest roll, pitch and yaw offset
+        SplineOptions();
+    };
+
+    // Smooth version of the stochastic trajectory: the states of a
+    // TrajectoryStateMachine are run kinematically once per episode, the
+    // poses where the state changes become waypoints, and a WaypointSpline
+    // through them (timed as the states) gives the pose of every update. The
+    // noise is a uniform cubic B-spline through random offsets every
+    // noiseInterval updates instead of a new constant every 100 updates.
+    // Pose and label are closed form functions of the update, so any frame
+    // can be reproduced from its tick without running physics; the camera
+    // is placed kinematically, as a replayed pose log.
+    class SplineTrajectory
+    {
+        public: SplineTrajectory(unsigned int _seed, bool _mirror,
+            const SplineOptions &_options = SplineOptions());
+
+        public: void SetOptions(const SplineOptions &_options) { options = _options; }
+        public: void SetStateDuration(int _duration) { machine.SetStateDuration(_duration); }
+        public: void SetObjectSize(double _x, double _y, double _z) { machine.SetObjectSize(_x, _y, _z); }
+        // Start a new trajectory (finished_state 0); the first Step plans it
+        // from the current pose.
+        public: void Reset() { planned = false; }
+        // Plans the episode from _start and rewinds to its first update.
+        public: void Plan(const Pose3 &_start);
+        // The next update: pose to put the camera at, with its velocity
+        // (body frame linear, world frame angular) and label in _cmd.
+        // Returns false when finished.
+        public: bool Step(const Pose3 &_current, Pose3 &_pose, TrajectoryCommand &_cmd);
+
+        // Closed form pose, velocity and label at update _tick of the plan.
+        public: Pose3 PoseAt(double _tick, Vec3 *_linear = NULL, Vec3 *_angular = NULL) const;
+        public: int LabelAt(uint64_t _tick) const;
+        public: uint64_t Ticks() const { return ticks; }
+        public: size_t Waypoints() const { return waypoints; }
+
+        // Offset of noise channel _channel at _tick and its derivative per update.
+        private: double Noise(int _channel, double _tick, double *_derivative) const;
+
+        private: SplineOptions options;
+        private: TrajectoryStateMachine machine;
+        private: std::minstd_rand random;
+        private: WaypointSpline path[4];//x, y, z, yaw
+        private: std::vector<double> noise[6];//B-spline control points of x y z roll pitch yaw
+        private: std::vector<uint64_t> labelEnds;//last update of every run of equal labels
+        private: std::vector<int> labels;
+        private: uint64_t ticks;
+        private: uint64_t tick;
+        private: size_t waypoints;
+        private: bool planned;
+    };
+}
+#endif
@@ -0,0 +1,88 @@
+#include "state_channel.hh"
+
+#include <string.h>
+
+namespace camera_common
+{
+    StateSlot::StateSlot() : sequence(0)
+    {
+        for(int i = 0; i < WORDS; i++) words[i].store(0, std::memory_order_relaxed);
+    }
+
+    void StateSlot::Write(const CameraState &_state)
+    {
+        uint64_t tmp[WORDS] = {0};
+        memcpy(tmp, &_state, sizeof(CameraState));
+        uint32_t s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for(int i = 0; i < WORDS; i++) words[i].store(tmp[i], std::memory_order_relaxed);
+        sequence.store(s + 2, std::memory_order_release);
+    }
+
+    CameraState StateSlot::Read() const
+    {
+        uint64_t tmp[WORDS];
+        while(true){
+            uint32_t before = sequence.load(std::memory_order_acquire);
+            if(before & 1) continue;//writer busy
+            for(int i = 0; i < WORDS; i++) tmp[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(sequence.load(std::memory_order_relaxed) == before) break;
+        }
+        CameraState state;
+        memcpy(&state, tmp, sizeof(CameraState));
+        return state;
+    }
+
+    StateChannel &StateChannel::Instance()
+    {
+        static StateChannel instance;
+        return instance;
+    }
+
+    StateChannel::StateChannel() : locationVersion(0) {}
+
+    StateSlot *StateChannel::Slot(const std::string &_model)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<StateSlot> &slot = slots[_model];
+        if(!slot) slot.reset(new StateSlot());
+        return slot.get();
+    }
+
+    void StateChannel::SetLocation(const std::string &_location)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        location = _location;
+        locationVersion.fetch_add(1, std::memory_order_release);
+    }
+
+    uint64_t StateChannel::Location(std::string &_location)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        _location = location;
+        return locationVersion.load(std::memory_order_relaxed);
+    }
+
+    void StateChannel::SetLocation(const std::string &_model, const std::string &_location)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        modelLocations[_model] = _location;
+        locationVersion.fetch_add(1, std::memory_order_release);
+    }
+
+    uint64_t StateChannel::Location(const std::string &_model, std::string &_location)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<std::string, std::string>::const_iterator it = modelLocations.find(_model);
+        _location = it != modelLocations.end() ? it->second : location;
+        return locationVersion.load(std::memory_order_relaxed);
+    }
+
+    std::string ModelName(const std::string &_scopedName)
+    {
+        size_t end = _scopedName.find("::");
+        return end == std::string::npos ? _scopedName : _scopedName.substr(0, end);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef _CAMERA_COMMON_STATE_CHANNEL_HH_
+#define _CAMERA_COMMON_STATE_CHANNEL_HH_
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace camera_common
+{
+    // What a controller publishes every update: the label (trajectory_state),
+    // whether the trajectory is finished (finished_state) and the world pose.
+    struct CameraState
+    {
+        uint64_t tick;//number of updates published so far, 0 = never written
+        int32_t label;
+        int32_t finished;
+        double x, y, z;
+        double qw, qx, qy, qz;
+    };
+
+    // Seqlock protected CameraState. One writer (the controller on the physics
+    // thread), any number of readers (Camera_gt on the render thread) that
+    // retry while a write is in progress. Neither side blocks or allocates.
+    class StateSlot
+    {
+        public: StateSlot();
+        public: void Write(const CameraState &_state);
+        public: CameraState Read() const;
+
+        private: static const int WORDS = (sizeof(CameraState) + 7) / 8;
+        private: std::atomic<uint32_t> sequence;//odd while writing
+        private: std::atomic<uint64_t> words[WORDS];
+    };
+
+    // Process wide registry of StateSlots keyed by model name, plus the
+    // saving location of the world plugin. Replaces the trajectory_state,
+    // finished_state and saving_location topics between plugins in the same
+    // gzserver: no protobuf serialization and no hop through the transport
+    // thread. Slots are never removed, so the returned pointers stay valid;
+    // look them up once in Load and keep them.
+    class StateChannel
+    {
+        public: static StateChannel &Instance();
+
+        public: StateSlot *Slot(const std::string &_model);
+
+        // The location changes once per episode, a mutex is fine.
+        public: void SetLocation(const std::string &_location);
+        // Location of one model only, e.g. one of several cameras of a world.
+        public: void SetLocation(const std::string &_model, const std::string &_location);
+        // Returns the version of the location, 0 if it was never set, so a
+        // reader can poll cheaply with LocationVersion.
+        public: uint64_t Location(std::string &_location);
+        // The location of _model if it has its own, otherwise the common one.
+        public: uint64_t Location(const std::string &_model, std::string &_location);
+        public: uint64_t LocationVersion() const
+        {
+            return locationVersion.load(std::memory_order_acquire);
+        }
+
+        private: StateChannel();
+
+        private: std::mutex mutex;
+        private: std::map<std::string, std::unique_ptr<StateSlot> > slots;
+        private: std::string location;
+        private: std::map<std::string, std::string> modelLocations;
+        private: std::atomic<uint64_t> locationVersion;
+    };
+
+    // Model name of a scoped sensor or link name ("camera::link" -> "camera").
+    std::string ModelName(const std::string &_scopedName);
+}
+#endif
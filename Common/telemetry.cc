@@ -0,0 +1,26 @@
+#include "telemetry.hh"
+
+namespace camera_common
+{
+    TelemetryBatcher::TelemetryBatcher(unsigned int _batch, unsigned int _stride)
+        : batch(_batch), stride(_stride == 0 ? 1 : _stride), episode(0), lastLabel(-1)
+    {
+        samples.reserve(batch);
+    }
+
+    bool TelemetryBatcher::Add(const TelemetrySample &_sample)
+    {
+        if(batch == 0) return false;
+        bool changed = _sample.label != lastLabel;
+        lastLabel = _sample.label;
+        if(!changed && _sample.tick % stride != 0) return false;
+        samples.push_back(_sample);
+        return samples.size() >= batch;
+    }
+
+    void TelemetryBatcher::NextEpisode()
+    {
+        episode++;
+        lastLabel = -1;
+    }
+}
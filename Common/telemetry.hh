@@ -0,0 +1,45 @@
+#ifndef _CAMERA_COMMON_TELEMETRY_HH_
+#define _CAMERA_COMMON_TELEMETRY_HH_
+
+#include <stdint.h>
+#include <vector>
+
+namespace camera_common
+{
+    // Label, pose and commanded velocity of the camera at one update.
+    struct TelemetrySample
+    {
+        uint64_t tick;
+        int32_t label;
+        double pose[7];//x y z qw qx qy qz, world frame
+        double velocity[6];//linear xyz, angular xyz, world frame
+    };
+
+    // Collects every _stride-th update (and every update where the label
+    // changes, so no transition is lost) until _batch samples are ready to
+    // be published as one telemetry message.
+    class TelemetryBatcher
+    {
+        public: TelemetryBatcher(unsigned int _batch, unsigned int _stride);
+
+        public: bool Enabled() const { return batch > 0; }
+        // Returns true when the batch is full and should be published.
+        public: bool Add(const TelemetrySample &_sample);
+        public: const std::vector<TelemetrySample> &Samples() const { return samples; }
+        public: bool Empty() const { return samples.empty(); }
+        public: void Clear() { samples.clear(); }
+
+        // Episodes are counted by the controller: it calls NextEpisode after
+        // publishing the batch that ends an episode (finished set), so the
+        // samples of an episode that is restarted early keep its number.
+        public: uint32_t Episode() const { return episode; }
+        public: void NextEpisode();
+
+        private: unsigned int batch;
+        private: unsigned int stride;
+        private: uint32_t episode;
+        private: int32_t lastLabel;
+        private: std::vector<TelemetrySample> samples;
+    };
+}
+#endif
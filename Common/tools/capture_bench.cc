@@ -0,0 +1,303 @@
+// Microbenchmark of the capture path without Gazebo: synthetic frames go
+// through CapturePipeline for every codec, output mode and thread count.
+//
+// usage: capture_bench [--frames N] [--width W] [--height H]
+//                      [--threads 1,2,4] [--codecs jpg,png,raw]
+//                      [--outputs files,shards] [--dir /tmp/capture_bench]
+//                      [--durability none|shard|interval] [--direct 0|1]
+//                      [--drop-cache 0|1] [--buffer-mb 4]
+//                      [--io sync,uring,threads] [--io-depth 16]
+//                      [--format rgb|gray|yuv420|chw_f32]
+//        capture_bench --convert 1 [--frames N] [--width W] [--height H]
+//        capture_bench --roundtrip 1 [--codecs png,raw,delta] [--frames N]
+//
+// --convert checks every pixel format conversion kernel against the scalar
+// code (odd sizes included) and times it per frame, then exits; it fails
+// if any kernel gives other bytes.
+//
+// --roundtrip encodes N frames with every lossless codec of --codecs (jpg
+// is skipped), at the benchmark size and an odd size, decodes them again in
+// order and fails unless every frame comes back byte for byte. Delta runs
+// with a keyframe every 4 frames, so keyframes and inter frames are both
+// checked.
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "capture_pipeline.hh"
+#include "frame_decoder.hh"
+
+using namespace camera_common;
+
+static const char *const USAGE =
+    "usage: capture_bench [--frames N] [--width W] [--height H] [--threads 1,2,4] [--codecs jpg,png,raw]\n"
+    "                     [--outputs files,shards] [--dir /tmp/capture_bench] [--durability none|shard|interval]\n"
+    "                     [--direct 0|1] [--drop-cache 0|1] [--buffer-mb 4] [--io sync,uring,threads]\n"
+    "                     [--io-depth 16] [--format rgb|gray|yuv420|chw_f32]\n"
+    "       capture_bench --convert 1 [--frames N] [--width W] [--height H]\n"
+    "       capture_bench --roundtrip 1 [--codecs png,raw,delta] [--frames N]\n";
+
+static std::vector<std::string> Split(const std::string &_s)
+{
+    std::vector<std::string> parts;
+    std::stringstream ss(_s);
+    std::string part;
+    while(std::getline(ss, part, ',')) if(part != "") parts.push_back(part);
+    return parts;
+}
+
+// User and system time of the whole process.
+static double CpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Every SIMD level of every format against the scalar code on an odd size
+// and the benchmark size, then the time per frame at each level.
+static int CheckConversions(const std::vector<unsigned char> &_image, unsigned int _w, unsigned int _h,
+    unsigned int _frames)
+{
+    printf("cpu: %s\n", SimdLevelName(DetectSimd()));
+    printf("%-8s %-7s %-6s %10s %10s\n", "format", "simd", "check", "ms/frame", "speedup");
+    int failures = 0;
+    const unsigned int sizes[2][2] = {{37, 11}, {_w, _h}};
+    for(int f = PIXEL_GRAY; f < PIXEL_COUNT; f++){
+        PixelFormat format = (PixelFormat)f;
+        double scalarMs = 0;
+        for(int l = SIMD_SCALAR; l <= DetectSimd(); l++){
+            SimdLevel level = (SimdLevel)l;
+            bool same = true;
+            for(int s = 0; s < 2; s++){
+                std::vector<unsigned char> expected, actual;
+                unsigned int w = sizes[s][0], h = sizes[s][1], c = 3;
+                unsigned int w2 = w, h2 = h, c2 = c;
+                ConvertPixels(format, &_image[0], w, h, c, expected, SIMD_SCALAR);
+                ConvertPixels(format, &_image[0], w2, h2, c2, actual, level);
+                same = same && expected == actual && w == w2 && h == h2 && c == c2;
+            }
+            std::vector<unsigned char> out;
+            uint64_t start = NowNs();
+            for(unsigned int i = 0; i < _frames; i++){
+                unsigned int w = _w, h = _h, c = 3;
+                ConvertPixels(format, &_image[0], w, h, c, out, level);
+            }
+            double ms = (NowNs() - start) / 1e6 / (_frames ? _frames : 1);
+            if(level == SIMD_SCALAR) scalarMs = ms;
+            printf("%-8s %-7s %-6s %10.3f %9.1fx\n", PixelFormatName(format), SimdLevelName(level),
+                same ? "ok" : "FAIL", ms, ms > 0 ? scalarMs / ms : 0.0);
+            if(!same) failures++;
+        }
+    }
+    return failures ? 1 : 0;
+}
+
+static void RemoveFiles(const std::string &_dir)
+{
+    DIR *d = opendir(_dir.c_str());
+    if(d == NULL) return;
+    struct dirent *e;
+    while((e = readdir(d)) != NULL){
+        if(e->d_name[0] == '.') continue;
+        unlink((_dir + "/" + e->d_name).c_str());
+    }
+    closedir(d);
+}
+
+// Smooth gradients with a moving pattern and some noise, so the codecs see
+// something closer to a rendered image than random bytes.
+static std::vector<unsigned char> SyntheticFrame(unsigned int _w, unsigned int _h, unsigned int _t)
+{
+    std::vector<unsigned char> img((size_t)_w * _h * 3);
+    unsigned int seed = 1234 + _t;
+    for(unsigned int y = 0; y < _h; y++){
+        for(unsigned int x = 0; x < _w; x++){
+            unsigned char *p = &img[((size_t)y * _w + x) * 3];
+            int noise = (rand_r(&seed) & 15) - 8;
+            int checker = (((x + 4 * _t) / 40 + y / 40) & 1) * 60;
+            p[0] = (unsigned char)std::min(255, std::max(0, (int)(x * 255 / _w) + noise));
+            p[1] = (unsigned char)std::min(255, std::max(0, (int)(y * 255 / _h) + checker + noise));
+            p[2] = (unsigned char)std::min(255, std::max(0, 128 + checker - noise));
+        }
+    }
+    return img;
+}
+
+// Encode and decode _frames frames of every lossless codec, see --roundtrip.
+static int CheckRoundTrip(const std::vector<std::string> &_codecs, unsigned int _w, unsigned int _h,
+    unsigned int _frames)
+{
+    printf("%-6s %9s %7s %-6s %10s\n", "codec", "size", "frames", "check", "ratio");
+    int failures = 0;
+    const unsigned int sizes[2][2] = {{37, 11}, {_w, _h}};
+    for(size_t c = 0; c < _codecs.size(); c++){
+        Codec codec;
+        if(!ParseCodec(_codecs[c], codec)){
+            fprintf(stderr, "unknown codec %s\n", _codecs[c].c_str());
+            return 1;
+        }
+        if(codec == CODEC_JPEG) continue;//lossy
+        for(int s = 0; s < 2; s++){
+            DeltaOptions delta;
+            delta.keyint = 4;
+            FrameEncoder encoder(codec, 90, 6, delta);
+            FrameDecoder decoder;
+            bool same = true;
+            size_t raw = 0, encoded = 0;
+            for(unsigned int i = 0; i < _frames && same; i++){
+                CaptureFrame frame;
+                frame.id = i;
+                frame.label = 0;
+                frame.width = sizes[s][0];
+                frame.height = sizes[s][1];
+                frame.channels = 3;
+                frame.format = PIXEL_RGB;
+                frame.pixels = SyntheticFrame(frame.width, frame.height, i);
+                std::vector<unsigned char> pixels;
+                unsigned int w = 0, h = 0, ch = 0;
+                same = encoder.Encode(frame) &&
+                    decoder.Decode(codec, &frame.encoded[0], frame.encoded.size(), pixels, w, h, ch) &&
+                    pixels == frame.pixels && w == frame.width && h == frame.height && ch == frame.channels;
+                raw += frame.pixels.size();
+                encoded += frame.encoded.size();
+            }
+            char size[32];
+            snprintf(size, sizeof(size), "%ux%u", sizes[s][0], sizes[s][1]);
+            printf("%-6s %9s %7u %-6s %10.2f\n", CodecName(codec), size, _frames, same ? "ok" : "FAIL",
+                encoded ? (double)raw / encoded : 0.0);
+            if(!same) failures++;
+        }
+    }
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int frames = 300, width = 640, height = 480;
+    std::string threadList = "1,2,4", codecList = "jpg,png,raw", outputList = "files,shards";
+    std::string dir = "/tmp/capture_bench";
+    std::string ioList = "sync";
+    unsigned int ioDepth = 16;
+    PixelFormat format = PIXEL_RGB;
+    bool convert = false, roundtrip = false;
+    bool codecsGiven = false;
+    ShardOptions shard;
+    for(int i = 1; i < argc; i += 2){
+        std::string key = argv[i];
+        if(key == "--help"){
+            printf("%s", USAGE);
+            return 0;
+        }
+        if(i + 1 == argc){
+            fprintf(stderr, "%s needs a value\n%s", key.c_str(), USAGE);
+            return 1;
+        }
+        std::string value = argv[i + 1];
+        if(key == "--frames") frames = atoi(value.c_str());
+        else if(key == "--width") width = atoi(value.c_str());
+        else if(key == "--height") height = atoi(value.c_str());
+        else if(key == "--threads") threadList = value;
+        else if(key == "--codecs"){
+            codecList = value;
+            codecsGiven = true;
+        }
+        else if(key == "--outputs") outputList = value;
+        else if(key == "--dir") dir = value;
+        else if(key == "--durability"){
+            if(!ParseDurability(value, shard.durability)){
+                fprintf(stderr, "unknown durability %s\n", value.c_str());
+                return 1;
+            }
+        }
+        else if(key == "--direct") shard.direct = atoi(value.c_str()) != 0;
+        else if(key == "--drop-cache") shard.dropCache = atoi(value.c_str()) != 0;
+        else if(key == "--buffer-mb") shard.bufferBytes = atoi(value.c_str()) << 20;
+        else if(key == "--io") ioList = value;
+        else if(key == "--io-depth") ioDepth = atoi(value.c_str());
+        else if(key == "--format"){
+            if(!ParsePixelFormat(value, format)){
+                fprintf(stderr, "unknown pixel format %s\n", value.c_str());
+                return 1;
+            }
+        }
+        else if(key == "--convert") convert = atoi(value.c_str()) != 0;
+        else if(key == "--roundtrip") roundtrip = atoi(value.c_str()) != 0;
+        else{
+            fprintf(stderr, "unknown option %s\n%s", key.c_str(), USAGE);
+            return 1;
+        }
+    }
+    if(roundtrip) return CheckRoundTrip(Split(codecsGiven ? codecList : "png,raw,delta"), width, height, frames);
+    mkdir(dir.c_str(), 0755);
+
+    const unsigned int distinct = 30;
+    std::vector<std::vector<unsigned char> > images;
+    for(unsigned int t = 0; t < distinct; t++) images.push_back(SyntheticFrame(width, height, t));
+    if(convert) return CheckConversions(images[0], width, height, frames);
+
+    printf("%-6s %-7s %-7s %7s %7s %10s %10s %10s %10s %8s\n",
+        "codec", "output", "io", "threads", "frames", "frames/s", "MB/s", "p50_ms", "p99_ms", "cpu_s");
+    std::vector<std::string> codecs = Split(codecList), outputs = Split(outputList), threads = Split(threadList);
+    std::vector<std::string> ios = Split(ioList);
+    for(size_t c = 0; c < codecs.size(); c++){
+        for(size_t o = 0; o < outputs.size(); o++){
+            for(size_t b = 0; b < ios.size(); b++){
+            for(size_t t = 0; t < threads.size(); t++){
+                CaptureConfig config;
+                if(!ParseCodec(codecs[c], config.codec) || !ParseOutputMode(outputs[o], config.output) ||
+                    !ParseIoBackend(ios[b], config.io)){
+                    fprintf(stderr, "unknown codec %s, output %s or io %s\n",
+                        codecs[c].c_str(), outputs[o].c_str(), ios[b].c_str());
+                    return 1;
+                }
+                config.threads = atoi(threads[t].c_str());
+                config.shard = shard;
+                config.ioDepth = ioDepth;
+                config.format = format;
+                RemoveFiles(dir);
+                uint64_t start, end;
+                double cpu;
+                std::vector<uint64_t> latencies;
+                uint64_t bytes, written;
+                {
+                    CapturePipeline pipeline(config);
+                    pipeline.SetOutputDirectory(dir);
+                    start = NowNs();
+                    cpu = CpuSeconds();
+                    for(unsigned int i = 0; i < frames; i++){
+                        char name[64];
+                        snprintf(name, sizeof(name), "%05u-gt%01u.%s", i, i % 4, pipeline.Extension(3));
+                        pipeline.Submit(i, i % 4, name, &images[i % distinct][0], width, height, 3);
+                    }
+                    pipeline.Flush();
+                    end = NowNs();
+                    cpu = CpuSeconds() - cpu;
+                    latencies = pipeline.Latencies();
+                    bytes = pipeline.BytesWritten();
+                    written = pipeline.FramesWritten();
+                }
+                double seconds = (end - start) / 1e9;
+                LatencySummary l = Summarize(latencies);
+                printf("%-6s %-7s %-7s %7u %7llu %10.1f %10.1f %10.2f %10.2f %8.2f\n",
+                    codecs[c].c_str(), outputs[o].c_str(), ios[b].c_str(), config.threads,
+                    (unsigned long long)written, written / seconds, bytes / 1e6 / seconds,
+                    l.p50 / 1e6, l.p99 / 1e6, cpu);
+                fflush(stdout);
+            }
+            }
+        }
+    }
+    RemoveFiles(dir);
+    return 0;
+}
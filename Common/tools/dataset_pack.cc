@@ -0,0 +1,339 @@
+// Packs Camera_gt output written as files, <in>/<location>/<focus>/RGB/
+// <id>-gt<label>.jpg, into shards: every RGB directory becomes
+// <out>/<location>/<focus>/ with shard-NNNNN.rec, shard-NNNNN.idx and a
+// manifest.json with the frames per label, as Camera_gt writes them with
+// output=shards. Reader threads read whole files (one sequential read
+// each) and verify them while one writer appends them in id order, at
+// most --window frames behind the readers. Frames that fail verification
+// are reported and left out. A directory whose output already has a
+// manifest.json was packed by an earlier run and is skipped, so an
+// interrupted run continues where it stopped. The manifest is only
+// written when every read frame of the directory reached the shard index
+// and the shards were closed cleanly; otherwise the directory is counted
+// as not packed (exit code 2) and packed again by the next run.
+//
+// usage: dataset_pack --in ROOT --out DIR [--threads 4] [--subdir RGB]
+//                     [--verify header|decode] [--window 256]
+//                     [--shard-mb 256] [--buffer-mb 4]
+//                     [--io sync|uring|threads] [--io-depth 16] [--force 0|1]
+// --verify header checks the JPEG markers and reads the size from the
+// frame header, decode also decodes every frame with libjpeg.
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_manifest.hh"
+#include "capture_stats.hh"
+#include "file_util.hh"
+#include "frame_decoder.hh"
+#include "frame_writer.hh"
+
+using namespace camera_common;
+
+static const char *const USAGE =
+    "usage: dataset_pack --in ROOT --out DIR [--threads 4] [--subdir RGB] "
+    "[--verify header|decode] [--window 256] [--shard-mb 256] [--buffer-mb 4] "
+    "[--io sync|uring|threads] [--io-depth 16] [--force 0|1]\n";
+
+struct Source
+{
+    unsigned int dir;//index in the directory list
+    uint64_t id;
+    int label;
+    std::string name;
+};
+
+// A frame read and verified by a reader, waiting for the writer.
+struct Slot
+{
+    bool ready;
+    bool ok;
+    CaptureFrame frame;
+};
+
+static bool IsDirectory(const std::string &_path)
+{
+    struct stat st;
+    return stat(_path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Every directory under _root that holds a _subdir, relative to _root.
+static void FindDirectories(const std::string &_root, const std::string &_relative,
+    const std::string &_subdir, std::vector<std::string> &_dirs)
+{
+    std::string path = _relative == "" ? _root : _root + "/" + _relative;
+    DIR *d = opendir(path.c_str());
+    if(d == NULL) return;
+    std::vector<std::string> children;
+    struct dirent *e;
+    while((e = readdir(d)) != NULL){
+        if(e->d_name[0] == '.') continue;
+        if(e->d_type == DT_DIR || (e->d_type == DT_UNKNOWN && IsDirectory(path + "/" + e->d_name)))
+            children.push_back(e->d_name);
+    }
+    closedir(d);
+    std::sort(children.begin(), children.end());
+    for(size_t i = 0; i < children.size(); i++){
+        if(children[i] == _subdir) _dirs.push_back(_relative);
+        else FindDirectories(_root, _relative == "" ? children[i] : _relative + "/" + children[i], _subdir, _dirs);
+    }
+}
+
+// The <id>-gt<label>.jpg files of _path, in id order.
+static void ListFrames(const std::string &_path, unsigned int _dir, std::vector<Source> &_sources)
+{
+    DIR *d = opendir(_path.c_str());
+    if(d == NULL) return;
+    std::vector<Source> frames;
+    struct dirent *e;
+    while((e = readdir(d)) != NULL){
+        const char *name = e->d_name;
+        char *end;
+        unsigned long long id = strtoull(name, &end, 10);
+        if(end == name || strncmp(end, "-gt", 3) != 0) continue;
+        const char *dot = strrchr(name, '.');
+        if(dot == NULL || (strcmp(dot, ".jpg") != 0 && strcmp(dot, ".jpeg") != 0)) continue;
+        Source s;
+        s.dir = _dir;
+        s.id = id;
+        s.label = end[3] >= '0' && end[3] <= '9' ? atoi(end + 3) : -1;
+        s.name = name;
+        frames.push_back(s);
+    }
+    closedir(d);
+    std::sort(frames.begin(), frames.end(), [](const Source &_a, const Source &_b){ return _a.id < _b.id; });
+    _sources.insert(_sources.end(), frames.begin(), frames.end());
+}
+
+static bool MakeDirectories(const std::string &_path)
+{
+    for(size_t i = 1; i <= _path.size(); i++){
+        if(i < _path.size() && _path[i] != '/') continue;
+        std::string part = _path.substr(0, i);
+        if(mkdir(part.c_str(), 0755) != 0 && errno != EEXIST){
+            fprintf(stderr, "cannot create %s: %s\n", part.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+// Shards left by an interrupted run, which did not get to the manifest.
+static void RemoveShards(const std::string &_dir)
+{
+    struct stat st;
+    for(unsigned int i = 0; stat((_dir + "/" + ShardFileName(i, "rec")).c_str(), &st) == 0; i++){
+        unlink((_dir + "/" + ShardFileName(i, "rec")).c_str());
+        unlink((_dir + "/" + ShardFileName(i, "idx")).c_str());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string in, out, subdir = "RGB", verify = "header";
+    unsigned int threads = 4, window = 256, ioDepth = 16;
+    bool force = false;
+    IoBackendMode ioMode = IO_SYNC;
+    ShardOptions shard;
+    for(int i = 1; i < argc; i += 2){
+        std::string key = argv[i];
+        if(key == "--help"){
+            printf("%s", USAGE);
+            return 0;
+        }
+        if(i + 1 == argc){
+            fprintf(stderr, "%s needs a value\n%s", key.c_str(), USAGE);
+            return 1;
+        }
+        std::string value = argv[i + 1];
+        if(key == "--in") in = value;
+        else if(key == "--out") out = value;
+        else if(key == "--threads") threads = atoi(value.c_str());
+        else if(key == "--subdir") subdir = value;
+        else if(key == "--verify") verify = value;
+        else if(key == "--window") window = atoi(value.c_str());
+        else if(key == "--shard-mb") shard.shardBytes = (uint64_t)atoi(value.c_str()) << 20;
+        else if(key == "--buffer-mb") shard.bufferBytes = atoi(value.c_str()) << 20;
+        else if(key == "--io-depth") ioDepth = atoi(value.c_str());
+        else if(key == "--force") force = atoi(value.c_str()) != 0;
+        else if(key == "--io"){
+            if(!ParseIoBackend(value, ioMode)){
+                fprintf(stderr, "unknown io backend %s\n", value.c_str());
+                return 1;
+            }
+        }
+        else{
+            fprintf(stderr, "unknown option %s\n%s", key.c_str(), USAGE);
+            return 1;
+        }
+    }
+    if(in == "" || out == "" || (verify != "header" && verify != "decode")){
+        fprintf(stderr, "%s", USAGE);
+        return 1;
+    }
+    if(threads == 0) threads = 1;
+    if(window < threads) window = threads;
+    const bool decode = verify == "decode";
+
+    std::vector<std::string> found, dirs;
+    FindDirectories(in, "", subdir, found);
+    struct stat st;
+    unsigned int skipped = 0;
+    for(size_t i = 0; i < found.size(); i++){
+        if(!force && stat((out + "/" + found[i] + "/" + MANIFEST_FILE).c_str(), &st) == 0) skipped++;
+        else dirs.push_back(found[i]);
+    }
+    std::vector<Source> sources;
+    for(size_t i = 0; i < dirs.size(); i++) ListFrames(in + "/" + dirs[i] + "/" + subdir, i, sources);
+    printf("%zu directories (%u packed before), %zu frames\n", dirs.size(), skipped, sources.size());
+    fflush(stdout);
+
+    std::vector<Slot> slots(window);
+    for(size_t i = 0; i < slots.size(); i++) slots[i].ready = false;
+    std::mutex mutex;
+    std::condition_variable readyCv, freeCv;
+    std::atomic<size_t> next(0);
+    size_t done = 0;//frames the writer is through with, guarded by mutex
+
+    std::vector<std::thread> readers;
+    for(unsigned int t = 0; t < threads; t++){
+        readers.push_back(std::thread([&]{
+            std::vector<unsigned char> pixels;
+            size_t i;
+            while((i = next++) < sources.size()){
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    freeCv.wait(lock, [&]{ return i < done + window; });
+                }
+                const Source &s = sources[i];
+                Slot &slot = slots[i % window];
+                CaptureFrame &f = slot.frame;
+                f.id = s.id;
+                f.label = s.label;
+                f.name = s.name;
+                f.format = PIXEL_RGB;
+                bool ok = ReadFile(in + "/" + dirs[s.dir] + "/" + subdir + "/" + s.name, f.encoded) &&
+                    ReadJpegInfo(f.encoded.data(), f.encoded.size(), f.width, f.height, f.channels);
+                if(ok && decode){
+                    unsigned int w, h, c;
+                    ok = DecodeJpeg(&f.encoded[0], f.encoded.size(), pixels, w, h, c) &&
+                        w == f.width && h == f.height && c == f.channels;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    slot.ok = ok;
+                    slot.ready = true;
+                }
+                readyCv.notify_all();
+            }
+        }));
+    }
+
+    std::unique_ptr<IoBackend> io = IoBackend::Create(ioMode, ioDepth);
+    ShardFrameWriter writer(CODEC_JPEG, shard, io.get());
+    CaptureManifest manifest;
+    std::vector<uint64_t> labels;
+    uint64_t packed = 0, bad = 0, bytes = 0;
+    unsigned int dirsPacked = 0, dirsBad = 0;
+    int current = -1;
+    bool dirOk = false;//the shards of the current directory can be trusted
+    uint64_t start = NowNs(), lastReport = start;
+    // Frames count once their index entry is written, called from Write and Close on this thread.
+    writer.SetCompletion([&](uint64_t _id, int _label, size_t _size, bool _ok){
+        if(!_ok){
+            bad++;
+            dirOk = false;
+            fprintf(stderr, "cannot write frame %llu of %s\n", (unsigned long long)_id, dirs[current].c_str());
+            return;
+        }
+        manifest.AddFrame(_id, _label);
+        packed++;
+        bytes += _size;
+        if(_label >= 0){
+            if((size_t)_label >= labels.size()) labels.resize(_label + 1, 0);
+            labels[_label]++;
+        }
+    });
+    // Completes the shards and the manifest of the current directory. Without
+    // a manifest the directory is packed again by the next run.
+    auto finish = [&]{
+        if(current < 0) return;
+        if(!writer.Close()) dirOk = false;
+        if(!dirOk){
+            dirsBad++;
+            fprintf(stderr, "could not pack %s, no manifest written\n", dirs[current].c_str());
+        }else if(manifest.frames > 0 && manifest.Write(out + "/" + dirs[current])) dirsPacked++;
+        else if(manifest.frames > 0) fprintf(stderr, "cannot write the manifest of %s\n", dirs[current].c_str());
+    };
+    for(size_t i = 0; i < sources.size(); i++){
+        Slot &slot = slots[i % window];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            readyCv.wait(lock, [&]{ return slot.ready; });
+        }
+        const Source &s = sources[i];
+        if((int)s.dir != current){
+            finish();
+            current = s.dir;
+            manifest = CaptureManifest();
+            manifest.codec = CodecName(CODEC_JPEG);
+            manifest.format = PixelFormatName(PIXEL_RGB);
+            manifest.output = OutputModeName(OUTPUT_SHARDS);
+            manifest.layout = "flat";
+            std::string target = out + "/" + dirs[current];
+            if(!MakeDirectories(target)){
+                fprintf(stderr, "cannot write to %s\n", target.c_str());
+                exit(1);//the readers are still running
+            }
+            RemoveShards(target);
+            dirOk = writer.Open(target);
+            if(!dirOk) fprintf(stderr, "cannot open the shards of %s\n", target.c_str());
+        }
+        if(!slot.ok || !dirOk || !writer.Write(slot.frame)){
+            if(slot.ok) dirOk = false;//a frame that was read could not be written
+            bad++;
+            fprintf(stderr, "%s %s/%s/%s\n", slot.ok ? "cannot write" : "bad frame",
+                dirs[s.dir].c_str(), subdir.c_str(), s.name.c_str());
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slot.ready = false;
+            done = i + 1;
+        }
+        freeCv.notify_all();
+
+        uint64_t now = NowNs();
+        if(now - lastReport > 1000000000ULL){
+            double seconds = (now - start) / 1e9;
+            printf("%llu/%zu frames, %.1f frames/s, %.1f MB/s\n", (unsigned long long)(packed + bad),
+                sources.size(), (packed + bad) / seconds, bytes / 1e6 / seconds);
+            fflush(stdout);
+            lastReport = now;
+        }
+    }
+    finish();
+    for(size_t i = 0; i < readers.size(); i++) readers[i].join();
+
+    double seconds = (NowNs() - start) / 1e9;
+    printf("packed %llu frames (%.1f MB) of %u directories in %.1f s: %.1f frames/s, %.1f MB/s, %llu bad\n",
+        (unsigned long long)packed, bytes / 1e6, dirsPacked, seconds, packed / seconds,
+        bytes / 1e6 / seconds, (unsigned long long)bad);
+    if(dirsBad > 0) printf("%u directories could not be packed\n", dirsBad);
+    printf("frames per label:");
+    for(size_t i = 0; i < labels.size(); i++) printf(" %zu: %llu", i, (unsigned long long)labels[i]);
+    printf("\n");
+    return bad || dirsBad ? 2 : 0;
+}
@@ -0,0 +1,458 @@
+// Checks capture output after a run. Every directory with frame files
+// (<id>-gt<label>.<ext>, also one level of layout sub directories), shards
+// or a manifest.json under --in is an episode; worker threads take one
+// episode at a time and stream through its frames in the order they were
+// encoded, one frame in memory per thread. Per episode:
+// - frames that do not decode (truncated or corrupt files and records),
+// - blank frames (brightest cell of the luminance thumbnail at most
+//   --blank, as Camera_gt's blank_threshold) and duplicates (thumbnail
+//   within --duplicate of the frame before),
+// - missing frame ids (Camera_gt numbers the saved frames without gaps;
+//   frames whose write failed, failed_frames of the manifest, may leave
+//   as many gaps) and labels outside 0..--labels-1,
+// - with --poses, whether the labels follow the recorded trajectory: the
+//   k-th episode (in path order) has to show the label changes of the
+//   k-th episode of the pose log in the same order,
+// - fewer frames than its manifest.json counts.
+// Writes a JSON report with the totals, the frames per label and every
+// episode, and the episodes to generate again (one path per line) to
+// --regenerate. Exits with 2 if any episode has to be generated again.
+//
+// usage: dataset_verify --in ROOT [--threads 4] [--report report.json]
+//                       [--regenerate list.txt] [--blank 8] [--duplicate 0]
+//                       [--max-blank 0.05] [--labels 4] [--poses poses.log]
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_manifest.hh"
+#include "capture_stats.hh"
+#include "file_util.hh"
+#include "frame_decoder.hh"
+#include "frame_similarity.hh"
+#include "frame_writer.hh"
+#include "pose_log.hh"
+
+using namespace camera_common;
+
+static const char *const USAGE =
+    "usage: dataset_verify --in ROOT [--threads 4] [--report report.json] "
+    "[--regenerate list.txt] [--blank 8] [--duplicate 0] [--max-blank 0.05] [--labels 4] "
+    "[--poses poses.log]\n";
+
+struct Options
+{
+    unsigned int blank;
+    double duplicate;
+    double maxBlank;//fraction of blank frames that is still fine
+    int labels;
+};
+
+struct FrameFile
+{
+    uint64_t id;
+    int label;
+    std::string path;
+    Codec codec;
+    PixelFormat format;
+};
+
+struct EpisodeReport
+{
+    std::string path;//relative to --in
+    bool shards;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t decodeErrors;
+    uint64_t unchecked;//planar frames, which carry no size to decode them
+    uint64_t blank;
+    uint64_t duplicates;
+    uint64_t missingIds;
+    uint64_t badLabels;
+    int64_t manifestFrames;//-1 without a manifest
+    std::string trajectory;//ok, mismatch or none
+    std::vector<uint64_t> labels;//frames per label
+    std::vector<int> labelRuns;//the labels in frame order without repeats
+    std::string firstError;
+    std::vector<uint64_t> ids;
+};
+
+// Decodes and checks the frames of one episode, in encoding order.
+class EpisodeChecker
+{
+    public: EpisodeChecker(const Options &_options, EpisodeReport &_report)
+        : options(_options), report(_report), havePrevious(false) {}
+
+    public: void Frame(uint64_t _id, int _label, Codec _codec, PixelFormat _format,
+        const unsigned char *_data, size_t _size)
+    {
+        report.frames++;
+        report.bytes += _size;
+        report.ids.push_back(_id);
+        if(_label < 0 || _label >= options.labels) report.badLabels++;
+        else{
+            if((size_t)_label >= report.labels.size()) report.labels.resize(_label + 1, 0);
+            report.labels[_label]++;
+            if(report.labelRuns.empty() || report.labelRuns.back() != _label) report.labelRuns.push_back(_label);
+        }
+        if(_format == PIXEL_YUV420 || _format == PIXEL_CHW_F32){
+            report.unchecked++;
+            return;
+        }
+        unsigned int w, h, c;
+        if(_data == NULL || !decoder.Decode(_codec, _data, _size, pixels, w, h, c)){
+            Error(_id, "does not decode");
+            report.decodeErrors++;
+            havePrevious = false;
+            return;
+        }
+        ComputeSignature(&pixels[0], w, h, c, current);
+        if(SignatureMax(current) <= options.blank) report.blank++;
+        else if(havePrevious && SignatureDistance(current, previous) <= options.duplicate) report.duplicates++;
+        previous = current;
+        havePrevious = true;
+    }
+
+    public: void Error(uint64_t _id, const std::string &_what)
+    {
+        if(report.firstError != "") return;
+        std::ostringstream out;
+        out << "frame " << _id << " " << _what;
+        report.firstError = out.str();
+    }
+
+    private: const Options &options;
+    private: EpisodeReport &report;
+    private: FrameDecoder decoder;
+    private: std::vector<unsigned char> pixels;
+    private: FrameSignature previous;
+    private: FrameSignature current;
+    private: bool havePrevious;
+};
+
+static bool ParseFrameName(const char *_name, uint64_t &_id, int &_label, Codec &_codec, PixelFormat &_format)
+{
+    char *end;
+    _id = strtoull(_name, &end, 10);
+    if(end == _name || strncmp(end, "-gt", 3) != 0) return false;
+    _label = end[3] >= '0' && end[3] <= '9' ? atoi(end + 3) : -1;
+    const char *dot = strrchr(_name, '.');
+    if(dot == NULL) return false;
+    std::string ext = dot + 1;
+    _format = PIXEL_RGB;
+    if(ext == "jpg" || ext == "jpeg") _codec = CODEC_JPEG;
+    else if(ext == "png") _codec = CODEC_PNG;
+    else if(ext == "ppm" || ext == "pgm") _codec = CODEC_RAW;
+    else if(ext == "cfd") _codec = CODEC_DELTA;
+    else if(ext == "yuv" || ext == "f32"){
+        _codec = CODEC_RAW;
+        _format = ext == "yuv" ? PIXEL_YUV420 : PIXEL_CHW_F32;
+    }
+    else return false;
+    return true;
+}
+
+// Frame files of _dir and, for the chunked and hashed layouts, of its sub
+// directories.
+static void ListFrames(const std::string &_dir, int _depth, std::vector<FrameFile> &_frames)
+{
+    DIR *d = opendir(_dir.c_str());
+    if(d == NULL) return;
+    struct dirent *e;
+    while((e = readdir(d)) != NULL){
+        if(e->d_name[0] == '.') continue;
+        FrameFile f;
+        if(ParseFrameName(e->d_name, f.id, f.label, f.codec, f.format)){
+            f.path = _dir + "/" + e->d_name;
+            _frames.push_back(f);
+        }else if(_depth > 0 && (e->d_type == DT_DIR || e->d_type == DT_UNKNOWN)){
+            ListFrames(_dir + "/" + e->d_name, _depth - 1, _frames);
+        }
+    }
+    closedir(d);
+}
+
+static bool Exists(const std::string &_path)
+{
+    struct stat st;
+    return stat(_path.c_str(), &st) == 0;
+}
+
+// Directories under _root that hold an episode, relative to _root.
+static void FindEpisodes(const std::string &_root, const std::string &_relative, std::vector<std::string> &_episodes)
+{
+    std::string path = _relative == "" ? _root : _root + "/" + _relative;
+    DIR *d = opendir(path.c_str());
+    if(d == NULL) return;
+    std::vector<std::string> children;
+    bool frames = false;
+    struct dirent *e;
+    while((e = readdir(d)) != NULL){
+        if(e->d_name[0] == '.') continue;
+        uint64_t id;
+        int label;
+        Codec codec;
+        PixelFormat format;
+        if(ParseFrameName(e->d_name, id, label, codec, format)) frames = true;
+        else if(e->d_type == DT_DIR || e->d_type == DT_UNKNOWN) children.push_back(e->d_name);
+    }
+    closedir(d);
+    if(frames || Exists(path + "/" + MANIFEST_FILE) || Exists(path + "/" + ShardFileName(0, "idx"))){
+        _episodes.push_back(_relative);
+        return;
+    }
+    std::sort(children.begin(), children.end());
+    for(size_t i = 0; i < children.size(); i++)
+        FindEpisodes(_root, _relative == "" ? children[i] : _relative + "/" + children[i], _episodes);
+}
+
+static void CheckFiles(const std::string &_dir, EpisodeChecker &_checker)
+{
+    std::vector<FrameFile> frames;
+    ListFrames(_dir, 1, frames);
+    std::sort(frames.begin(), frames.end(), [](const FrameFile &_a, const FrameFile &_b){ return _a.id < _b.id; });
+    std::vector<unsigned char> data;
+    for(size_t i = 0; i < frames.size(); i++){
+        const FrameFile &f = frames[i];
+        bool ok = ReadFile(f.path, data);
+        _checker.Frame(f.id, f.label, f.codec, f.format, ok && !data.empty() ? &data[0] : NULL, ok ? data.size() : 0);
+    }
+}
+
+// The records of every shard through its index, read front to back.
+static void CheckShards(const std::string &_dir, EpisodeChecker &_checker)
+{
+    std::vector<unsigned char> data;
+    for(unsigned int s = 0; Exists(_dir + "/" + ShardFileName(s, "idx")); s++){
+        FILE *index = fopen((_dir + "/" + ShardFileName(s, "idx")).c_str(), "rb");
+        FILE *records = fopen((_dir + "/" + ShardFileName(s, "rec")).c_str(), "rb");
+        if(index == NULL || records == NULL){
+            if(index != NULL) fclose(index);
+            if(records != NULL) fclose(records);
+            _checker.Error(0, "of shard " + ShardFileName(s, "rec") + " missing");
+            continue;
+        }
+        setvbuf(records, NULL, _IOFBF, 4 << 20);
+        ShardIndexEntry entry;
+        uint64_t position = 0;
+        while(fread(&entry, sizeof(entry), 1, index) == 1){
+            ShardRecordHeader header;
+            bool ok = (entry.offset == position || fseeko(records, entry.offset, SEEK_SET) == 0) &&
+                fread(&header, sizeof(header), 1, records) == 1 && header.magic == SHARD_RECORD_MAGIC &&
+                header.id == entry.id && header.size == entry.size;
+            if(ok){
+                data.resize(header.size);
+                ok = header.size == 0 || fread(&data[0], 1, header.size, records) == header.size;
+            }
+            position = entry.offset + sizeof(header) + entry.size;
+            Codec codec = (Codec)(header.codec & 0xffff);
+            PixelFormat format = (PixelFormat)(header.codec >> 16);
+            if(!ok){
+                _checker.Frame(entry.id, entry.label, CODEC_RAW, PIXEL_RGB, NULL, 0);
+                position = (uint64_t)-1;//seek to the next record
+            }else _checker.Frame(entry.id, entry.label, codec, format, data.empty() ? NULL : &data[0], data.size());
+        }
+        fclose(index);
+        fclose(records);
+    }
+}
+
+// _frames in order, possibly without some of the labels of _trajectory.
+static bool FollowsTrajectory(const std::vector<int> &_frames, const std::vector<int> &_trajectory)
+{
+    size_t t = 0;
+    for(size_t f = 0; f < _frames.size(); f++){
+        while(t < _trajectory.size() && _trajectory[t] != _frames[f]) t++;
+        if(t == _trajectory.size()) return false;
+    }
+    return true;
+}
+
+static bool Regenerate(const EpisodeReport &_r, const Options &_options)
+{
+    return _r.frames == 0 || _r.decodeErrors > 0 || _r.missingIds > 0 || _r.badLabels > 0 ||
+        _r.trajectory == "mismatch" || _r.blank > _options.maxBlank * _r.frames ||
+        (_r.manifestFrames >= 0 && _r.frames < (uint64_t)_r.manifestFrames);
+}
+
+static std::string Quote(const std::string &_s)
+{
+    std::string out = "\"";
+    for(size_t i = 0; i < _s.size(); i++){
+        if(_s[i] == '"' || _s[i] == '\\') out += '\\';
+        out += _s[i];
+    }
+    return out + "\"";
+}
+
+static void WriteLabels(std::ostream &_out, const std::vector<uint64_t> &_labels)
+{
+    _out << "{";
+    for(size_t i = 0; i < _labels.size(); i++) _out << (i ? ", " : "") << "\"" << i << "\": " << _labels[i];
+    _out << "}";
+}
+
+int main(int argc, char **argv)
+{
+    std::string in, reportPath, regeneratePath, posesPath;
+    unsigned int threads = 4;
+    Options options;
+    options.blank = 8;
+    options.duplicate = 0;
+    options.maxBlank = 0.05;
+    options.labels = 4;
+    for(int i = 1; i < argc; i += 2){
+        std::string key = argv[i];
+        if(key == "--help"){
+            printf("%s", USAGE);
+            return 0;
+        }
+        if(i + 1 == argc){
+            fprintf(stderr, "%s needs a value\n%s", key.c_str(), USAGE);
+            return 1;
+        }
+        std::string value = argv[i + 1];
+        if(key == "--in") in = value;
+        else if(key == "--threads") threads = atoi(value.c_str());
+        else if(key == "--report") reportPath = value;
+        else if(key == "--regenerate") regeneratePath = value;
+        else if(key == "--blank") options.blank = atoi(value.c_str());
+        else if(key == "--duplicate") options.duplicate = atof(value.c_str());
+        else if(key == "--max-blank") options.maxBlank = atof(value.c_str());
+        else if(key == "--labels") options.labels = atoi(value.c_str());
+        else if(key == "--poses") posesPath = value;
+        else{
+            fprintf(stderr, "unknown option %s\n%s", key.c_str(), USAGE);
+            return 1;
+        }
+    }
+    if(in == ""){
+        fprintf(stderr, "%s", USAGE);
+        return 1;
+    }
+    if(threads == 0) threads = 1;
+    std::vector<PoseLogEpisode> poses;
+    if(posesPath != "" && !ReadPoseLog(posesPath, poses)){
+        fprintf(stderr, "cannot read the pose log %s\n", posesPath.c_str());
+        return 1;
+    }
+
+    std::vector<std::string> paths;
+    FindEpisodes(in, "", paths);
+    std::vector<EpisodeReport> reports(paths.size());
+    std::atomic<size_t> next(0);
+    uint64_t start = NowNs();
+    std::vector<std::thread> workers;
+    for(unsigned int t = 0; t < threads; t++){
+        workers.push_back(std::thread([&]{
+            size_t i;
+            while((i = next++) < paths.size()){
+                EpisodeReport &r = reports[i];
+                r.path = paths[i];
+                std::string dir = paths[i] == "" ? in : in + "/" + paths[i];
+                r.shards = Exists(dir + "/" + ShardFileName(0, "idx"));
+                r.frames = r.bytes = r.decodeErrors = r.unchecked = r.blank = r.duplicates = 0;
+                r.missingIds = r.badLabels = 0;
+                r.manifestFrames = ReadManifestNumber(dir, "frames");
+                int64_t failed = ReadManifestNumber(dir, "failed_frames");
+                EpisodeChecker checker(options, r);
+                if(r.shards) CheckShards(dir, checker);
+                else CheckFiles(dir, checker);
+
+                std::sort(r.ids.begin(), r.ids.end());
+                r.ids.erase(std::unique(r.ids.begin(), r.ids.end()), r.ids.end());
+                if(!r.ids.empty()) r.missingIds = r.ids.back() - r.ids.front() + 1 - r.ids.size();
+                r.missingIds -= std::min<uint64_t>(r.missingIds, failed > 0 ? failed : 0);
+                std::vector<uint64_t>().swap(r.ids);
+
+                r.trajectory = "none";
+                if(i < poses.size()){
+                    std::vector<int> runs;
+                    for(size_t s = 0; s < poses[i].size(); s++)
+                        if(runs.empty() || runs.back() != poses[i][s].label) runs.push_back(poses[i][s].label);
+                    r.trajectory = FollowsTrajectory(r.labelRuns, runs) ? "ok" : "mismatch";
+                }
+            }
+        }));
+    }
+    for(size_t i = 0; i < workers.size(); i++) workers[i].join();
+    double seconds = (NowNs() - start) / 1e9;
+
+    EpisodeReport total;
+    total.frames = total.bytes = total.decodeErrors = total.unchecked = total.blank = total.duplicates = 0;
+    total.missingIds = total.badLabels = 0;
+    std::vector<std::string> regenerate;
+    for(size_t i = 0; i < reports.size(); i++){
+        const EpisodeReport &r = reports[i];
+        total.frames += r.frames;
+        total.bytes += r.bytes;
+        total.decodeErrors += r.decodeErrors;
+        total.unchecked += r.unchecked;
+        total.blank += r.blank;
+        total.duplicates += r.duplicates;
+        total.missingIds += r.missingIds;
+        total.badLabels += r.badLabels;
+        if(r.labels.size() > total.labels.size()) total.labels.resize(r.labels.size(), 0);
+        for(size_t l = 0; l < r.labels.size(); l++) total.labels[l] += r.labels[l];
+        if(Regenerate(r, options)) regenerate.push_back(r.path == "" ? in : in + "/" + r.path);
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"root\": " << Quote(in) << ",\n  \"episodes\": " << reports.size()
+        << ",\n  \"frames\": " << total.frames << ",\n  \"bytes\": " << total.bytes
+        << ",\n  \"decode_errors\": " << total.decodeErrors << ",\n  \"unchecked\": " << total.unchecked
+        << ",\n  \"blank\": " << total.blank << ",\n  \"duplicates\": " << total.duplicates
+        << ",\n  \"missing_ids\": " << total.missingIds << ",\n  \"bad_labels\": " << total.badLabels
+        << ",\n  \"seconds\": " << seconds << ",\n  \"labels\": ";
+    WriteLabels(json, total.labels);
+    json << ",\n  \"regenerate\": [";
+    for(size_t i = 0; i < regenerate.size(); i++) json << (i ? ", " : "") << Quote(regenerate[i]);
+    json << "],\n  \"episode_reports\": [";
+    for(size_t i = 0; i < reports.size(); i++){
+        const EpisodeReport &r = reports[i];
+        json << (i ? "," : "") << "\n    {\"path\": " << Quote(r.path) << ", \"output\": \""
+            << (r.shards ? "shards" : "files") << "\", \"frames\": " << r.frames
+            << ", \"manifest_frames\": " << r.manifestFrames << ", \"decode_errors\": " << r.decodeErrors
+            << ", \"unchecked\": " << r.unchecked << ", \"blank\": " << r.blank
+            << ", \"duplicates\": " << r.duplicates << ", \"missing_ids\": " << r.missingIds
+            << ", \"bad_labels\": " << r.badLabels << ", \"trajectory\": \"" << r.trajectory
+            << "\", \"labels\": ";
+        WriteLabels(json, r.labels);
+        json << ", \"first_error\": " << Quote(r.firstError) << "}";
+    }
+    json << "\n  ]\n}\n";
+
+    if(reportPath != "" && !WriteFileAtomically(reportPath, json.str())){
+        fprintf(stderr, "cannot write %s\n", reportPath.c_str());
+        return 1;
+    }
+    if(regeneratePath != ""){
+        std::string list;
+        for(size_t i = 0; i < regenerate.size(); i++) list += regenerate[i] + "\n";
+        if(!WriteFileAtomically(regeneratePath, list)){
+            fprintf(stderr, "cannot write %s\n", regeneratePath.c_str());
+            return 1;
+        }
+    }
+    printf("%zu episodes, %llu frames (%.1f MB) in %.1f s: %.1f frames/s\n", reports.size(),
+        (unsigned long long)total.frames, total.bytes / 1e6, seconds, total.frames / (seconds > 0 ? seconds : 1));
+    printf("decode errors %llu, blank %llu, duplicates %llu, missing ids %llu, bad labels %llu, unchecked %llu\n",
+        (unsigned long long)total.decodeErrors, (unsigned long long)total.blank,
+        (unsigned long long)total.duplicates, (unsigned long long)total.missingIds,
+        (unsigned long long)total.badLabels, (unsigned long long)total.unchecked);
+    printf("frames per label:");
+    for(size_t i = 0; i < total.labels.size(); i++) printf(" %zu: %llu", i, (unsigned long long)total.labels[i]);
+    printf("\n%zu episodes to regenerate\n", regenerate.size());
+    for(size_t i = 0; i < regenerate.size(); i++) printf("  %s\n", regenerate[i].c_str());
+    if(reportPath == "") fputs(json.str().c_str(), stdout);
+    return regenerate.empty() ? 0 : 2;
+}
@@ -0,0 +1,187 @@
+// Stand-in for a trainer that reads frames from the stream of Camera_gt
+// (stream option) instead of from disk. Prints throughput once a second and
+// the frames per label at the end; frames the server dropped because this
+// client was too slow show up as missed ids.
+//
+// usage: stream_client --address unix:/tmp/camera.sock|tcp:5555
+//                      [--frames N] [--delay-ms 0] [--out dir]
+// --frames stops after N frames (default: until the server closes),
+// --delay-ms sleeps after every batch to act like a slow consumer, --out
+// writes the frames as <id>-gt<label>.<ext> files.
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "capture_stats.hh"
+#include "frame_server.hh"
+
+using namespace camera_common;
+
+static const char *const USAGE =
+    "usage: stream_client --address unix:<path>|tcp:<port> [--frames N] [--delay-ms 0] [--out dir]\n";
+
+static bool ReadAll(int _fd, void *_data, size_t _size)
+{
+    char *p = (char *)_data;
+    while(_size > 0){
+        ssize_t n = recv(_fd, p, _size, 0);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n;
+        _size -= n;
+    }
+    return true;
+}
+
+static int Connect(const std::string &_address)
+{
+    bool isUnix;
+    std::string path;
+    int port;
+    if(!ParseStreamAddress(_address, isUnix, path, port)){
+        fprintf(stderr, "bad address %s, use unix:<path> or tcp:<port>\n", _address.c_str());
+        return -1;
+    }
+    int fd = socket(isUnix ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+    int ok;
+    if(isUnix){
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        ok = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }else{
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ok = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    if(ok != 0){
+        fprintf(stderr, "cannot connect to %s: %s\n", _address.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    std::string address, out;
+    unsigned long long maxFrames = 0;
+    int delayMs = 0;
+    for(int i = 1; i < argc; i += 2){
+        std::string key = argv[i];
+        if(key == "--help"){
+            printf("%s", USAGE);
+            return 0;
+        }
+        if(i + 1 == argc){
+            fprintf(stderr, "%s needs a value\n%s", key.c_str(), USAGE);
+            return 1;
+        }
+        std::string value = argv[i + 1];
+        if(key == "--address") address = value;
+        else if(key == "--frames") maxFrames = strtoull(value.c_str(), NULL, 10);
+        else if(key == "--delay-ms") delayMs = atoi(value.c_str());
+        else if(key == "--out") out = value;
+        else{
+            fprintf(stderr, "unknown option %s\n%s", key.c_str(), USAGE);
+            return 1;
+        }
+    }
+    if(address == ""){
+        fprintf(stderr, "%s", USAGE);
+        return 1;
+    }
+    int fd = Connect(address);
+    if(fd < 0) return 1;
+
+    std::vector<unsigned long long> labels;
+    unsigned long long frames = 0, batches = 0, bytes = 0, bad = 0;
+    unsigned long long intervalFrames = 0, intervalBytes = 0;
+    //frames come out of order with several capture workers, count what is
+    //missing from the range of ids seen
+    unsigned long long minId = ~0ULL, maxId = 0;
+    uint64_t start = NowNs(), lastPrint = start;
+    std::vector<unsigned char> data;
+    while(maxFrames == 0 || frames < maxFrames){
+        StreamBatchHeader batch;
+        if(!ReadAll(fd, &batch, sizeof(batch))) break;
+        if(batch.magic != STREAM_BATCH_MAGIC){
+            fprintf(stderr, "bad batch magic %08x\n", batch.magic);
+            return 1;
+        }
+        data.resize(batch.bytes);
+        if(batch.bytes > 0 && !ReadAll(fd, &data[0], batch.bytes)) break;
+        batches++;
+        size_t offset = 0;
+        for(uint32_t f = 0; f < batch.frames; f++){
+            ShardRecordHeader header;
+            if(offset + sizeof(header) > data.size()){
+                bad++;
+                break;
+            }
+            memcpy(&header, &data[offset], sizeof(header));
+            offset += sizeof(header);
+            if(header.magic != SHARD_RECORD_MAGIC || offset + header.size > data.size()){
+                bad++;
+                break;
+            }
+            if(header.id < minId) minId = header.id;
+            if(header.id > maxId) maxId = header.id;
+            if(header.label >= 0){
+                if((size_t)header.label >= labels.size()) labels.resize(header.label + 1, 0);
+                labels[header.label]++;
+            }
+            if(out != ""){
+                char name[64];
+                snprintf(name, sizeof(name), "/%05llu-gt%01d.%s", (unsigned long long)header.id, header.label,
+                    FrameExtension((Codec)(header.codec & 0xffff), (PixelFormat)(header.codec >> 16), header.channels));
+                FILE *file = fopen((out + name).c_str(), "wb");
+                if(file != NULL){
+                    fwrite(&data[offset], 1, header.size, file);
+                    fclose(file);
+                }
+            }
+            offset += header.size;
+            frames++;
+            intervalFrames++;
+        }
+        bytes += batch.bytes;
+        intervalBytes += batch.bytes;
+
+        unsigned long long missed = frames ? maxId - minId + 1 - frames : 0;
+        uint64_t now = NowNs();
+        if(now - lastPrint >= 1000000000ULL){
+            double seconds = (now - lastPrint) / 1e9;
+            printf("%llu frames, %.1f frames/s, %.1f MB/s, %.1f frames per batch, %llu missed\n",
+                frames, intervalFrames / seconds, intervalBytes / 1e6 / seconds,
+                batches ? (double)frames / batches : 0.0, missed);
+            fflush(stdout);
+            lastPrint = now;
+            intervalFrames = 0;
+            intervalBytes = 0;
+        }
+        if(delayMs > 0) usleep(delayMs * 1000);
+    }
+    close(fd);
+
+    unsigned long long missed = frames ? maxId - minId + 1 - frames : 0;
+    double seconds = (NowNs() - start) / 1e9;
+    printf("total: %llu frames in %llu batches, %.1f frames/s, %.1f MB/s, %llu missed, %llu bad\n",
+        frames, batches, frames / seconds, bytes / 1e6 / seconds, missed, bad);
+    for(size_t i = 0; i < labels.size(); i++) printf("label %zu: %llu frames\n", i, labels[i]);
+    return bad == 0 ? 0 : 1;
+}
@@ -0,0 +1,347 @@
+// Runs the camera trajectory of camera_move_stoch_adapt without Gazebo: the
+// TrajectoryStateMachine drives a kinematic pose integrator, one Step per
+// physics update of --dt seconds.
+//
+// Writes the label and pose every --every ticks as csv, compares that csv
+// with a golden file (--check, exit code 1 on the first difference) or only
+// reports the number of ticks per second (--bench). --check compares the
+// episode, tick, label and state columns exactly and the pose columns
+// within --tolerance (default 1e-4), so rounding differences of another
+// compiler or libm do not fail it.
+//
+// usage: trajectory_sim [--seed S] [--size x,y,z] [--episodes N]
+//                       [--state-duration D] [--mirror 0|1] [--dt 0.001]
+//                       [--every 100] [--out trajectory.csv]
+//                       [--check golden.csv] [--tolerance 1e-4] [--bench 1]
+//                       [--pose-log poses.cpl]
+//        trajectory_sim --trajectory orbit [--size x,y,z] [--standoff 0.75]
+//                       [--pitch 0.5] [--coverage 1] [--spacing 0.05]
+//                       [--rate 30] [--dt 0.001] [...]
+//        trajectory_sim --trajectory spline [--noise-interval 500]
+//                       [--position-noise 0.02] [--angle-noise 0.03] [...]
+//
+// --pose-log records every update in the pose log format of the controllers
+// (record_poses), reads it back and reports its size and quantization error;
+// it fails if a pose read back is further off than the quantization.
+//
+// --trajectory orbit runs the OrbitTrajectory instead (the state column is
+// its phase) and compares its planned updates and frames with the run; a
+// frame is counted every 1/--rate simulated seconds. --trajectory spline
+// runs the SplineTrajectory of the same seed next to the stochastic
+// trajectory and reports how far it strays from that path. Every mode reports the
+// largest acceleration and jerk of the camera position.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "capture_stats.hh"
+#include "pose_log.hh"
+#include "spline_trajectory.hh"
+#include "orbit_trajectory.hh"
+#include "trajectory.hh"
+
+using namespace camera_common;
+
+static const char *const USAGE =
+    "usage: trajectory_sim [--seed S] [--size x,y,z] [--episodes N] [--state-duration D] [--mirror 0|1]\n"
+    "                      [--dt 0.001] [--every 100] [--out trajectory.csv] [--check golden.csv]\n"
+    "                      [--tolerance 1e-4] [--bench 1] [--pose-log poses.cpl]\n"
+    "       trajectory_sim --trajectory orbit [--size x,y,z] [--standoff 0.75] [--pitch 0.5] [--coverage 1]\n"
+    "                      [--spacing 0.05] [--rate 30] [--dt 0.001] [...]\n"
+    "       trajectory_sim --trajectory spline [--noise-interval 500] [--position-noise 0.02]\n"
+    "                      [--angle-noise 0.03] [...]\n";
+
+static bool ParseSize(const std::string &_s, double &_x, double &_y, double &_z)
+{
+    return sscanf(_s.c_str(), "%lf,%lf,%lf", &_x, &_y, &_z) == 3;
+}
+
+static std::vector<std::string> SplitFields(const std::string &_line)
+{
+    std::vector<std::string> fields;
+    std::stringstream ss(_line);
+    std::string field;
+    while(std::getline(ss, field, ',')) fields.push_back(field);
+    return fields;
+}
+
+// Two csv lines match if they have the same fields; decimal fields (the
+// pose) may differ by _tolerance, everything else (header, episode, tick,
+// label, state) has to be equal.
+static bool SameLine(const std::string &_expected, const std::string &_got, double _tolerance)
+{
+    std::vector<std::string> a = SplitFields(_expected), b = SplitFields(_got);
+    if(a.size() != b.size()) return false;
+    for(size_t i = 0; i < a.size(); i++){
+        if(a[i] == b[i]) continue;
+        if(a[i].find('.') == std::string::npos || b[i].find('.') == std::string::npos) return false;
+        char *endA, *endB;
+        double x = strtod(a[i].c_str(), &endA), y = strtod(b[i].c_str(), &endB);
+        if(*endA != 0 || *endB != 0 || !(fabs(x - y) <= _tolerance)) return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int seed = 42, episodes = 1, every = 100;
+    int stateDuration = 5000;
+    bool mirror = false, bench = false;
+    double sx = 1, sy = 1, sz = 1, dt = 0.001, tolerance = 1e-4;
+    std::string out, check, poseLog, kind = "stochastic";
+    OrbitOptions orbitOptions;
+    SplineOptions splineOptions;
+    for(int i = 1; i < argc; i += 2){
+        std::string key = argv[i];
+        if(key == "--help"){
+            printf("%s", USAGE);
+            return 0;
+        }
+        if(i + 1 == argc){
+            fprintf(stderr, "%s needs a value\n%s", key.c_str(), USAGE);
+            return 1;
+        }
+        std::string value = argv[i + 1];
+        if(key == "--seed") seed = strtoul(value.c_str(), NULL, 10);
+        else if(key == "--size"){
+            if(!ParseSize(value, sx, sy, sz)){
+                fprintf(stderr, "--size expects x,y,z\n");
+                return 1;
+            }
+        }
+        else if(key == "--episodes") episodes = atoi(value.c_str());
+        else if(key == "--state-duration") stateDuration = atoi(value.c_str());
+        else if(key == "--mirror") mirror = atoi(value.c_str()) != 0;
+        else if(key == "--dt") dt = atof(value.c_str());
+        else if(key == "--every") every = atoi(value.c_str());
+        else if(key == "--out") out = value;
+        else if(key == "--check") check = value;
+        else if(key == "--tolerance") tolerance = atof(value.c_str());
+        else if(key == "--pose-log") poseLog = value;
+        else if(key == "--bench") bench = atoi(value.c_str()) != 0;
+        else if(key == "--trajectory") kind = value;
+        else if(key == "--standoff") orbitOptions.standoff = atof(value.c_str());
+        else if(key == "--pitch") orbitOptions.pitch = atof(value.c_str());
+        else if(key == "--coverage") orbitOptions.coverage = atof(value.c_str());
+        else if(key == "--spacing") orbitOptions.spacing = atof(value.c_str());
+        else if(key == "--rate") orbitOptions.frameRate = atof(value.c_str());
+        else if(key == "--noise-interval") splineOptions.noiseInterval = atof(value.c_str());
+        else if(key == "--position-noise") splineOptions.positionNoise = atof(value.c_str());
+        else if(key == "--angle-noise") splineOptions.angleNoise = atof(value.c_str());
+        else{
+            fprintf(stderr, "unknown option %s\n%s", key.c_str(), USAGE);
+            return 1;
+        }
+    }
+    if(every == 0) every = 1;
+    if(kind != "stochastic" && kind != "orbit" && kind != "spline"){
+        fprintf(stderr, "--trajectory expects stochastic, orbit or spline\n");
+        return 1;
+    }
+    const bool orbiting = kind == "orbit";
+    const bool smooth = kind == "spline";
+    if(orbiting && (orbitOptions.spacing <= 0 || orbitOptions.frameRate <= 0)){
+        fprintf(stderr, "--spacing and --rate must be positive\n");
+        return 1;
+    }
+    orbitOptions.dt = dt;
+    OrbitTrajectory orbit(orbitOptions);
+    orbit.SetObjectSize(sx, sy, sz);
+
+    TrajectoryStateMachine trajectory(seed, mirror);
+    trajectory.SetStateDuration(stateDuration);
+    trajectory.SetObjectSize(sx, sy, sz);
+    splineOptions.dt = dt;
+    SplineTrajectory spline(seed, mirror, splineOptions);
+    spline.SetStateDuration(stateDuration);
+    spline.SetObjectSize(sx, sy, sz);
+
+    std::ostringstream csv;
+    csv << "episode,tick,label,state,x,y,z,roll,pitch,yaw\n";
+    PoseLogWriter recorder;
+    if(poseLog != "" && !recorder.Open(poseLog)){
+        fprintf(stderr, "could not write %s\n", poseLog.c_str());
+        return 1;
+    }
+    std::vector<PoseLogEpisode> recorded(episodes);
+    uint64_t ticks = 0;
+    uint64_t labelTicks[4] = {0, 0, 0, 0};
+    uint64_t frames = 0;
+    double frameDistance = 0, frameDistanceMin = 1e9, frameDistanceMax = 0;
+    double maxAcceleration = 0, maxJerk = 0, maxDeviation = 0;
+    uint64_t start = NowNs();
+    for(unsigned int e = 0; e < episodes; e++){
+        // Start pose of the camera next to the focus object, as placed by the world plugins
+        Pose3 pose;
+        pose.pos = Vec3(-0.75 - sy / 2, 0, 0.05);
+        trajectory.Reset();
+        orbit.Reset();
+        spline.Reset();
+        TrajectoryCommand cmd;
+        Vec3 lastFrame = pose.pos;
+        Pose3 reference = pose;//stochastic trajectory next to the spline
+        std::vector<Vec3> referencePath, splinePath;
+        Vec3 history[3] = {pose.pos, pose.pos, pose.pos};
+        auto step = [&](){
+            if(orbiting){
+                if(!orbit.Step(pose, cmd)) return false;
+                IntegratePose(pose, pose.rot * cmd.linear, cmd.angular, dt);
+            }else if(smooth){
+                Pose3 next;
+                if(!spline.Step(pose, next, cmd)) return false;
+                pose = next;
+                TrajectoryCommand stochastic;
+                if(trajectory.Step(stochastic))
+                    IntegratePose(reference, reference.rot * stochastic.linear, stochastic.angular, dt);
+            }else{
+                if(!trajectory.Step(cmd)) return false;
+                IntegratePose(pose, pose.rot * cmd.linear, cmd.angular, dt);
+            }
+            return true;
+        };
+        for(uint64_t t = 0; step(); t++){
+            if(t >= 3){
+                Vec3 a = (pose.pos - history[2] * 2 + history[1]) * (1 / (dt * dt));
+                Vec3 j = (pose.pos - history[2] * 3 + history[1] * 3 - history[0]) * (1 / (dt * dt * dt));
+                maxAcceleration = std::max(maxAcceleration, a.Length());
+                maxJerk = std::max(maxJerk, j.Length());
+            }
+            history[0] = history[1];
+            history[1] = history[2];
+            history[2] = pose.pos;
+            if(smooth && t % 10 == 0) referencePath.push_back(reference.pos);
+            if(smooth && t % 100 == 0) splinePath.push_back(pose.pos);
+            if(orbiting && floor((t + 1) * dt * orbitOptions.frameRate) > floor(t * dt * orbitOptions.frameRate)){
+                double d = (pose.pos - lastFrame).Length();
+                if(frames > 0){
+                    frameDistance += d;
+                    frameDistanceMin = std::min(frameDistanceMin, d);
+                    frameDistanceMax = std::max(frameDistanceMax, d);
+                }
+                lastFrame = pose.pos;
+                frames++;
+            }
+            ticks++;
+            if(cmd.label >= 0 && cmd.label < 4) labelTicks[cmd.label]++;
+            if(recorder.IsOpen()){
+                recorder.Add(t, cmd.label, pose);
+                PoseLogSample sample = {t, cmd.label, pose};
+                recorded[e].push_back(sample);
+            }
+            if(bench || t % every != 0) continue;
+            Vec3 rpy = pose.rot.Euler();
+            char line[256];
+            snprintf(line, sizeof(line), "%u,%llu,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+                e, (unsigned long long)t, cmd.label, orbiting ? (int)orbit.CurrentPhase() : trajectory.InnerState(),
+                pose.pos.x, pose.pos.y, pose.pos.z, rpy.x, rpy.y, rpy.z);
+            csv << line;
+        }
+        if(recorder.IsOpen()) recorder.EndEpisode();
+        // distance to the nearest point of the stochastic path
+        for(size_t i = 0; i < splinePath.size(); i++){
+            double nearest = 1e9;
+            for(size_t j = 0; j < referencePath.size(); j++)
+                nearest = std::min(nearest, (splinePath[i] - referencePath[j]).Length());
+            maxDeviation = std::max(maxDeviation, nearest);
+        }
+    }
+    double seconds = (NowNs() - start) / 1e9;
+
+    printf("seed %u episodes %u ticks %llu (up %llu, forward %llu, turn %llu, land %llu)\n",
+        seed, episodes, (unsigned long long)ticks,
+        (unsigned long long)labelTicks[0], (unsigned long long)labelTicks[1],
+        (unsigned long long)labelTicks[2], (unsigned long long)labelTicks[3]);
+    printf("%.3f s, %.2f Mticks/s, %.0f simulated s\n",
+        seconds, seconds > 0 ? ticks / seconds / 1e6 : 0.0, ticks * dt);
+    printf("max acceleration %.3g m/s^2, max jerk %.3g m/s^3\n", maxAcceleration, maxJerk);
+    if(smooth)
+        printf("spline through %zu waypoints, at most %.3f m from the stochastic trajectory\n",
+            spline.Waypoints(), maxDeviation);
+    if(orbiting){
+        printf("orbit radius %.3f m, %.2f revolutions, path %.2f m at %.3f m/s\n",
+            orbit.Radius(), orbit.Revolutions(), orbit.PathLength(), orbit.Speed());
+        printf("planned %llu updates and %llu frames per episode, ran %llu updates and %llu frames\n",
+            (unsigned long long)orbit.Updates(), (unsigned long long)orbit.Frames(),
+            (unsigned long long)(ticks / episodes), (unsigned long long)(frames / episodes));
+        if(frames > episodes)
+            printf("distance between frames %.4f m (min %.4f, max %.4f)\n",
+                frameDistance / (frames - episodes), frameDistanceMin, frameDistanceMax);
+    }
+    if(recorder.IsOpen()){
+        recorder.Close();
+        std::vector<PoseLogEpisode> replayed;
+        if(!ReadPoseLog(poseLog, replayed) || replayed.size() != recorded.size()){
+            fprintf(stderr, "could not read back %s\n", poseLog.c_str());
+            return 1;
+        }
+        double maxPosition = 0, maxRotation = 0;
+        size_t samples = 0;
+        for(size_t e = 0; e < recorded.size(); e++){
+            if(replayed[e].size() != recorded[e].size()){
+                fprintf(stderr, "episode %zu: %zu samples instead of %zu\n", e, replayed[e].size(), recorded[e].size());
+                return 1;
+            }
+            for(size_t i = 0; i < recorded[e].size(); i++){
+                const PoseLogSample &a = recorded[e][i], &b = replayed[e][i];
+                if(a.tick != b.tick || a.label != b.label){
+                    fprintf(stderr, "episode %zu sample %zu: tick or label differs\n", e, i);
+                    return 1;
+                }
+                maxPosition = std::max(maxPosition, (a.pose.pos - b.pose.pos).Length());
+                maxRotation = std::max(maxRotation, std::max(fabs(a.pose.rot.w - b.pose.rot.w),
+                    std::max(fabs(a.pose.rot.x - b.pose.rot.x), std::max(fabs(a.pose.rot.y - b.pose.rot.y),
+                    fabs(a.pose.rot.z - b.pose.rot.z)))));
+            }
+            samples += recorded[e].size();
+        }
+        FILE *f = fopen(poseLog.c_str(), "rb");
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fclose(f);
+        printf("pose log %s: %ld bytes, %.2f bytes per update, max error %.2g m, %.2g quaternion\n",
+            poseLog.c_str(), size, samples ? (double)size / samples : 0.0, maxPosition, maxRotation);
+        //half a step per coordinate at most
+        if(maxPosition > POSE_LOG_POSITION_STEP || maxRotation > POSE_LOG_ROTATION_STEP){
+            fprintf(stderr, "the poses read back differ by more than the quantization\n");
+            return 1;
+        }
+    }
+    if(bench) return 0;
+
+    if(out != ""){
+        std::ofstream f(out.c_str());
+        f << csv.str();
+        if(!f){
+            fprintf(stderr, "could not write %s\n", out.c_str());
+            return 1;
+        }
+    }
+    if(check != ""){
+        std::ifstream f(check.c_str());
+        if(!f){
+            fprintf(stderr, "could not read %s\n", check.c_str());
+            return 1;
+        }
+        std::istringstream produced(csv.str());
+        std::string expected, got;
+        for(unsigned int line = 1; ; line++){
+            bool haveExpected = (bool)std::getline(f, expected);
+            bool haveGot = (bool)std::getline(produced, got);
+            if(!haveExpected && !haveGot) break;
+            if(!haveExpected || !haveGot || !SameLine(expected, got, tolerance)){
+                fprintf(stderr, "%s:%u differs\n  expected: %s\n  got:      %s\n", check.c_str(),
+                    line, haveExpected ? expected.c_str() : "<eof>", haveGot ? got.c_str() : "<eof>");
+                return 1;
+            }
+        }
+        printf("matches %s\n", check.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "trace.hh"
+
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace camera_common
+{
+    Tracer &Tracer::Instance()
+    {
+        static Tracer instance;
+        return instance;
+    }
+
+    Tracer::Tracer() : enabled(false), file(NULL), firstEvent(true), pid(getpid())
+    {
+        const char *env = getenv("CAMERA_TRACE");
+        if(env != NULL && env[0] != '\0') Enable(env);
+    }
+
+    Tracer::~Tracer()
+    {
+        Flush();
+        std::lock_guard<std::mutex> lock(mutex);
+        if(file != NULL){
+            //the closing bracket is optional in the json array format, add it
+            //when the process shuts down cleanly
+            fputs("\n]\n", file);
+            fclose(file);
+            file = NULL;
+        }
+    }
+
+    bool Tracer::Enable(const std::string &_path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(file != NULL) return true;//first caller decides the file
+        file = fopen(_path.c_str(), "w");
+        if(file == NULL){
+            fprintf(stderr, "[TRACE]: could not open %s\n", _path.c_str());
+            return false;
+        }
+        fputs("[", file);
+        enabled.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    Tracer::ThreadBuffer &Tracer::Local()
+    {
+        static thread_local ThreadBuffer *local = NULL;
+        if(local == NULL){
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+            local = buffers.back().get();
+            local->tid = syscall(SYS_gettid);
+            local->events.reserve(4096);
+        }
+        return *local;
+    }
+
+    void Tracer::Record(const char *_name, const char *_category,
+        uint64_t _start, uint64_t _end)
+    {
+        if(!Enabled()) return;
+        ThreadBuffer &b = Local();
+        TraceEvent e = {_name, _category, _start, _end};
+        std::lock_guard<std::mutex> lock(b.mutex);
+        b.events.push_back(e);
+    }
+
+    void Tracer::Flush()
+    {
+        if(!Enabled()) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if(file == NULL) return;
+        std::vector<TraceEvent> events;
+        for(size_t i = 0; i < buffers.size(); i++){
+            {
+                std::lock_guard<std::mutex> bufferLock(buffers[i]->mutex);
+                events.swap(buffers[i]->events);
+            }
+            for(size_t j = 0; j < events.size(); j++){
+                const TraceEvent &e = events[j];
+                fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld}",
+                    firstEvent ? "" : ",", e.name, e.category, e.start / 1e3,
+                    (e.end - e.start) / 1e3, pid, buffers[i]->tid);
+                firstEvent = false;
+            }
+            events.clear();
+        }
+        fflush(file);
+    }
+}
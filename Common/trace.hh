@@ -0,0 +1,87 @@
+#ifndef _CAMERA_COMMON_TRACE_HH_
+#define _CAMERA_COMMON_TRACE_HH_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "capture_stats.hh"
+
+namespace camera_common
+{
+    // One finished span. Names and categories must be string literals (or
+    // otherwise outlive the tracer), only the pointer is stored.
+    struct TraceEvent
+    {
+        const char *name;
+        const char *category;
+        uint64_t start;//ns, NowNs clock
+        uint64_t end;
+    };
+
+    // Optional span recorder for the simulation and capture loop. Spans go to
+    // a buffer owned by the recording thread and are appended to a
+    // Chrome/Perfetto trace (json array format) on Flush. Tracing is off
+    // unless the CAMERA_TRACE environment variable names an output file or
+    // Enable is called, e.g. from the trace_file option of the world plugins.
+    class Tracer
+    {
+        public: static Tracer &Instance();
+        public: ~Tracer();
+
+        public: bool Enable(const std::string &_path);
+        public: bool Enabled() const
+        {
+            return enabled.load(std::memory_order_relaxed);
+        }
+        public: void Record(const char *_name, const char *_category,
+            uint64_t _start, uint64_t _end);
+        // Append everything recorded so far to the trace file.
+        public: void Flush();
+
+        private: struct ThreadBuffer
+        {
+            std::mutex mutex;//only contended while flushing
+            std::vector<TraceEvent> events;
+            long tid;
+        };
+
+        private: Tracer();
+        private: ThreadBuffer &Local();
+
+        private: std::atomic<bool> enabled;
+        private: std::mutex mutex;
+        private: std::vector<std::unique_ptr<ThreadBuffer> > buffers;
+        private: FILE *file;
+        private: bool firstEvent;
+        private: int pid;
+    };
+
+    // Records its own lifetime as a span when tracing is enabled.
+    class TraceScope
+    {
+        public: TraceScope(const char *_name, const char *_category)
+            : name(_name), category(_category), start(0)
+        {
+            if(Tracer::Instance().Enabled()) start = NowNs();
+        }
+        public: ~TraceScope()
+        {
+            if(start != 0) Tracer::Instance().Record(name, category, start, NowNs());
+        }
+        private: const char *name;
+        private: const char *category;
+        private: uint64_t start;
+    };
+}
+
+#define CAMERA_TRACE_CONCAT_(a, b) a##b
+#define CAMERA_TRACE_CONCAT(a, b) CAMERA_TRACE_CONCAT_(a, b)
+#define CAMERA_TRACE_SCOPE(name, category) \
+    camera_common::TraceScope CAMERA_TRACE_CONCAT(traceScope, __LINE__)(name, category)
+
+#endif
@@ -0,0 +1,157 @@
+#include "trajectory.hh"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace camera_common
+{
+    // noise sizes of camera_move_stoch_adapt
+    static const float directionNoise = 0.006; // small perturbations on the direction of the speed vector
+    static const float orientationNoise = 0.014; // small perturbations on the orientation of the Camera
+    static const float speedNoise = 0.001; // small perturbations on the absolute value of speed
+    static const float yaw = -0.314;//turning speed for states of 5000 updates
+
+    TrajectoryStateMachine::TrajectoryStateMachine(unsigned int _seed, bool _mirror)
+        : random(_seed), mirror(_mirror), stateDuration(5000),
+          speed(1.0f), numberofruns(1), currentrun(1)
+    {
+        frameNumber=0;
+        nextThreshold= Rand() % durationNoise + stateDuration-floor(durationNoise/2);
+        innerState=0;//the state in which the drone flies in 11 steps around the object
+        outerState=0;//the relative control states needed as ground truth
+        finished=false;
+        // Apply noise to direction, orientation and size of speed vector
+        DrawNoise();
+        //Current stepsize for object of size 1 1 1
+        currents = Vec3(0.5, 0.5, 0.1);
+    }
+
+    int TrajectoryStateMachine::Rand()
+    {
+        return random() & 0x7fffffff;
+    }
+
+    void TrajectoryStateMachine::DrawNoise()
+    {
+        // the noise is drawn for states of 5000 updates and scaled with the speeds,
+        // so a shorter state_duration gives the same angles and offsets per state
+        const double scale = 5000.0/stateDuration;
+        float vx = ((Rand()%10)-5)*directionNoise/10;
+        float vy = ((Rand()%10)-5)*directionNoise/10;
+        float vz = ((Rand()%10)-5)*directionNoise/10*scale+0.01;//+0.01 to compensate gravity
+        float ar = ((Rand()%10)-5)*orientationNoise/10;
+        float ap = ((Rand()%10)-5)*orientationNoise/10;
+        float ay = ((Rand()%10)-5)*orientationNoise/10;
+        speed = speed+((Rand()%10)-5)*speedNoise/10;
+        v = Vec3(vx*scale,vy*scale,vz);
+        a = Vec3(ar,ap,ay)*scale;
+    }
+
+    void TrajectoryStateMachine::SetStateDuration(int _duration)
+    {
+        if(_duration <= 0) return;
+        double scale = double(stateDuration)/_duration;
+        currents = currents*scale;
+        a = a*scale;
+        if(_duration != stateDuration) v = Vec3(v.x*scale, v.y*scale, (v.z-0.01)*scale+0.01);
+        stateDuration = _duration;
+        nextThreshold= Rand() % durationNoise + stateDuration-floor(durationNoise/2);
+    }
+
+    void TrajectoryStateMachine::SetObjectSize(double _x, double _y, double _z)
+    {
+        double sx = (_x+1.5)*1000/stateDuration; //stepsize = distance(sizeOfFocusObject) / numberOfFrames
+        double sy = (_y+1.5)*1000/stateDuration;
+        double sz = (_z*0.5)*1000/stateDuration;//stepsize = objectsize * 0.5 *1000/5000 ~ circle around half way
+        if(_z>1){
+            sz = 0.5*1000/stateDuration;//=(1*0.5/5)
+            numberofruns = ceil(_z*2);//divide by 0.5
+        }else{
+            numberofruns = 1;
+        }
+        currents = Vec3(sx,sy,sz);
+    }
+
+    void TrajectoryStateMachine::Reset()
+    {
+        finished = false;
+        innerState = 0;
+        outerState = 0;
+        frameNumber = 0;
+        nextThreshold= Rand() % durationNoise + stateDuration-floor(durationNoise/2);
+        currentrun = 1;
+    }
+
+    bool TrajectoryStateMachine::Step(TrajectoryCommand &_cmd)
+    {
+        if(finished) return false;
+        _cmd.stateChanged = false;
+        frameNumber = frameNumber+1;
+        if(frameNumber > nextThreshold){
+            innerState = innerState+1;
+            if(innerState == 11){
+                innerState = 0;
+                finished = true;
+            }else{
+                int dur = stateDuration;
+                if(innerState == 10){
+                    if(numberofruns != currentrun){
+                        currentrun=currentrun+1;//one run down
+                        innerState = 0;//go up
+                    }else{
+                        dur = numberofruns * dur;//give it more time to go down according to the numbersofruns it went up
+                    }
+                }
+                if(innerState==1 || innerState==9) dur = stateDuration/2; //doing half of x direction so only half of length is needed
+                nextThreshold = Rand() % durationNoise + dur -floor(durationNoise/2);
+                frameNumber = 0;
+                _cmd.stateChanged = true;
+            }
+        }
+        _cmd.finished = finished;
+
+        if(frameNumber % std::max(1, updateNoise*stateDuration/5000) == 0) DrawNoise();
+
+        double side = mirror ? -1 : 1;
+        Vec3 vt;//temp translational speed vector
+        Vec3 at;//temp angular speed vector
+        switch(innerState){
+            case 0://go up: outerState 0
+                vt=v+Vec3(0,0,currents[2]*speed);
+                at=a;
+                outerState = 0;
+                break;
+            case 2:
+            case 4:
+            case 6:
+            case 8://turn:
+                at=a+Vec3(0,0,side*yaw*(5000.0/stateDuration));//a quarter turn per state
+                vt=v;
+                outerState = 2;
+                break;
+            case 1:
+            case 5:
+            case 9://flying in x direction according to stepsize in x directoin
+                vt=v+Vec3(0, side*currents[0]*speed, 0);//still put in y direction because its relative
+                at=a;
+                outerState = 1;
+                break;
+            case 3://go forward absolute
+            case 7://go backward absolute
+                vt=v+Vec3(0, side*currents[1]*speed, 0);//fly with speed of y direction
+                at=a;
+                outerState = 1;
+                break;
+            case 10://land
+                vt=v+Vec3(0,0,-currents[2]);
+                at=a;
+                outerState=3;
+                break;
+        }
+        _cmd.linear = vt;
+        _cmd.angular = at;
+        _cmd.label = outerState;
+        return true;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef _CAMERA_COMMON_TRAJECTORY_HH_
+#define _CAMERA_COMMON_TRAJECTORY_HH_
+
+#include <random>
+
+#include "pose_math.hh"
+
+namespace camera_common
+{
+    // Velocity command for one update of the camera.
+    struct TrajectoryCommand
+    {
+        Vec3 linear;//body frame, rotate with the current pose before applying
+        Vec3 angular;//world frame
+        int label;//outerState: 0 up, 1 forward/sideways, 2 turn, 3 land
+        bool stateChanged;//innerState changed during this update
+        bool finished;//trajectory finished during this update
+    };
+
+    // The stochastic trajectory of camera_move_stoch_adapt: eleven inner
+    // states (up, half side, turn, forward, turn, side, turn, backward, turn,
+    // half side, land) with noisy durations, velocities and speed, adapted
+    // to the size of the focus object. Tall objects repeat states 0..9.
+    // Gazebo free, so it can be driven by the plugins as well as by
+    // tools/trajectory_sim.
+    class TrajectoryStateMachine
+    {
+        // _mirror flips the turning direction and the sideways motion (camera_move_test)
+        public: TrajectoryStateMachine(unsigned int _seed, bool _mirror);
+
+        // Mean number of updates per state, scales the speeds and turn rates
+        // accordingly so the camera flies the same path in fewer updates.
+        public: void SetStateDuration(int _duration);
+        public: int StateDuration() const { return stateDuration; }
+        public: void SetObjectSize(double _x, double _y, double _z);
+        public: int NumberOfRuns() const { return numberofruns; }
+
+        // Start a new trajectory (finished_state 0).
+        public: void Reset();
+        // One update. Returns false when the trajectory is finished.
+        public: bool Step(TrajectoryCommand &_cmd);
+
+        public: int InnerState() const { return innerState; }
+        public: int NextThreshold() const { return nextThreshold; }
+        public: bool Finished() const { return finished; }
+
+        private: int Rand();
+        private: void DrawNoise();
+
+        private: static const int durationNoise = 5; //variation among number of updates before in next state
+        private: static const int updateNoise = 100; // number of updates before noise is updated to make perturbations clearer (states of 5000)
+        private: std::minstd_rand random;
+        private: bool mirror;
+        private: int stateDuration;
+        private: Vec3 v;//translational velocity noise: z direction for gravity compensation
+        private: Vec3 a;//angular velocity noise
+        private: float speed;//size of velocity vector
+        private: Vec3 currents;//stepsize adapted to the current size of the focus object
+        private: int numberofruns;//the number of runs it goes through state 0->9 for a tall object
+        private: int currentrun;
+        private: int frameNumber;
+        private: int nextThreshold;
+        private: int innerState;
+        private: int outerState;
+        private: bool finished;
+    };
+}
+#endif
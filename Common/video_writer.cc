@@ -0,0 +1,252 @@
+#include "video_writer.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "capture_stats.hh"
+#include "color_convert.hh"
+
+#ifdef HAVE_AVCODEC
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/opt.h>
+}
+#endif
+
+namespace camera_common
+{
+    VideoOptions::VideoOptions()
+        : encoder("libx264"), preset("veryfast"), crf(23), keyint(30), fps(25), threads(0) {}
+
+    std::string VideoFileName(unsigned int _episode, const char *_extension)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "video-%05u.%s", _episode, _extension);
+        return name;
+    }
+
+    VideoFrameWriter::VideoFrameWriter(const VideoOptions &_options)
+        : options(_options), episode(0), context(NULL), picture(NULL), packet(NULL),
+          videoFd(-1), indexFd(-1), width(0), height(0), pts(0), offset(0)
+    {
+        if(options.keyint == 0) options.keyint = 1;
+        if(options.fps == 0) options.fps = 25;
+    }
+
+    VideoFrameWriter::~VideoFrameWriter()
+    {
+        Close();
+    }
+
+    bool VideoFrameWriter::Available()
+    {
+#ifdef HAVE_AVCODEC
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool VideoFrameWriter::Open(const std::string &_directory)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CloseEpisode();
+        directory = _directory;
+        // continue after the episodes already in the directory
+        episode = 0;
+        struct stat st;
+        while(stat((directory + "/" + VideoFileName(episode, "idx")).c_str(), &st) == 0) episode++;
+        return Available();
+    }
+
+    bool VideoFrameWriter::Close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(CloseEpisode()) return true;
+        fprintf(stderr, "[CAPTURE]: could not complete video %u\n", episode);
+        return false;
+    }
+
+    void VideoFrameWriter::Scan(const std::string &_directory, CaptureManifest &_manifest)
+    {
+        struct stat st;
+        for(unsigned int e = 0; stat((_directory + "/" + VideoFileName(e, "idx")).c_str(), &st) == 0; e++){
+            FILE *f = fopen((_directory + "/" + VideoFileName(e, "idx")).c_str(), "rb");
+            if(f == NULL) continue;
+            VideoIndexEntry entry;
+            while(fread(&entry, sizeof(entry), 1, f) == 1) _manifest.AddFrame(entry.id, entry.label);
+            fclose(f);
+        }
+    }
+
+
+    bool VideoFrameWriter::OpenEpisode(const CaptureFrame &_frame)
+    {
+#ifdef HAVE_AVCODEC
+        width = _frame.width & ~1u;
+        height = _frame.height & ~1u;
+        if(width == 0 || height == 0) return false;
+        const AVCodec *codec = avcodec_find_encoder_by_name(options.encoder.c_str());
+        if(codec == NULL){
+            fprintf(stderr, "[CAPTURE]: no encoder %s, using the default h264 encoder\n", options.encoder.c_str());
+            codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+        }
+        if(codec == NULL){
+            fprintf(stderr, "[CAPTURE]: libavcodec has no h264 encoder\n");
+            return false;
+        }
+        context = avcodec_alloc_context3(codec);
+        if(context == NULL) return false;
+        context->width = width;
+        context->height = height;
+        context->time_base.num = 1;
+        context->time_base.den = options.fps;
+        context->framerate.num = options.fps;
+        context->framerate.den = 1;
+        context->gop_size = options.keyint;
+        context->max_b_frames = 0;//one packet per frame, in frame order
+        context->pix_fmt = AV_PIX_FMT_YUV420P;
+        context->thread_count = options.threads;
+        //x264 private options, other encoders ignore them
+        av_opt_set(context->priv_data, "preset", options.preset.c_str(), 0);
+        av_opt_set_double(context->priv_data, "crf", options.crf, 0);
+        if(avcodec_open2(context, codec, NULL) < 0){
+            fprintf(stderr, "[CAPTURE]: cannot open encoder %s\n", codec->name);
+            CloseEpisode();
+            return false;
+        }
+        picture = av_frame_alloc();
+        packet = av_packet_alloc();
+        if(picture == NULL || packet == NULL){
+            CloseEpisode();
+            return false;
+        }
+        picture->format = AV_PIX_FMT_YUV420P;
+        picture->width = width;
+        picture->height = height;
+        if(av_frame_get_buffer(picture, 32) < 0){
+            CloseEpisode();
+            return false;
+        }
+        std::string video = directory + "/" + VideoFileName(episode, "h264");
+        std::string index = directory + "/" + VideoFileName(episode, "idx");
+        videoFd = open(video.c_str(), CreateFlags(), 0644);
+        indexFd = open(index.c_str(), CreateFlags(), 0644);
+        if(videoFd < 0 || indexFd < 0){
+            fprintf(stderr, "[CAPTURE]: cannot open %s: %s\n", video.c_str(), strerror(errno));
+            CloseEpisode();
+            return false;
+        }
+        pts = 0;
+        offset = 0;
+        waiting.clear();
+        return true;
+#else
+        (void)_frame;
+        return false;
+#endif
+    }
+
+    bool VideoFrameWriter::Drain()
+    {
+#ifdef HAVE_AVCODEC
+        while(true){
+            int result = avcodec_receive_packet(context, packet);
+            if(result == AVERROR(EAGAIN) || result == AVERROR_EOF) return true;
+            if(result < 0) return false;
+            VideoIndexEntry entry;
+            memset(&entry, 0, sizeof(entry));
+            std::map<int64_t, std::pair<uint64_t, int> >::iterator frame = waiting.find(packet->pts);
+            bool known = frame != waiting.end();
+            if(known){
+                entry.id = frame->second.first;
+                entry.label = frame->second.second;
+                waiting.erase(frame);
+            }else entry.label = -1;
+            entry.offset = offset;
+            entry.size = packet->size;
+            entry.pts = packet->pts;
+            entry.flags = (packet->flags & AV_PKT_FLAG_KEY) ? VIDEO_KEYFRAME : 0;
+            bool ok = WriteAll(videoFd, packet->data, packet->size) &&
+                WriteAll(indexFd, &entry, sizeof(entry));
+            offset += packet->size;
+            //the completion counts the bytes of the frames
+            if(known && completion) completion(entry.id, entry.label, entry.size, ok);
+            else if(ok) CaptureStats::Instance().Add(COUNTER_BYTES_WRITTEN, packet->size);
+            av_packet_unref(packet);
+            if(!ok) return false;
+        }
+#else
+        return false;
+#endif
+    }
+
+    bool VideoFrameWriter::Write(const CaptureFrame &_frame)
+    {
+#ifdef HAVE_AVCODEC
+        std::lock_guard<std::mutex> lock(mutex);
+        if(context != NULL && ((_frame.width & ~1u) != width || (_frame.height & ~1u) != height))
+            CloseEpisode();//a camera with another size, start a new stream
+        if(context == NULL && !OpenEpisode(_frame)) return false;
+        if(av_frame_make_writable(picture) < 0) return false;
+        //odd last rows and columns are cropped
+        RgbToYuv420(&_frame.pixels[0], _frame.channels, (size_t)_frame.width * _frame.channels, width, height,
+            picture->data[0], picture->linesize[0], picture->data[1], picture->data[2], picture->linesize[1],
+            DetectSimd());
+        picture->pts = pts;
+        if(avcodec_send_frame(context, picture) < 0) return false;
+        //from here on the frame is reported through the completion
+        waiting[pts] = std::make_pair(_frame.id, _frame.label);
+        pts++;
+        if(!Drain()){
+            fprintf(stderr, "[CAPTURE]: could not write video %u, starting a new one\n", episode);
+            FailWaiting();
+            CloseEpisode();
+        }
+        return true;
+#else
+        (void)_frame;
+        return false;
+#endif
+    }
+
+    void VideoFrameWriter::FailWaiting()
+    {
+        if(completion){
+            std::map<int64_t, std::pair<uint64_t, int> >::const_iterator i;
+            for(i = waiting.begin(); i != waiting.end(); ++i) completion(i->second.first, i->second.second, 0, false);
+        }
+        waiting.clear();
+    }
+
+    bool VideoFrameWriter::CloseEpisode()
+    {
+        bool ok = true;
+#ifdef HAVE_AVCODEC
+        if(context != NULL && videoFd >= 0 && !waiting.empty()){
+            //flush the frames still in the encoder
+            ok = avcodec_send_frame(context, NULL) >= 0 && Drain();
+        }
+        FailWaiting();
+        if(context != NULL) avcodec_free_context(&context);
+        if(picture != NULL) av_frame_free(&picture);
+        if(packet != NULL) av_packet_free(&packet);
+#endif
+        if(videoFd >= 0){
+            close(videoFd);
+            episode++;
+        }
+        if(indexFd >= 0) close(indexFd);
+        videoFd = -1;
+        indexFd = -1;
+        context = NULL;
+        picture = NULL;
+        packet = NULL;
+        return ok;
+    }
+}
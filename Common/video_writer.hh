@@ -0,0 +1,93 @@
+#ifndef _CAMERA_COMMON_VIDEO_WRITER_HH_
+#define _CAMERA_COMMON_VIDEO_WRITER_HH_
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "frame_writer.hh"
+
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+
+namespace camera_common
+{
+    struct VideoOptions
+    {
+        std::string encoder;//libavcodec encoder name, h264 if it is not there
+        std::string preset;//x264 speed preset
+        double crf;//x264 constant rate factor, lower is better quality
+        unsigned int keyint;//frames between keyframes, the random access granularity
+        unsigned int fps;//playback rate in the stream
+        unsigned int threads;//encoder threads, 0 lets the encoder choose
+        VideoOptions();
+    };
+
+    // Video layout: every episode (every Open) is a raw H.264 (Annex B)
+    // stream video-NNNNN.h264 with SPS/PPS repeated before every keyframe,
+    // and video-NNNNN.idx with one VideoIndexEntry per frame in stream
+    // order. Without b-frames every packet is one frame, so a reader seeks
+    // to the last keyframe at or before the frame it wants and decodes from
+    // there. The stream also plays as is: ffplay -f h264 video-00000.h264
+    struct VideoIndexEntry
+    {
+        uint64_t id;//frame id
+        uint64_t offset;//of the packet in the .h264 file
+        uint32_t size;//of the packet
+        int32_t label;
+        int64_t pts;//frame number in the episode, in 1/fps
+        uint32_t flags;//VIDEO_KEYFRAME
+        uint32_t reserved;
+    };
+
+    static const uint32_t VIDEO_KEYFRAME = 1;
+
+    std::string VideoFileName(unsigned int _episode, const char *_extension);
+
+    // Encodes the pixels of the frames (CaptureFrame::encoded is not used)
+    // in the order Write is called, so the pipeline runs it with one
+    // worker. Only built with libavcodec (HAVE_AVCODEC), see Available.
+    // The encoder keeps frames in its lookahead, so a frame is reported
+    // through the completion, with the size of its packet, once its packet
+    // and index entry are written; the last ones when the episode is
+    // closed. When a write fails the episode ends and the frames still in
+    // the encoder are reported as failed.
+    class VideoFrameWriter : public FrameWriter
+    {
+        public: explicit VideoFrameWriter(const VideoOptions &_options);
+        public: virtual ~VideoFrameWriter();
+        public: static bool Available();
+        public: virtual bool Open(const std::string &_directory);
+        public: virtual bool Write(const CaptureFrame &_frame);
+        public: virtual bool Close();
+        public: virtual bool Asynchronous() const { return true; }
+        // Reads the index of every episode in _directory.
+        public: virtual void Scan(const std::string &_directory, CaptureManifest &_manifest);
+
+        private: bool OpenEpisode(const CaptureFrame &_frame);
+        private: bool CloseEpisode();
+        // Write the packets the encoder has ready and report their frames.
+        private: bool Drain();
+        // Report the frames still in the encoder as failed.
+        private: void FailWaiting();
+
+        private: VideoOptions options;
+        private: std::string directory;
+        private: std::mutex mutex;
+        private: unsigned int episode;
+        private: AVCodecContext *context;
+        private: AVFrame *picture;
+        private: AVPacket *packet;
+        private: int videoFd;
+        private: int indexFd;
+        private: unsigned int width;//of the episode, even
+        private: unsigned int height;
+        private: int64_t pts;//of the next frame
+        private: uint64_t offset;//end of the .h264 file
+        private: std::map<int64_t, std::pair<uint64_t, int> > waiting;//pts -> id, label of frames in the encoder
+    };
+}
+#endif
@@ -18,11 +18,20 @@
 #include <gazebo/transport/transport.hh>
 #include <gazebo/msgs/msgs.hh>
 #include <gazebo/gazebo.hh>
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <boost/filesystem.hpp>
 
 //#include "gazebo/physics/physics.hh"
 #include "plugins/CameraPlugin.hh"
+#include "capture_pipeline.hh"
+#include "capture_stats.hh"
+#include "frame_similarity.hh"
+#include "label_balancer.hh"
+#include "state_channel.hh"
+#include "trace.hh"
 
 using namespace std;
 namespace gazebo
@@ -36,9 +45,20 @@ namespace gazebo
         transport::SubscriberPtr finishedSub;
         transport::SubscriberPtr locationSub;
         std::string location;
-        int saveCount;
+        std::atomic<bool> locationChanged;//set by the transport thread, applied in OnNewFrame
+        std::mutex locationMutex;
+        int saveCount;//frames saved this episode
+        uint64_t frameId = 0;//id and file name of the next saved frame
+        bool append = false;//continue numbering after the frames already in the location
         bool wait;
         bool finished;//If finished =1 dont save
+        camera_common::StatsDumper statsDumper;//periodically writes the capture statistics
+        std::unique_ptr<camera_common::CapturePipeline> pipeline;//encodes and writes frames off the render thread
+        camera_common::StateSlot *stateSlot = NULL;//label and finished of the controller, NULL with state_channel topics
+        uint64_t locationVersion = 0;//last location applied from the StateChannel
+        std::string modelName;//of the camera, its own location when the world runs several cameras
+        camera_common::FrameFilter filter = camera_common::FrameFilter(0, 0);//skips blank and duplicate frames
+        camera_common::LabelBalancer balancer;//subsamples frames per label
         
 
         public: void Load(sensors::SensorPtr _parent, sdf::ElementPtr _sdf)
@@ -48,6 +68,7 @@ namespace gazebo
             saveCount = 0;
             finished = false;
             wait = true;
+            locationChanged = false;
             location = _sdf->Get<std::string>("location");
             maxNumber = _sdf->Get<int>("maxnumberframes");
             if(location == ""){
@@ -60,9 +81,107 @@ namespace gazebo
             if(maxNumber == 0) maxNumber = 1000;
             std::cout << "Location: "<<location << ". Max number: "<<maxNumber<<std::endl;
             
+            // Encoding and writing options, see Common/capture_pipeline.hh
+            camera_common::CaptureConfig config;
+            std::string codec = _sdf->Get<std::string>("codec");
+            if(codec != "" && !camera_common::ParseCodec(codec, config.codec))
+                gzerr << "[GT]: unknown codec "<<codec<<", using jpg\n";
+            std::string output = _sdf->Get<std::string>("output");
+            if(output != "" && !camera_common::ParseOutputMode(output, config.output))
+                gzerr << "[GT]: unknown output "<<output<<", using files\n";
+            if(_sdf->HasElement("quality")) config.quality = _sdf->Get<int>("quality");
+            // pixel_format: rgb (as rendered), gray, yuv420 or chw_f32, converted on the writer threads
+            std::string format = _sdf->Get<std::string>("pixel_format");
+            if(format != "" && !camera_common::ParsePixelFormat(format, config.format))
+                gzerr << "[GT]: unknown pixel_format "<<format<<", using rgb\n";
+            // codec delta (lossless): a keyframe every delta_keyint frames, zlib level delta_level
+            if(_sdf->HasElement("delta_keyint")) config.delta.keyint = _sdf->Get<int>("delta_keyint");
+            if(_sdf->HasElement("delta_level")) config.delta.level = _sdf->Get<int>("delta_level");
+            if(_sdf->HasElement("writer_threads")) config.threads = _sdf->Get<int>("writer_threads");
+            if(_sdf->HasElement("queue_size")) config.queueSize = _sdf->Get<int>("queue_size");
+            if(_sdf->HasElement("drop_when_full")) config.dropWhenFull = _sdf->Get<bool>("drop_when_full");
+            std::string layout = _sdf->Get<std::string>("layout");
+            if(layout != "" && !camera_common::ParseLayout(layout, config.layout))
+                gzerr << "[GT]: unknown layout "<<layout<<", using flat\n";
+            if(_sdf->HasElement("frames_per_dir")) config.framesPerDir = _sdf->Get<int>("frames_per_dir");
+            if(_sdf->HasElement("hash_dirs")) config.hashDirs = _sdf->Get<int>("hash_dirs");
+            if(_sdf->HasElement("append")) config.append = append = _sdf->Get<bool>("append");
+            if(_sdf->HasElement("shard_size_mb")) config.shard.shardBytes = _sdf->Get<int>("shard_size_mb")*(1ULL<<20);
+            // Shards are written in shard_buffer_mb pieces; durability none, shard or interval
+            // (fdatasync every sync_interval s); direct_io (O_DIRECT) or drop_cache keep the
+            // frames out of the page cache
+            if(_sdf->HasElement("shard_buffer_mb")) config.shard.bufferBytes = _sdf->Get<int>("shard_buffer_mb")*(1ULL<<20);
+            std::string durability = _sdf->Get<std::string>("durability");
+            if(durability != "" && !camera_common::ParseDurability(durability, config.shard.durability))
+                gzerr << "[GT]: unknown durability "<<durability<<", using none\n";
+            if(_sdf->HasElement("sync_interval")) config.shard.syncInterval = _sdf->Get<double>("sync_interval");
+            if(_sdf->HasElement("direct_io")) config.shard.direct = _sdf->Get<bool>("direct_io");
+            if(_sdf->HasElement("drop_cache")) config.shard.dropCache = _sdf->Get<bool>("drop_cache");
+            // io_backend sync (default), uring (io_depth writes in flight from one thread) or
+            // threads (io_depth pwrite threads, also used when io_uring is not available)
+            std::string ioBackend = _sdf->Get<std::string>("io_backend");
+            if(ioBackend != "" && !camera_common::ParseIoBackend(ioBackend, config.io))
+                gzerr << "[GT]: unknown io_backend "<<ioBackend<<", using sync\n";
+            if(_sdf->HasElement("io_depth")) config.ioDepth = _sdf->Get<int>("io_depth");
+            // stream: also serve the encoded frames on unix:<path> or tcp:<port> (localhost), see
+            // Common/frame_server.hh; stream_queue frames per subscriber, stream_batch frames per send
+            if(_sdf->HasElement("stream")) config.stream = _sdf->Get<std::string>("stream");
+            if(_sdf->HasElement("stream_queue")) config.streamQueue = _sdf->Get<int>("stream_queue");
+            if(_sdf->HasElement("stream_batch")) config.streamBatch = _sdf->Get<int>("stream_batch");
+            // output video: one h264 stream per episode, video_keyint frames between keyframes
+            if(_sdf->HasElement("video_encoder")) config.video.encoder = _sdf->Get<std::string>("video_encoder");
+            if(_sdf->HasElement("video_preset")) config.video.preset = _sdf->Get<std::string>("video_preset");
+            if(_sdf->HasElement("video_crf")) config.video.crf = _sdf->Get<double>("video_crf");
+            if(_sdf->HasElement("video_keyint")) config.video.keyint = _sdf->Get<int>("video_keyint");
+            if(_sdf->HasElement("video_fps")) config.video.fps = _sdf->Get<int>("video_fps");
+            if(_sdf->HasElement("video_threads")) config.video.threads = _sdf->Get<int>("video_threads");
+            pipeline.reset(new camera_common::CapturePipeline(config));
+            pipeline->SetOutputDirectory(location);
+            if(append){
+                frameId = pipeline->NextFrameId();
+                gzmsg << "[GT]: appending to "<<location<<" from frame "<<frameId<<"\n";
+            }
+            gzmsg << "[GT]: "<<camera_common::CodecName(config.codec)<<" "
+                <<camera_common::OutputModeName(pipeline->Config().output)<<" with "<<config.threads<<" writer threads, "
+                <<camera_common::IoBackendName(config.io)<<" io\n";
+            // Skip blank frames (brightest cell of the luminance thumbnail at most blank_threshold,
+            // default 8, 0 skips a fixed 7 frames at the start instead) and, if dedup_threshold > 0,
+            // frames whose mean luminance differs less than that from the last saved frame
+            unsigned int blankThreshold = _sdf->HasElement("blank_threshold") ? _sdf->Get<unsigned int>("blank_threshold") : 8;
+            double dedupThreshold = _sdf->HasElement("dedup_threshold") ? _sdf->Get<double>("dedup_threshold") : 0;
+            filter = camera_common::FrameFilter(blankThreshold, dedupThreshold);
+            if(blankThreshold > 0) wait = false;
+            // Balance the labels while capturing: label_rates keeps a fixed fraction per label,
+            // label_ratios aims at a share per label (comma separated, label 0 first)
+            std::string labelRates = _sdf->Get<std::string>("label_rates");
+            std::string labelRatios = _sdf->Get<std::string>("label_ratios");
+            if(labelRatios != "" && !balancer.SetRatios(labelRatios))
+                gzerr << "[GT]: could not parse label_ratios "<<labelRatios<<"\n";
+            else if(labelRatios == "" && labelRates != "" && !balancer.SetRates(labelRates))
+                gzerr << "[GT]: could not parse label_rates "<<labelRates<<"\n";
+            // Optional machine readable statistics of the capture pipeline
+            std::string statsFile = _sdf->Get<std::string>("stats_file");
+            if(statsFile != ""){
+                double statsInterval = _sdf->Get<double>("stats_interval");
+                statsDumper.Start(statsFile, statsInterval);
+                gzmsg << "[GT]: writing capture statistics to "<<statsFile<<"\n";
+            }
+            
             node = transport::NodePtr(new transport::Node());
             // Don't forget to load the camera plugin
             CameraPlugin::Load(_parent, _sdf);
+            // inprocess (default): read the state of the controller in this model directly,
+            // the topics are only used until the controller or world writes the channel
+            // (camera_move, camera_move_stoch and camera_world_turningobjects never do)
+            // topics: only the gazebo topics, as before
+            std::string channel = _sdf->Get<std::string>("state_channel");
+            if(channel != "topics"){
+                if(channel != "" && channel != "inprocess")
+                    gzerr << "[GT]: unknown state_channel "<<channel<<", using inprocess\n";
+                modelName = camera_common::ModelName(_parent->GetParentName());
+                stateSlot = camera_common::StateChannel::Instance().Slot(modelName);
+                gzmsg << "[GT]: reading the state of "<<modelName<<" in process\n";
+            }
             // Initialize the node with the sensors name
             node->Init(_parent->GetName());
             std::cout << "Subscribing to: " << "trajectory" << std::endl;
@@ -79,36 +198,83 @@ namespace gazebo
         // Function is called everytime a message is received.
         private: void callback_location(ConstGzStringPtr &_msg)
         {
+            //the world writes the state channel, which may hold a location for this camera only
+            if(stateSlot != NULL && camera_common::StateChannel::Instance().LocationVersion() != 0) return;
             // Dump the message contents to stdout.
             gzmsg << "[GT:] received location: "<<_msg->data() << std::endl;
-            if(_msg->data()!=""){
-                location = _msg->data() + "/RGB";
-                boost::filesystem::path dir(location.c_str());
-                if(boost::filesystem::create_directory(dir)) {
-                        gzmsg << "[GT]:Success in creating: "<<location << "\n";
-                }
+            setLocation(_msg->data());
+        }
+        // Create <_base>/RGB, OnNewFrame switches the pipeline to it
+        private: void setLocation(const std::string &_base)
+        {
+            if(_base=="") return;
+            std::lock_guard<std::mutex> lock(locationMutex);
+            location = _base + "/RGB";
+            boost::filesystem::path dir(location.c_str());
+            if(boost::filesystem::create_directory(dir)) {
+                    gzmsg << "[GT]:Success in creating: "<<location << "\n";
             }
+            locationChanged = true;
         }
         private: void callback_finished(ConstIntPtr &_msg)
         {
+            if(slotWritten()) return;
             // Dump the message contents to stdout.
-            if(_msg->data()==1){ finished=true; saveCount = 0;}
+            if(_msg->data()==1){ finished=true; saveCount = 0; if(!append) frameId = 0;}
+            if(_msg->data()==1 && balancer.Enabled()) gzmsg << "[GT]: kept per label "<<balancer.Describe()<<"\n";
             if(_msg->data()==0) finished=false; 
             cout <<"[GT] received finished "<< finished << std::endl;
         }
         
         private: void callback_state(ConstIntPtr &_msg)
         {
+            if(slotWritten()) return;
             // Dump the message contents to stdout.
             this->state =  _msg->data();
             //std::cout << state << std::endl;
         }
 
+        // The controller writes the StateChannel, its topics are redundant
+        private: bool slotWritten() const
+        {
+            return stateSlot != NULL && stateSlot->Read().tick != 0;
+        }
+
+        // Take label, finished and saving location from the StateChannel
+        private: void readState()
+        {
+            camera_common::CameraState s = stateSlot->Read();
+            if(s.tick != 0){
+                state = s.label;
+                if(s.finished && !finished){ saveCount = 0; if(!append) frameId = 0;}
+                finished = s.finished;
+            }
+            camera_common::StateChannel &channel = camera_common::StateChannel::Instance();
+            if(channel.LocationVersion() != locationVersion){
+                std::string base;
+                locationVersion = channel.Location(modelName, base);
+                setLocation(base);
+            }
+        }
+
         // Update the controller
         public: void OnNewFrame(const unsigned char *_image,
             unsigned int _width, unsigned int _height, unsigned int _depth,
             const std::string &_format)
         {
+            camera_common::ScopedStageTimer renderTimer(camera_common::STAGE_RENDER);
+            CAMERA_TRACE_SCOPE("OnNewFrame", "camera");
+            camera_common::CaptureStats &stats = camera_common::CaptureStats::Instance();
+            stats.Add(camera_common::COUNTER_FRAMES_SEEN);
+            if(stateSlot != NULL) readState();
+            if(locationChanged){
+                //waits for the frames of the previous location to be written
+                std::lock_guard<std::mutex> lock(locationMutex);
+                pipeline->SetOutputDirectory(location);
+                locationChanged = false;
+                filter.Reset();
+                if(append) frameId = pipeline->NextFrameId();
+            }
             if(wait){
                 saveCount++;
                 if(saveCount>7){ //the first 7 frames appear to be black even though the simulation waits untill
@@ -119,16 +285,37 @@ namespace gazebo
             }
             if(!finished && !wait){
                 char tmp[1024];
-                snprintf(tmp, sizeof(tmp), "%s/%05d-gt%01d.jpg",this->location.c_str(),
-                    this->saveCount, this->state);
+                snprintf(tmp, sizeof(tmp), "%05llu-gt%01d.%s",
+                    (unsigned long long)this->frameId, this->state, pipeline->Extension(_depth));
                 
-                if (this->saveCount < maxNumber)
+                //only frames worth saving are offered, so blank and duplicate frames
+                //do not count for the label balance
+                camera_common::FrameFilter::Verdict verdict = camera_common::FrameFilter::KEEP;
+                bool balanced = true;
+                if(this->saveCount < maxNumber) verdict = filter.Check(_image, _width, _height, _depth);
+                if(this->saveCount < maxNumber && verdict == camera_common::FrameFilter::KEEP)
+                    balanced = balancer.Offer(this->state);
+                if(verdict == camera_common::FrameFilter::BLANK){
+                    stats.Add(camera_common::COUNTER_FRAMES_BLANK);
+                }else if(verdict == camera_common::FrameFilter::DUPLICATE){
+                    stats.Add(camera_common::COUNTER_FRAMES_DUPLICATE);
+                }else if(!balanced){
+                    stats.Add(camera_common::COUNTER_FRAMES_BALANCED);
+                }else if (this->saveCount < maxNumber)
                 {
-                    this->parentSensor->GetCamera()->SaveFrame(
-                        _image, _width, _height, _depth, _format, tmp);
-                    gzmsg << "Saving frame [" << this->saveCount
-                        << "] as [" << tmp << "]\n";
-                    this->saveCount++;
+                    //only copies the image, encoding and writing happen on the pipeline threads;
+                    //a frame dropped by a full queue keeps its id for the next one, so the ids stay
+                    //without gaps
+                    if(pipeline->Submit(this->frameId, this->state, tmp,
+                        _image, _width, _height, _depth)){
+                        gzmsg << "Saving frame [" << this->frameId
+                            << "] as [" << tmp << "]\n";
+                        filter.Keep();
+                        this->saveCount++;
+                        this->frameId++;
+                    }
+                }else{
+                    stats.Add(camera_common::COUNTER_FRAMES_DROPPED);
                 }
             }
             
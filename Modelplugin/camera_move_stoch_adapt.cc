@@ -21,11 +21,36 @@
 
 #include <gazebo/msgs/msgs.hh>
 #include <stdlib.h>
+#include <atomic>
+#include <mutex>
+
+#include "capture_stats.hh"
+#include "orbit_trajectory.hh"
+#include "pose_log.hh"
+#include "spline_trajectory.hh"
+#include "state_channel.hh"
+#include "telemetry.hh"
+#include "trace.hh"
+#include "trajectory.hh"
+#include "trajectory_telemetry.pb.h"
 
 using namespace std;
 
 namespace gazebo
 {
+  // update_rate of the first sensor of the model that has one, 0 without
+  static double SensorUpdateRate(sdf::ElementPtr _model)
+  {
+    if(!_model || !_model->HasElement("link")) return 0;
+    for(sdf::ElementPtr link = _model->GetElement("link"); link; link = link->GetNextElement("link")){
+        if(!link->HasElement("sensor")) continue;
+        for(sdf::ElementPtr sensor = link->GetElement("sensor"); sensor; sensor = sensor->GetNextElement("sensor"))
+            if(sensor->HasElement("update_rate") && sensor->Get<double>("update_rate") > 0)
+                return sensor->Get<double>("update_rate");
+    }
+    return 0;
+  }
+
   class CameraMove : public ModelPlugin
   {   
     // Pointer to the model
@@ -33,61 +58,47 @@ namespace gazebo
 
     // Pointer to the update event connection
     private: event::ConnectionPtr updateConnection;
+    private: event::ConnectionPtr updateEndConnection;//record_poses only
     
-    // Counters for changing the direction
-    private: const int durationNoise = 5; //variation among number of updates before in next state
-    private: const float directionNoise = 0.006; // small perturbations on the direction of the speed vector
-    private: const float orientationNoise = 0.014; // small perturbations on the orientation of the Camera
-    private: const float speedNoise = 0.001; // small perturbations on the absolute value of speed
-    private: const int updateNoise = 100; // number of updates before noise is updated to make perturbations clearer
-    private: math::Vector3 v;//translational velocity: z direction for gravity compensation
-    private: math::Vector3 a;//angular velocity
-    private: math::Vector3 s;//standard stepsize in x,y,z direction
-    private: float speed = 1.0f;//size of velocity vector
-    private: math::Vector3 currents;//size the current stepsize adapted to the current size of the focus object
-    private: int numberofruns = 1;//the number of runs it goes through state 0->9 for a tall object
-    private: int currentrun = 1;//the number of runs it goes through state 0->9 for a tall object
-    
-    private: int frameNumber;
-    private: int nextThreshold;
-    private: int innerState;
-    private: int outerState;
-    private: bool finished;
+    // Trajectory states and noise, shared with tools/trajectory_sim
+    private: camera_common::TrajectoryStateMachine trajectory;
+    // trajectory=orbit: helix around the object with equally spaced frames instead
+    private: camera_common::OrbitTrajectory orbit;
+    private: bool orbiting = false;
+    // trajectory=spline: the stochastic states as a smooth path, the camera is placed at its pose every update
+    private: camera_common::SplineTrajectory spline;
+    private: bool smooth = false;
+    // In process label/pose/finished for Camera_gt, see Common/state_channel.hh
+    private: camera_common::StateSlot *stateSlot;
+    private: uint64_t ticks = 0;
+    private: bool publishState = false;//also publish trajectory_state on the gazebo topic
+    // Batched label/pose/velocity samples on /gazebo/moving/telemetry
+    private: camera_common::TelemetryBatcher telemetry;
+    private: transport::PublisherPtr telemetryPub;
+    // record_poses: pose log of every episode, replay_poses: drive the camera from such a log
+    private: camera_common::PoseLogWriter poseRecorder;
+    private: std::vector<camera_common::PoseLogEpisode> replayEpisodes;
+    private: bool replaying = false;
+    private: bool replayDone = false;
+    private: size_t replayEpisode = 0;
+    private: size_t replaySample = 0;
+    private: uint64_t episodeTicks = 0;
+    // label of this update, logged with the pose after the physics step in OnUpdateEnd
+    private: bool recordPending = false;
+    private: int recordLabel = 0;
+    private: bool recordFinished = false;
+    private: std::atomic<bool> restart;//finished_state 0 received, applied in OnUpdate
+    // object_size received on the transport thread, applied in OnUpdate
+    private: std::mutex sizeMutex;
+    private: bool sizeChanged = false;
+    private: camera_common::Vec3 objectSize;
     private: transport::NodePtr node;
     private: transport::PublisherPtr statePub;
     private: transport::PublisherPtr finishedPub;
     private: transport::SubscriberPtr finishedSub;   
     private: transport::SubscriberPtr sizeSub;   
     
-    public: CameraMove() : ModelPlugin() {
-        frameNumber=0;
-        nextThreshold= rand() % durationNoise + 5000-floor(durationNoise/2);
-        innerState=0;//the state in which the drone flies in 11 steps around the object
-        outerState=0;//the relative control states needed as ground truth
-        finished=false;
-	
-        // Apply noise to direction, orientation and size of speed vector
-        float vx = ((rand()%10)-5)*directionNoise/10;
-        float vy = ((rand()%10)-5)*directionNoise/10;
-        float vz = ((rand()%10)-5)*directionNoise/10+0.01;
-        float ar = ((rand()%10)-5)*orientationNoise/10;
-        float ap = ((rand()%10)-5)*orientationNoise/10;
-        float ay = ((rand()%10)-5)*orientationNoise/10;
-        speed = speed+((rand()%10)-5)*speedNoise/10;
-        v = math::Vector3(vx,vy,vz);//translational velocity: z direction for gravity compensation
-        a = math::Vector3(ar,ap,ay);//angular velocity
-        
-        
-        // Trajectory is defined by stepsize in certain direction: these are the weights for an object of size 1 1 1 
-        float sx = 0.5; //stepsize of x direction defined by objects size
-        float sy = 0.5; //stepsize of y direction defined by objects size
-        float sz = 0.1;
-        s = math::Vector3(sx, sy, sz);
-        
-        //Current stepsize for object of size 1 1 1
-        currents = math::Vector3(sx, sy, sz);
-        
-        
+    public: CameraMove() : ModelPlugin(), trajectory(rand(), false), spline(rand(), false), telemetry(0, 1), restart(false) {
         // Create a new transport node
         this->node= gazebo::transport::NodePtr (new gazebo::transport::Node());
         // Create a publisher on the ~/trajectory_state topic
@@ -108,153 +119,293 @@ namespace gazebo
         
         // Initialize the node with the world name
         this->node->Init(model->GetName());
+        
+        // inprocess (default) or topics: how Camera_gt receives the label every update
+        stateSlot = camera_common::StateChannel::Instance().Slot(model->GetName());
+        std::string channel = _sdf->Get<std::string>("state_channel");
+        publishState = channel == "topics";
+        if(channel != "" && channel != "topics" && channel != "inprocess")
+            gzerr<<"[MOV]: unknown state_channel "<<channel<<", using inprocess"<<endl;
+        
+        // telemetry_batch samples per message (default 100, 0 disables), one sample every telemetry_stride updates
+        unsigned int batch = _sdf->HasElement("telemetry_batch") ? _sdf->Get<unsigned int>("telemetry_batch") : 100;
+        unsigned int stride = _sdf->HasElement("telemetry_stride") ? _sdf->Get<unsigned int>("telemetry_stride") : 1;
+        telemetry = camera_common::TelemetryBatcher(batch, stride);
+        if(telemetry.Enabled())
+            telemetryPub = node->Advertise<camera_msgs::msgs::TrajectoryTelemetry>("/gazebo/moving/telemetry");
+        
+        // Record the poses of every episode, or replay them instead of running the trajectory
+        std::string recordPoses = _sdf->Get<std::string>("record_poses");
+        std::string replayPoses = _sdf->Get<std::string>("replay_poses");
+        if(replayPoses != ""){
+            if(camera_common::ReadPoseLog(replayPoses, replayEpisodes)){
+                replaying = true;
+                gzmsg<<"[MOV]: replaying "<<replayEpisodes.size()<<" episodes of "<<replayPoses<<endl;
+            }else{
+                gzerr<<"[MOV]: could not read pose log "<<replayPoses<<", running the trajectory"<<endl;
+            }
+        }else if(recordPoses != ""){
+            if(poseRecorder.Open(recordPoses)){
+                gzmsg<<"[MOV]: recording poses to "<<recordPoses<<endl;
+                this->updateEndConnection = event::Events::ConnectWorldUpdateEnd(
+                    boost::bind(&CameraMove::OnUpdateEnd, this));
+            }else gzerr<<"[MOV]: could not open "<<recordPoses<<endl;
+        }
+        
+        // Own seed for the noise, otherwise it follows srand of the world
+        if(_sdf->HasElement("seed")){
+            trajectory = camera_common::TrajectoryStateMachine(_sdf->Get<unsigned int>("seed"), false);
+            spline = camera_common::SplineTrajectory(_sdf->Get<unsigned int>("seed"), false);
+            gzmsg<<"[MOV]: seed "<<_sdf->Get<unsigned int>("seed")<<endl;
+        }
+        // Shorter states give a faster trajectory over the same path, e.g. for benchmarks
+        if(_sdf->HasElement("state_duration")){
+            int duration = _sdf->Get<int>("state_duration");
+            if(duration > 0){
+                trajectory.SetStateDuration(duration);
+                spline.SetStateDuration(duration);
+                gzmsg<<"[MOV]: state duration "<<duration<<endl;
+            }
+        }
+        
+        // stochastic (default), orbit or spline, see Common/orbit_trajectory.hh and Common/spline_trajectory.hh
+        std::string kind = _sdf->Get<std::string>("trajectory");
+        if(kind == "orbit"){
+            camera_common::OrbitOptions options;
+            if(_sdf->HasElement("orbit_standoff")) options.standoff = _sdf->Get<double>("orbit_standoff");
+            if(_sdf->HasElement("orbit_pitch")) options.pitch = _sdf->Get<double>("orbit_pitch");
+            if(_sdf->HasElement("orbit_coverage")) options.coverage = _sdf->Get<double>("orbit_coverage");
+            if(_sdf->HasElement("orbit_clearance")) options.clearance = _sdf->Get<double>("orbit_clearance");
+            if(_sdf->HasElement("orbit_spacing")) options.spacing = _sdf->Get<double>("orbit_spacing");
+            // the camera saves a frame every sensor update, so its rate is the default
+            double sensorRate = SensorUpdateRate(model->GetSDF());
+            if(sensorRate > 0) options.frameRate = sensorRate;
+            if(_sdf->HasElement("orbit_frame_rate")) options.frameRate = _sdf->Get<double>("orbit_frame_rate");
+            else if(sensorRate <= 0) gzmsg<<"[MOV]: no sensor update_rate, orbit_frame_rate "<<options.frameRate<<endl;
+            options.dt = model->GetWorld()->GetPhysicsEngine()->GetMaxStepSize();
+            if(options.spacing > 0 && options.frameRate > 0 && options.dt > 0){
+                orbit.SetOptions(options);
+                orbiting = true;
+                gzmsg<<"[MOV]: orbit trajectory, a frame every "<<options.spacing<<" m at "<<orbit.Speed()<<" m/s"<<endl;
+            }else{
+                gzerr<<"[MOV]: orbit_spacing and orbit_frame_rate must be positive, running the stochastic trajectory"<<endl;
+            }
+        }else if(kind == "spline"){
+            camera_common::SplineOptions options;
+            if(_sdf->HasElement("spline_noise_interval")) options.noiseInterval = _sdf->Get<double>("spline_noise_interval");
+            if(_sdf->HasElement("spline_position_noise")) options.positionNoise = _sdf->Get<double>("spline_position_noise");
+            if(_sdf->HasElement("spline_angle_noise")) options.angleNoise = _sdf->Get<double>("spline_angle_noise");
+            options.dt = model->GetWorld()->GetPhysicsEngine()->GetMaxStepSize();
+            spline.SetOptions(options);
+            smooth = true;
+            gzmsg<<"[MOV]: spline trajectory, noise knots every "<<options.noiseInterval<<" updates"<<endl;
+        }else if(kind != "" && kind != "stochastic"){
+            gzerr<<"[MOV]: unknown trajectory "<<kind<<", using stochastic"<<endl;
+        }
 
     }
     //Called whenever the trajectory is finished
     private: void callbackFinished(ConstIntPtr &_msg){
         gzmsg<<"[MOV]:trajectory finished? "<< _msg->data()<< endl<<flush;
         if(_msg->data()==0){
-            finished = false;
-            innerState = 0;
-            outerState = 0;
-            frameNumber = 0;
-            nextThreshold= rand() % durationNoise + 5000-floor(durationNoise/2);
-            currentrun = 1;
+            restart = true;
             gazebo::common::Time::MSleep(20);//only start flying when everything is certainly ready.
         }
     }
     //Called when a new focus object is spawned and the size is changed
     private: void callbackSize(ConstVector3dPtr &_msg){
         gzmsg<<"[MOV]:Size received: "<< _msg->x()<< ","<<_msg->y()<<","<<_msg->z()<< endl<<flush;
-        double sx = (_msg->x()+1.5)*1000/5000; //stepsize = distance(sizeOfFocusObject) / numberOfFrames
-        double sy = (_msg->y()+1.5)/5;
-        double sz = (_msg->z()*0.5)/5;//stepsize = objectsize * 0.5 *1000/5000 ~ circle around half way
-        if(_msg->z()>1){
-            sz = 0.1;//=(1*0.5/5)
-            numberofruns = ceil(_msg->z()*2);//divide by 0.5 
-            gzmsg<<"[MOV]: Number of runs: "<<numberofruns<<endl;
-        }else{
-            numberofruns = 1;
+        std::lock_guard<std::mutex> lock(sizeMutex);
+        objectSize = camera_common::Vec3(_msg->x(), _msg->y(), _msg->z());
+        sizeChanged = true;
+    }
+    //Adapt the trajectories to the last received size, on the physics thread like Step
+    private: void applySize(){
+        camera_common::Vec3 size;
+        {
+            std::lock_guard<std::mutex> lock(sizeMutex);
+            if(!sizeChanged) return;
+            size = objectSize;
+            sizeChanged = false;
+        }
+        trajectory.SetObjectSize(size.x, size.y, size.z);
+        orbit.SetObjectSize(size.x, size.y, size.z);
+        spline.SetObjectSize(size.x, size.y, size.z);
+        if(orbiting){
+            gzmsg<<"[MOV]: orbit of "<<orbit.Revolutions()<<" revolutions at "<<orbit.Radius()<<" m: "
+                <<orbit.Updates()<<" updates, "<<orbit.Frames()<<" frames"<<endl;
+        }else if(trajectory.NumberOfRuns() > 1){
+            gzmsg<<"[MOV]: Number of runs: "<<trajectory.NumberOfRuns()<<endl;
         }
-        currents = math::Vector3(sx,sy,sz);
-        
-        
     }
     
     // Called by the world update start event
     public: void OnUpdate()
     {
-        if(!finished){
+        camera_common::ScopedStageTimer updateTimer(camera_common::STAGE_UPDATE);
+        CAMERA_TRACE_SCOPE("OnUpdate", "controller");
+        camera_common::CaptureStats::Instance().Add(camera_common::COUNTER_TICKS);
+        applySize();
+        if(restart.exchange(false)){
+            //the episode starts over once every object is spawned
+            trajectory.Reset();
+            orbit.Reset();
+            spline.Reset();
+            poseRecorder.DiscardEpisode();
+            replaySample = 0;
+            replayDone = false;
+            episodeTicks = 0;
+        }
+        if(replaying){
+            replayUpdate();
+            return;
+        }
+        camera_common::TrajectoryCommand cmd;
         math::Pose pose = this->model->GetWorldPose();
-        frameNumber = frameNumber+1;
-        //cout<<"threshold: "<<changingThreshold<<endl<<flush;
-        if(frameNumber > nextThreshold){
-            innerState = innerState+1;
-            if(innerState == 11){ 
-                innerState = 0;
-                finished = 1;
-            }else{
-                int dur = 5000;
-                if(innerState == 10){
-                    if(numberofruns != currentrun){
-                        currentrun=currentrun+1;//one run down
-                        innerState = 0;//go up
-                    }else{
-                        dur = numberofruns * dur;//give it more time to go down according to the numbersofruns it went up
-                    }
-                }
-                if(innerState==1 || innerState==9) dur = 2500; //doing half of x direction so only half of length is needed
-                nextThreshold = rand() % durationNoise + dur -floor(durationNoise/2);//mean of threshold is 5000
-                frameNumber = 0;
-                cout << "current state " << innerState << "next: "<<nextThreshold<<endl;
+        camera_common::Pose3 current;
+        current.pos = camera_common::Vec3(pose.pos.x, pose.pos.y, pose.pos.z);
+        current.rot = camera_common::Quat(pose.rot.w, pose.rot.x, pose.rot.y, pose.rot.z);
+        if(orbiting){
+            if(!orbit.Step(current, cmd)) return;
+            if(cmd.stateChanged) cout << "orbit phase " << orbit.CurrentPhase() << endl;
+        }else if(smooth){
+            camera_common::Pose3 next;
+            if(!spline.Step(current, next, cmd)) return;
+            if(cmd.stateChanged) cout << "label " << cmd.label << endl;
+            //kinematic: placed at the pose of this tick and held there by zero velocities (as replay
+            //does), so the physics step does not carry it on to the next one; cmd keeps the
+            //spline velocity for the telemetry
+            pose = math::Pose(math::Vector3(next.pos.x, next.pos.y, next.pos.z),
+                math::Quaternion(next.rot.w, next.rot.x, next.rot.y, next.rot.z));
+            this->model->SetWorldPose(pose);
+        }else{
+            if(!trajectory.Step(cmd)) return;
+            if(cmd.stateChanged){
+                cout << "current state " << trajectory.InnerState() << "next: "<<trajectory.NextThreshold()<<endl;
             }
         }
-        //TODO do this line away
-        //if(innerState==1){finished = true;}
 
-        if(finished){
-            // Make sure to shut everything down.
-            //gazebo::shutdown();
+        if(cmd.finished){
             // Publish that everything is done
             msgs::Int msg;
             msg.set_data(1);
             // Send the message
             finishedPub->Publish(msg);
         }
-        
-        float yaw = -0.314;
-        if(frameNumber % updateNoise == 0){
-            // Apply noise to direction, orientation and size of speed vector
-            float vx = ((rand()%10)-5)*directionNoise/10;
-            float vy = ((rand()%10)-5)*directionNoise/10;
-            float vz = ((rand()%10)-5)*directionNoise/10+0.01;//+0.01 to compensate gravity
-            float ar = ((rand()%10)-5)*orientationNoise/10;
-            float ap = ((rand()%10)-5)*orientationNoise/10;
-            float ay = ((rand()%10)-5)*orientationNoise/10;
-            speed = speed+((rand()%10)-5)*speedNoise/10;
-            
-            v=math::Vector3(vx,vy,vz);//translational velocity: z direction for gravity compensation
-            a=math::Vector3(ar,ap,ay);//angular velocity
-            //cout<<"randomness of the speed vector: "<<endl;
-            //cout<<v[0]<<"; "<<v[1]<<"; "<<v[2]<<"; "<<a[0]<<"; "<<a[1]<<"; "<<a[2]<<"; "<<endl<<flush;
-        }
-	
-        math::Vector3 vt(0,0,0);//temp translational speed vector
-        math::Vector3 at(0,0,0);//temp angular speed vector
-        switch(innerState){
-            case 0://go up: outerState 0
-                vt=v+math::Vector3(0,0,currents[2]*speed);
-		at=a;
-                outerState = 0;
-                break;
-            case 2:
-            case 4:
-            case 6:
-            case 8://turn: 
-                at=a+math::Vector3(0,0,yaw);
-		vt=v;
-                outerState = 2;
-                break;
-            case 1:
-            case 5:
-            case 9://flying in x direction according to stepsize in x directoin
-                vt=v+math::Vector3(0, currents[0]*speed, 0);//still put in y direction because its relative
-		at=a;
-                outerState = 1;
-                break;
-            case 3://go forward absolute
-            case 7://go backward absolute 
-                vt=v+math::Vector3(0, currents[1]*speed, 0);//fly with speed of y direction
-		at=a;
-                outerState = 1;
-                break;
-            case 10://land
-                vt=v+math::Vector3(0,0,-currents[2]);//*speed*numberofruns);//if we went 3x up we have to go 3x faster down
-		at=a;
-                outerState=3;
-                break;
-            default:
-                gzerr << "[MOV]: unknown innerState."<<endl;
-                break;
-        }
 
         // Apply a small linear velocity to the model.
+        math::Vector3 vt(cmd.linear.x, cmd.linear.y, cmd.linear.z);
         vt = pose.rot * vt; // change relative speed Vector to absolute frame
-        this->model->SetLinearVel(vt);
-        this->model->SetAngularVel(at);
-        //cout << "outerState: "<< outerState<< endl;
+        if(smooth){
+            this->model->SetLinearVel(math::Vector3(0, 0, 0));
+            this->model->SetAngularVel(math::Vector3(0, 0, 0));
+        }else{
+            this->model->SetLinearVel(vt);
+            this->model->SetAngularVel(math::Vector3(cmd.angular.x, cmd.angular.y, cmd.angular.z));
+        }
+
+        if(poseRecorder.IsOpen()){
+            recordPending = true;
+            recordLabel = cmd.label;
+            recordFinished = cmd.finished;
+        }
+
         // Sent the state out there!
-        
-        //cout<<"pose of the speed vector: "<<endl;
-	//cout<<vt[0]<<"; "<<vt[1]<<"; "<<vt[1]<<"; "<<at[0]<<"; "<<at[1]<<"; "<<at[2]<<"; "<<endl<<flush;
+        camera_common::CameraState state;
+        state.tick = ++ticks;
+        state.label = cmd.label;
+        state.finished = cmd.finished;
+        state.x = pose.pos.x; state.y = pose.pos.y; state.z = pose.pos.z;
+        state.qw = pose.rot.w; state.qx = pose.rot.x; state.qy = pose.rot.y; state.qz = pose.rot.z;
+        stateSlot->Write(state);
+        if(publishState){
+            msgs::Int msg;
+            msg.set_data(cmd.label);
+            statePub->Publish(msg);
+        }
+        if(telemetry.Enabled()){
+            camera_common::TelemetrySample sample = {state.tick, cmd.label,
+                {state.x, state.y, state.z, state.qw, state.qx, state.qy, state.qz},
+                {vt.x, vt.y, vt.z, cmd.angular.x, cmd.angular.y, cmd.angular.z}};
+            if(telemetry.Add(sample) || cmd.finished) publishTelemetry(cmd.finished);
+        }
+    }
 
-        // Create the message
-        msgs::Int msg;
-        msg.set_data(outerState);
-        // Send the message
-        statePub->Publish(msg);
-    
+    // Called by the world update end event, after the physics step: log the
+    // pose the camera reached with the velocities of this update, which is
+    // the pose Camera_gt renders and the pose replay puts the camera at
+    public: void OnUpdateEnd()
+    {
+        if(!recordPending) return;
+        recordPending = false;
+        math::Pose pose = this->model->GetWorldPose();
+        camera_common::Pose3 p;
+        p.pos = camera_common::Vec3(pose.pos.x, pose.pos.y, pose.pos.z);
+        p.rot = camera_common::Quat(pose.rot.w, pose.rot.x, pose.rot.y, pose.rot.z);
+        poseRecorder.Add(episodeTicks++, recordLabel, p);
+        if(recordFinished && !poseRecorder.EndEpisode()) gzerr<<"[MOV]: could not write the pose log"<<endl;
+    }
+
+    // Place the camera at the next pose of the log, kinematically
+    private: void replayUpdate()
+    {
+        if(replayDone || replayEpisode >= replayEpisodes.size()) return;
+        const camera_common::PoseLogEpisode &episode = replayEpisodes[replayEpisode];
+        camera_common::CameraState state;
+        state.tick = ++ticks;
+        if(replaySample >= episode.size()){
+            replayDone = true;
+            replayEpisode++;
+            msgs::Int msg;
+            msg.set_data(1);
+            finishedPub->Publish(msg);
+            state = stateSlot->Read();
+            state.tick = ticks;
+            state.finished = 1;
+            stateSlot->Write(state);
+            if(telemetry.Enabled()) publishTelemetry(true);
+            return;
+        }
+        const camera_common::PoseLogSample &s = episode[replaySample++];
+        this->model->SetWorldPose(math::Pose(math::Vector3(s.pose.pos.x, s.pose.pos.y, s.pose.pos.z),
+            math::Quaternion(s.pose.rot.w, s.pose.rot.x, s.pose.rot.y, s.pose.rot.z)));
+        this->model->SetLinearVel(math::Vector3(0, 0, 0));
+        this->model->SetAngularVel(math::Vector3(0, 0, 0));
+        state.label = s.label;
+        state.finished = 0;
+        state.x = s.pose.pos.x; state.y = s.pose.pos.y; state.z = s.pose.pos.z;
+        state.qw = s.pose.rot.w; state.qx = s.pose.rot.x; state.qy = s.pose.rot.y; state.qz = s.pose.rot.z;
+        stateSlot->Write(state);
+        if(publishState){
+            msgs::Int msg;
+            msg.set_data(s.label);
+            statePub->Publish(msg);
+        }
+        //the logged poses with the zero velocities the camera is held at
+        if(telemetry.Enabled()){
+            camera_common::TelemetrySample sample = {state.tick, s.label,
+                {state.x, state.y, state.z, state.qw, state.qx, state.qy, state.qz}, {0, 0, 0, 0, 0, 0}};
+            if(telemetry.Add(sample)) publishTelemetry(false);
+        }
+    }
+
+    // Send the collected samples as one TrajectoryTelemetry message
+    private: void publishTelemetry(bool _finished)
+    {
+        camera_msgs::msgs::TrajectoryTelemetry msg;
+        msg.set_model(model->GetName());
+        msg.set_episode(telemetry.Episode());
+        msg.set_finished(_finished);
+        const std::vector<camera_common::TelemetrySample> &samples = telemetry.Samples();
+        for(size_t i = 0; i < samples.size(); i++){
+            msg.add_tick(samples[i].tick);
+            msg.add_label(samples[i].label);
+            for(int j = 0; j < 7; j++) msg.add_pose(samples[i].pose[j]);
+            for(int j = 0; j < 6; j++) msg.add_velocity(samples[i].velocity[j]);
         }
+        telemetryPub->Publish(msg);
+        telemetry.Clear();
+        if(_finished) telemetry.NextEpisode();
     }
 
     
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Run camera_benchmark.world headless with software rendering and print the
+# json report. Reports of two builds can be compared with diff.
+# usage: run_benchmark.sh [output directory] [timeout in seconds]
+out=${1:-/tmp/camera_benchmark}
+limit=${2:-3600}
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+
+mkdir -p "$out"
+rm -rf "$out/models" "$out/report.json"
+sed "s#/tmp/camera_benchmark#$out#g" "$here/camera_benchmark.world" > "$out/benchmark.world"
+mkdir -p "$out/models/benchmark_camera"
+cp "$root/Models/benchmark_camera/model.config" "$out/models/benchmark_camera/"
+sed "s#/tmp/camera_benchmark#$out#g" "$root/Models/benchmark_camera/model.sdf" > "$out/models/benchmark_camera/model.sdf"
+
+export GAZEBO_MODEL_PATH=$out/models:$root/Models:$GAZEBO_MODEL_PATH
+export GAZEBO_PLUGIN_PATH=$root/Modelplugin/build:$root/Worldplugin/build:$GAZEBO_PLUGIN_PATH
+export LD_LIBRARY_PATH=$root/Modelplugin/build/Common:$LD_LIBRARY_PATH
+export LIBGL_ALWAYS_SOFTWARE=1
+
+# camera sensors need a GL context, use a virtual display when there is none
+run=""
+if [ -z "$DISPLAY" ] && which xvfb-run > /dev/null; then
+    run="xvfb-run -a -s '-screen 0 1280x1024x24'"
+fi
+eval timeout $limit $run gzserver --verbose "$out/benchmark.world" > "$out/gzserver.log" 2>&1
+
+if [ ! -f "$out/report.json" ]; then
+    echo "no report written, see $out/gzserver.log"
+    exit 1
+fi
+cat "$out/report.json"
@@ -1,15 +1,93 @@
 #include "gazebo/physics/physics.hh"
 #include "gazebo/common/common.hh"
 #include "gazebo/gazebo.hh"
+#include <atomic>
 #include <iostream>
+#include <sstream>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 
 #include <sensors/sensors.hh>
 
+#include "benchmark_report.hh"
+#include "capture_stats.hh"
+#include "state_channel.hh"
+#include "trace.hh"
+
 using namespace std;
 
 namespace gazebo
 {
+    // Parsed SDF of every model:// model the world inserted, so the next
+    // insert of the same model (a focus object that comes back, another
+    // camera) skips resolving the uri, reading the file and converting it.
+    class ModelAssetCache
+    {
+        public: ModelAssetCache() : hits(0), misses(0), parseNs(0) {}
+        
+        // The SDF of model://_name, read from disk the first time; NULL if it can not be read
+        public: sdf::SDFPtr Get(const string &_name){
+            map<string, sdf::SDFPtr>::iterator it = models.find(_name);
+            if(it != models.end()){
+                hits++;
+                return it->second;
+            }
+            misses++;
+            CAMERA_TRACE_SCOPE("parse model sdf", "world");
+            uint64_t start = camera_common::NowNs();
+            sdf::SDFPtr model(new sdf::SDF());
+            string file = common::ModelDatabase::Instance()->GetModelFile("model://"+_name);
+            if(file == "" || !sdf::init(model) || !sdf::readFile(file, model)){
+                gzerr << "[WORLD]: could not parse model://"<<_name<<endl;
+                model.reset();
+            }
+            parseNs += camera_common::NowNs() - start;
+            models[_name] = model;//also remember failures, they fall back to InsertModelFile
+            return model;
+        }
+        
+        // Insert model://_name, renamed to _rename if that is not empty and
+        // without the visuals of its links if _hideVisuals (cameras that
+        // should not show up in each other's frames)
+        public: void Insert(physics::WorldPtr _world, const string &_name, const string &_rename = "",
+            bool _hideVisuals = false){
+            sdf::SDFPtr model = Get(_name);
+            if(model == NULL || model->root == NULL || !model->root->HasElement("model")){
+                if(_rename == "") _world->InsertModelFile("model://"+_name);
+                else _world->InsertModelString("<sdf version='1.5'><include><uri>model://"+_name+
+                    "</uri><name>"+_rename+"</name></include></sdf>");
+                return;
+            }
+            if(_rename == "" && !_hideVisuals){
+                _world->InsertModelSDF(*model);
+                return;
+            }
+            sdf::SDF copy;
+            copy.root = model->root->Clone();
+            sdf::ElementPtr modelElement = copy.root->GetElement("model");
+            if(_rename != "") modelElement->GetAttribute("name")->SetFromString(_rename);
+            if(_hideVisuals && modelElement->HasElement("link")){
+                for(sdf::ElementPtr link = modelElement->GetElement("link"); link; link = link->GetNextElement("link")){
+                    while(link->HasElement("visual")) link->RemoveChild(link->GetElement("visual"));
+                    if(link->HasElement("sensor"))//no frustum either
+                        for(sdf::ElementPtr sensor = link->GetElement("sensor"); sensor; sensor = sensor->GetNextElement("sensor"))
+                            sensor->GetElement("visualize")->Set(false);
+                }
+            }
+            _world->InsertModelSDF(copy);
+        }
+        
+        public: uint64_t Hits() const { return hits; }
+        public: uint64_t Misses() const { return misses; }
+        public: size_t Models() const { return models.size(); }
+        public: double ParseSeconds() const { return parseNs / 1e9; }
+        
+        private: map<string, sdf::SDFPtr> models;
+        private: uint64_t hits;
+        private: uint64_t misses;
+        private: uint64_t parseNs;
+    };
+
     class Camera_world : public WorldPlugin
     {
         private: bool reloading;
@@ -24,6 +102,13 @@ namespace gazebo
         private: vector<string>  focusList;
         private: string camera;
         private: string savingLocation;
+        //cameras > 1: camera_0..camera_K-1 around the focus object, each with its own controller and <location>/<name>/RGB
+        private: vector<string> cameras;
+        private: vector<camera_common::StateSlot *> cameraSlots;
+        private: vector<uint64_t> cameraStartTicks;//tick of every slot when the episode started
+        private: std::atomic<unsigned int> finishedMessages;//finished_state 1 this episode, from controllers without a slot
+        private: event::ConnectionPtr updateConnection;
+        private: ModelAssetCache assets;//parsed model SDF, reused by every insert
         
         private: physics::WorldPtr world;
         private: transport::NodePtr node;
@@ -34,6 +119,17 @@ namespace gazebo
         private: transport::PublisherPtr sizePub;
         
         private: map<string,bool>  spawnMap;//Map with all focus objects to be spawned
+        private: uint64_t spawnStart;//start of waiting for all objects to be spawned
+        private: uint64_t spawnDuration;//time it took to (re)load the current episode
+        
+        //Benchmark bookkeeping, only written out when benchmark_report is set
+        private: string benchmarkReport;
+        private: camera_common::BenchmarkReport report;
+        private: bool episodeRunning;
+        private: uint64_t episodeStart;
+        private: common::Time episodeSimStart;
+        private: uint64_t startTicks, startFrames, startDropped, startBytes;
+        private: uint64_t startAssetHits, startAssetMisses;
         
         public: Camera_world() : WorldPlugin(){
             ground_plane = "ground_plane";
@@ -42,11 +138,28 @@ namespace gazebo
             //spawnMap[sun] = false;//The sun is lighting and so doesnt get spawned like normal model? or is spawned too soon.
             savingLocation="/esat/quaoar/kkelchte/simulation/no_location";
             reloading = false;
+            episodeRunning = false;
+            finishedMessages = 0;
+            spawnDuration = 0;
         }
         
         
         public: void Load(physics::WorldPtr _parent, sdf::ElementPtr _sdf)
         {
+            //Optional chrome trace of the simulation loop (see Common/trace.hh)
+            string traceFile = _sdf->Get<string>("trace_file");
+            if(traceFile != "") camera_common::Tracer::Instance().Enable(traceFile);
+            spawnStart = camera_common::NowNs();
+            
+            //Fixed seed so that the noise on the trajectories is repeatable
+            unsigned int seed = 0;
+            if(_sdf->HasElement("seed")){
+                seed = _sdf->Get<unsigned int>("seed");
+                srand(seed);
+                cout << "seed: "<<seed<<endl;
+            }
+            benchmarkReport = _sdf->Get<string>("benchmark_report");
+            report.SetConfiguration(_parent->GetName(), seed);
             
             this->world = _parent;
             
@@ -54,8 +167,8 @@ namespace gazebo
             this->world->SetPaused(true);
             
             //Standard objects
-            world->InsertModelFile("model://"+ground_plane);
-            world->InsertModelFile("model://"+sun);
+            insertModel(ground_plane);
+            insertModel(sun);
             
             //Insert surroundings
             string tmp = _sdf->Get<string>("surroundings");
@@ -66,7 +179,7 @@ namespace gazebo
                 surroundings = "Surroundingwalls";
             }
             spawnMap[surroundings] = false;
-            world->InsertModelFile("model://"+surroundings);
+            insertModel(surroundings);
             
             //Inser focus object
             //load in focusList vector
@@ -88,7 +201,7 @@ namespace gazebo
             }
             currentFocus = focusList.back();
             focusList.pop_back();
-            world->InsertModelFile("model://"+currentFocus);
+            insertModel(currentFocus);
             spawnMap[currentFocus] = false;
             
             //Load the size of the different focus objects
@@ -141,8 +254,25 @@ namespace gazebo
             }else{
                 camera="distorted_camera_k";
             }
-            world->InsertModelFile("model://"+camera);
-            spawnMap[camera] = false;
+            unsigned int cameraCount = _sdf->HasElement("cameras") ? _sdf->Get<unsigned int>("cameras") : 1;
+            if(cameraCount <= 1){
+                cameras.push_back(camera);
+                insertModel(camera);
+            }else{
+                for(unsigned int k = 0; k < cameraCount; k++){
+                    ostringstream name;
+                    name << camera << "_" << k;
+                    cameras.push_back(name.str());
+                    insertCamera(name.str());
+                    cameraSlots.push_back(camera_common::StateChannel::Instance().Slot(name.str()));
+                }
+                cameraStartTicks.assign(cameraCount, 0);
+                //the last camera to finish ends the episode, see OnUpdate
+                this->updateConnection = event::Events::ConnectWorldUpdateBegin(
+                    boost::bind(&Camera_world::OnUpdate, this));
+                cout << "cameras: "<<cameraCount<<endl;
+            }
+            for(size_t k = 0; k < cameras.size(); k++) spawnMap[cameras[k]] = false;
             
             
             //Read saving location
@@ -173,11 +303,7 @@ namespace gazebo
             this->finishedPub = node->Advertise<msgs::Int>("/gazebo/moving/finished_state");
             this->sizePub = node->Advertise<msgs::Vector3d>("/gazebo/moving/object_size");
             
-            // Send the message with proper saving location
-            msgs::GzString msg;
-            msg.set_data(savingLocation);
-            locationPub->Publish(msg);
-            
+            publishLocation();
         }
         
         //Called whenever an object is spawn:
@@ -208,19 +334,13 @@ namespace gazebo
                 
             }
             //give the camera the right position
-            if(camera.compare(_msg->name())==0){
-                physics::ModelPtr cameraModel = world->GetModel(camera);
-                if(cameraModel == NULL){gzerr<<"no model found"<<endl;exit();}
-                else{ 
-                    physics::LinkPtr cameraLink = cameraModel->GetLink("link");
-                    //move the camera 0.25 tile away from the surface of the object
-                    math::Pose p (-0.75-currentSize[1]/2,0.0,0.05,0,0,0);
-                    const math::Pose& campose = p;
-                    cameraLink->SetWorldPose(campose, true, true);
-                }
-            }
+            for(size_t k = 0; k < cameras.size(); k++)
+                if(cameras[k].compare(_msg->name())==0) placeCamera(k);
             //start simulation when everything is ready
             if(ready){
+                uint64_t now = camera_common::NowNs();
+                if(!episodeRunning) spawnDuration = now - spawnStart;
+                camera_common::Tracer::Instance().Record("spawn barrier wait", "world", spawnStart, now);
                 reloading = false;
                 msgs::Int msg;
                 msg.set_data(0);
@@ -233,16 +353,79 @@ namespace gazebo
         //Called whenever the trajectory is finished
         private: void callbackFinishedTrajectory(ConstIntPtr &_msg){
             //cout<<"trajectory finished? "<< _msg->data()<< endl<<flush;
-            if(_msg->data()==1){
+            //with several cameras the last one to finish ends the episode, see OnUpdate
+            if(_msg->data()==1 && !cameraSlots.empty()) finishedMessages++;
+            if(_msg->data()==1 && cameraSlots.empty()){
                 if(!reloading){ 
+                    endEpisode();
                     reload();
                     reloading=true;
                 }
             }
             if(_msg->data()==0){
+                if(!episodeRunning) startEpisode();
                 this->world->SetPaused(false);
             }
         }
+        
+        //Remember wall time, simulation time and capture counters at the start of an episode
+        private: void startEpisode(){
+            camera_common::CaptureStats &stats = camera_common::CaptureStats::Instance();
+            episodeRunning = true;
+            episodeStart = camera_common::NowNs();
+            episodeSimStart = world->GetSimTime();
+            startTicks = stats.Total(camera_common::COUNTER_TICKS);
+            startFrames = stats.Total(camera_common::COUNTER_FRAMES_SAVED);
+            startDropped = stats.Total(camera_common::COUNTER_FRAMES_DROPPED);
+            startBytes = stats.Total(camera_common::COUNTER_BYTES_WRITTEN);
+            startAssetHits = assets.Hits();
+            startAssetMisses = assets.Misses();
+            for(size_t k = 0; k < cameraSlots.size(); k++) cameraStartTicks[k] = cameraSlots[k]->Read().tick;
+            finishedMessages = 0;
+        }
+        
+        //Several cameras: end the episode once every controller wrote finished in this episode. camera_move and
+        //camera_move_stoch never write their slot, they only publish finished_state 1 once per episode, so the
+        //episode also ends after one such message per camera
+        public: void OnUpdate(){
+            if(!episodeRunning || reloading) return;
+            size_t finished = 0;
+            for(size_t k = 0; k < cameraSlots.size(); k++){
+                camera_common::CameraState s = cameraSlots[k]->Read();
+                if(s.finished && s.tick > cameraStartTicks[k]) finished++;
+            }
+            if(finished < cameraSlots.size() && finishedMessages < cameraSlots.size()) return;
+            endEpisode();
+            reload();
+            reloading=true;
+        }
+        
+        //Add the finished episode to the benchmark report
+        private: void endEpisode(){
+            if(!episodeRunning) return;
+            episodeRunning = false;
+            camera_common::CaptureStats &stats = camera_common::CaptureStats::Instance();
+            camera_common::EpisodeResult e;
+            e.focus = currentFocus;
+            e.wallTime = (camera_common::NowNs() - episodeStart) / 1e9;
+            e.simTime = (world->GetSimTime() - episodeSimStart).Double();
+            e.reloadLatency = spawnDuration / 1e9;
+            e.ticks = stats.Total(camera_common::COUNTER_TICKS) - startTicks;
+            e.framesCaptured = stats.Total(camera_common::COUNTER_FRAMES_SAVED) - startFrames;
+            e.framesDropped = stats.Total(camera_common::COUNTER_FRAMES_DROPPED) - startDropped;
+            e.bytesWritten = stats.Total(camera_common::COUNTER_BYTES_WRITTEN) - startBytes;
+            e.assetHits = assets.Hits() - startAssetHits;
+            e.assetMisses = assets.Misses() - startAssetMisses;
+            report.AddEpisode(e);
+            gzmsg << "[WORLD]: episode "<<currentFocus<<" took "<<e.wallTime<<"s for "
+                <<e.framesCaptured<<" frames"<<endl;
+            gzmsg << "[WORLD]: model cache "<<assets.Hits()<<" hits, "<<assets.Misses()<<" misses ("
+                <<100.0*assets.Hits()/max<uint64_t>(1, assets.Hits()+assets.Misses())<<"% hits), "
+                <<assets.Models()<<" models parsed in "<<assets.ParseSeconds()<<"s"<<endl;
+            //write after every episode so a killed run still leaves a report
+            if(benchmarkReport != "" && !report.Write(benchmarkReport))
+                gzerr << "[WORLD]: could not write "<<benchmarkReport<<endl;
+        }
         //quit the program
         private: void exit(){
             cout << "Gazebo is shutting down... "<<endl<<flush;
@@ -252,10 +435,63 @@ namespace gazebo
             exitPub->Publish(msg);
         }
         
+        //insert a model from the model database, asynchronously loaded by the world
+        private: void insertModel(const string &_name){
+            CAMERA_TRACE_SCOPE("InsertModelSDF", "world");
+            assets.Insert(world, _name);
+        }
+        
+        //insert one of several cameras under its own name, not colliding with the other cameras
+        private: void insertCamera(const string &_name){
+            CAMERA_TRACE_SCOPE("InsertModelSDF", "world");
+            assets.Insert(world, camera, _name, true);//the other cameras fly around the same object
+        }
+        
+        //send the saving location to Camera_gt, every camera has its own directory when there are several
+        private: void publishLocation(){
+            msgs::GzString msg;
+            msg.set_data(savingLocation);
+            locationPub->Publish(msg);
+            camera_common::StateChannel &channel = camera_common::StateChannel::Instance();
+            for(size_t k = 0; k < cameraSlots.size(); k++){
+                string location = savingLocation+"/"+cameras[k];
+                boost::filesystem::create_directory(boost::filesystem::path(location.c_str()));
+                channel.SetLocation(cameras[k], location);
+            }
+            channel.SetLocation(savingLocation);
+        }
+        
+        //move camera _k 0.25 tile away from the surface of the object; several cameras are spread
+        //evenly around it, every one looking at the object
+        private: void placeCamera(size_t _k){
+            physics::ModelPtr cameraModel = world->GetModel(cameras[_k]);
+            if(cameraModel == NULL){gzerr<<"no model found"<<endl;exit();return;}
+            physics::LinkPtr cameraLink = cameraModel->GetLink("link");
+            double angle = 2*M_PI*_k/cameras.size();
+            double c = cos(angle), s = sin(angle);
+            //distance from the center to the side of the object in this direction (x faces size[1], as for one camera)
+            double extent = currentSize[1]/2;
+            if(fabs(s) > 1e-6) extent = min(fabs(c) > 1e-6 ? currentSize[1]/2/fabs(c) : 1e9, currentSize[0]/2/fabs(s));
+            math::Pose p (-(0.75+extent)*c, -(0.75+extent)*s, 0.05, 0, 0, angle);
+            const math::Pose& campose = p;
+            cameraLink->SetWorldPose(campose, true, true);
+            //ghost links collide with everything except each other
+            if(cameraSlots.size() > 0) cameraLink->SetCollideMode("ghost");
+        }
+        
         //reload a simulation
         private: void reload(){
+            //everything of the previous episode is recorded by now
+            camera_common::Tracer::Instance().Flush();
+            CAMERA_TRACE_SCOPE("reload", "world");
+            spawnStart = camera_common::NowNs();
             
             this->world->SetPaused(true);
+            if(focusList.empty()){
+                cout << "Run through all focus objects"<<endl;
+                exit();
+                return;
+            }
             //world->PrintEntityTree();
             // Update focus model
             string prevFocus = currentFocus;
@@ -271,7 +507,7 @@ namespace gazebo
             spawnMap.erase(prevFocus);
                 
             //Load new focus object
-            world->InsertModelFile("model://"+currentFocus);
+            insertModel(currentFocus);
             spawnMap[currentFocus]=false;
             
             //cout<<currentFocus<<" is next"<<endl<<flush;
@@ -284,20 +520,9 @@ namespace gazebo
             
             // Change location for saving the images:
             //cout << "savingLocation: "<< savingLocation <<endl<<flush;
-            msgs::GzString msg;
-            msg.set_data(savingLocation);
-            locationPub->Publish(msg);
-            
-            physics::ModelPtr cameraModel = world->GetModel(camera);
-            if(cameraModel == NULL){gzerr<<"no model found"<<endl;exit();}
-            else{ 
-                physics::LinkPtr cameraLink = cameraModel->GetLink("link");
-                //move the camera 0.25 tile away from the surface of the object
-                math::Pose p (-0.75-currentSize[1]/2,0.0,0.05,0,0,0);
-                const math::Pose& campose = p;
-                cameraLink->SetWorldPose(campose, true, true);
-            }
+            publishLocation();
             
+            for(size_t k = 0; k < cameras.size(); k++) placeCamera(k);
 
         }
     };
@@ -3,6 +3,8 @@
 #include "gazebo/gazebo.hh"
 #include <sensors/sensors.hh>
 
+#include "trace.hh"
+
 using namespace std;
 
 namespace gazebo
@@ -32,6 +34,7 @@ namespace gazebo
         private: transport::SubscriberPtr modelsub;
         
         private: map<string,bool>  spawnMap;//Map with all focus objects to be spawned
+        private: uint64_t spawnStart;//start of waiting for all objects to be spawned
         
         public: Camera_world() : WorldPlugin(){
             ground_plane = "ground_plane";
@@ -50,10 +53,14 @@ namespace gazebo
         
         public: void Load(physics::WorldPtr _parent, sdf::ElementPtr _sdf)
         {
+            //Optional chrome trace of the simulation loop (see Common/trace.hh)
+            string traceFile = _sdf->Get<string>("trace_file");
+            if(traceFile != "") camera_common::Tracer::Instance().Enable(traceFile);
+            spawnStart = camera_common::NowNs();
             this->world = _parent;
             //Standard objects
-            world->InsertModelFile("model://"+ground_plane);
-            world->InsertModelFile("model://"+sun);
+            insertModel(ground_plane);
+            insertModel(sun);
             
             //Insert surroundings
             string tmp = _sdf->Get<string>("surroundings");
@@ -75,7 +82,7 @@ namespace gazebo
             }
             si = 0;
             //spawnMap[surroundingsList.at(si)] = false;
-            world->InsertModelFile("model://"+surroundingsList.at(si));
+            insertModel(surroundingsList.at(si));
             
             //Inser focus object
             //load in focusList vector
@@ -90,16 +97,16 @@ namespace gazebo
                     //focusList.push_back(focusObject);
                     focusString = focusString.substr(found+1);
                     found=focusString.find(" ");
-                    world->InsertModelFile("model://"+focusObject);
+                    insertModel(focusObject);
                     spawnMap[focusObject] = false;
                 }
                 //focusList.push_back(focusString);
-                world->InsertModelFile("model://"+focusString);
+                insertModel(focusString);
                 spawnMap[focusString] = false;
             }else{
                 //focusList.push_back("box");
                 spawnMap["box"] = false;
-                world->InsertModelFile("model://box");
+                insertModel("box");
             }
             fi = 0;
             
@@ -109,7 +116,7 @@ namespace gazebo
                 camera = tmp;
                 cout << "cam: "<<camera<<endl;
             }
-            world->InsertModelFile("model://"+camera);
+            insertModel(camera);
             
             //Read saving location
             tmp = _sdf->Get<string>("savingLocation");
@@ -172,6 +179,7 @@ namespace gazebo
                 } 
             }
             if(ready){
+                camera_common::Tracer::Instance().Record("spawn barrier wait", "world", spawnStart, camera_common::NowNs());
                 reloading = false;
                 this->world->SetPaused(false);
                 msgs::Int msg;
@@ -211,8 +219,18 @@ namespace gazebo
                 }
             }
         }
+        //insert a model from the model database, asynchronously loaded by the world
+        private: void insertModel(const string &_name){
+            CAMERA_TRACE_SCOPE("InsertModelFile", "world");
+            world->InsertModelFile("model://"+_name);
+        }
+        
         //reload a simulation
         private: void reload(){
+            //everything of the previous episode is recorded by now
+            camera_common::Tracer::Instance().Flush();
+            CAMERA_TRACE_SCOPE("reload", "world");
+            spawnStart = camera_common::NowNs();
             this->world->SetPaused(true);
             
             int oldfi = fi;//save previous index